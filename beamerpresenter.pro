@@ -62,6 +62,10 @@ linux {
     #DEFINES += USE_WAYLAND_SUBMENU_PATCH
 }
 
+# Use LZ4 (liblz4) for the "lz" cache mode. Without this option a built-in
+# LZ codec is used, which is slightly slower and compresses slightly worse.
+#DEFINES += USE_LZ4
+
 # Disable debugging message if debugging mode is disabled.
 CONFIG(release, debug|release):DEFINES += QT_NO_DEBUG_OUTPUT
 # Enable specific debugging messages
@@ -77,16 +81,22 @@ CONFIG(debug, debug|release) {
     #DEFINES += DEBUG_INPUT
     #DEFINES += DEBUG_SLIDE_TRANSITIONS
     #DEFINES += DEBUG_MULTIMEDIA
+    # Enable the option --benchmark for benchmarks of internal components.
+    #DEFINES += ENABLE_BENCHMARKS
 }
 
 SOURCES += \
         src/main.cpp \
         src/pdf/pdfdoc.cpp \
         src/pdf/externalrenderer.cpp \
+        src/pdf/imagecodec.cpp \
         src/pdf/basicrenderer.cpp \
-        src/pdf/singlerenderer.cpp \
+        src/pdf/tilerenderer.cpp \
         src/pdf/cachemap.cpp \
-        src/pdf/cachethread.cpp \
+        src/pdf/cachemanager.cpp \
+        src/pdf/renderpool.cpp \
+        src/pdf/persistentrenderer.cpp \
+        src/pdf/diskcache.cpp \
         src/screens/controlscreen.cpp \
         src/screens/presentationscreen.cpp \
         src/slide/previewslide.cpp \
@@ -95,6 +105,10 @@ SOURCES += \
         src/slide/presentationslide.cpp \
         src/draw/pathoverlay.cpp \
         src/draw/drawpath.cpp \
+        src/draw/strokeindex.cpp \
+        src/draw/strokearena.cpp \
+        src/draw/zlibdevice.cpp \
+        src/draw/annotationfile.cpp \
         src/gui/timer.cpp \
         src/gui/pagenumberedit.cpp \
         src/gui/toolbutton.cpp \
@@ -111,10 +125,14 @@ HEADERS += \
         src/names.h \
         src/pdf/pdfdoc.h \
         src/pdf/externalrenderer.h \
+        src/pdf/imagecodec.h \
         src/pdf/basicrenderer.h \
-        src/pdf/singlerenderer.h \
+        src/pdf/tilerenderer.h \
         src/pdf/cachemap.h \
-        src/pdf/cachethread.h \
+        src/pdf/cachemanager.h \
+        src/pdf/renderpool.h \
+        src/pdf/persistentrenderer.h \
+        src/pdf/diskcache.h \
         src/screens/controlscreen.h \
         src/screens/presentationscreen.h \
         src/slide/previewslide.h \
@@ -123,6 +141,10 @@ HEADERS += \
         src/slide/presentationslide.h \
         src/draw/pathoverlay.h \
         src/draw/drawpath.h \
+        src/draw/strokeindex.h \
+        src/draw/strokearena.h \
+        src/draw/zlibdevice.h \
+        src/draw/annotationfile.h \
         src/gui/timer.h \
         src/gui/pagenumberedit.h \
         src/gui/toolbutton.h \
@@ -138,6 +160,10 @@ contains(DEFINES, EMBEDDED_APPLICATIONS_ENABLED) {
     SOURCES += src/slide/media/embedapp.cpp
     HEADERS += src/slide/media/embedapp.h
 }
+contains(DEFINES, ENABLE_BENCHMARKS) {
+    SOURCES += src/benchmark.cpp
+    HEADERS += src/benchmark.h
+}
 
 FORMS += \
         src/ui/controlscreen.ui
@@ -145,6 +171,9 @@ FORMS += \
 unix {
     INCLUDEPATH += /usr/include/poppler/qt5
     LIBS += -L /usr/lib/ -lpoppler-qt5
+    # zlib is used for reading and writing compressed drawing files.
+    LIBS += -lz
+    contains(DEFINES, USE_LZ4):LIBS += -llz4
 }
 macx {
     ## Please configure this according to your poppler installation.
@@ -175,7 +204,7 @@ unix {
 
     configuration.path = /etc/$${TARGET}/
     configuration.CONFIG = no_build
-    configuration.files = config/$${TARGET}.conf config/pid2wid.sh
+    configuration.files = config/$${TARGET}.conf config/pid2wid.sh config/renderworker.py
 
     icon.path = $${ICON_PATH}
     icon.CONFIG = no_build
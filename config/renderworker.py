@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# This file is part of BeamerPresenter.
+# Copyright (C) 2020  stiglers-eponym
+#
+# BeamerPresenter is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# BeamerPresenter is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Reference implementation of a persistent external renderer.
+
+Usage in the configuration of BeamerPresenter:
+    renderer-workers=2
+    renderer=python3 /etc/beamerpresenter/renderworker.py %file
+
+The PDF file is opened once. Requests are read from standard input, one per
+line: "<page> <width> <height>" (page numbers start at 1). Each reply is the
+size of the image as 4 byte big endian integer followed by the image (binary
+PPM). A size of 0 reports an error.
+
+Pages are rendered with PyMuPDF if it is installed. Otherwise a test pattern
+showing the page number as a bar is generated. This is useful for testing the
+protocol without any PDF library.
+"""
+
+import sys
+import struct
+
+try:
+    import fitz
+except ImportError:
+    fitz = None
+
+
+def render_mupdf(doc, page, width, height):
+    pdfpage = doc[page - 1]
+    matrix = fitz.Matrix(width / pdfpage.rect.width, height / pdfpage.rect.height)
+    return pdfpage.get_pixmap(matrix=matrix, alpha=False).tobytes("ppm")
+
+
+def render_pattern(pages, page, width, height):
+    # Light background with a dark bar, whose position shows the page number.
+    background = b"\xf0\xf0\xe0"
+    bar = b"\x20\x40\x80"
+    left = (page - 1) * width // max(pages, 1)
+    right = max(left + 1, page * width // max(pages, 1))
+    row = background * left + bar * (right - left) + background * (width - right)
+    plain = background * width
+    top = height // 3
+    bottom = 2 * height // 3
+    data = plain * top + row * (bottom - top) + plain * (height - bottom)
+    return b"P6\n%d %d\n255\n" % (width, height) + data
+
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: renderworker.py FILE", file=sys.stderr)
+        return 1
+    doc = fitz.open(sys.argv[1]) if fitz is not None else None
+    out = sys.stdout.buffer
+    for line in sys.stdin:
+        try:
+            page, width, height = (int(value) for value in line.split())
+            if doc is not None:
+                image = render_mupdf(doc, page, width, height)
+            else:
+                image = render_pattern(100, page, width, height)
+        except Exception as error:
+            print("renderworker.py:", error, file=sys.stderr)
+            image = b""
+        out.write(struct.pack(">I", len(image)))
+        out.write(image)
+        out.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,719 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+#include "pdf/imagecodec.h"
+#include "pdf/cachemap.h"
+#include "draw/strokeindex.h"
+#include "draw/zlibdevice.h"
+#include "draw/annotationfile.h"
+#include <QPainter>
+#include <QBuffer>
+#include <QDomDocument>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QTemporaryDir>
+#include <QFileInfo>
+#include "names.h"
+#include <random>
+#include <numeric>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+
+/// Heap memory in use in bytes, as reported by glibc. This includes the
+/// padding of the allocator and the allocations of all threads.
+/// Only used by benchmarkStrokeStorage.
+static qint64 heapInUse()
+{
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 const info = mallinfo2();
+#else
+    struct mallinfo const info = mallinfo();
+#endif
+    return qint64(info.uordblks) + qint64(info.hblkhd);
+}
+static constexpr bool heapMeasured = true;
+#else
+static qint64 heapInUse() {return 0;}
+static constexpr bool heapMeasured = false;
+#endif
+
+int runBenchmark(QString const& name, PdfDoc const* doc)
+{
+    if (name == "codecs")
+        benchmarkCacheCodecs(doc);
+    else if (name == "derived-caches")
+        benchmarkDerivedCaches(doc);
+    else if (name == "stroke-index")
+        benchmarkStrokeIndex();
+    else if (name == "stroke-decimation")
+        benchmarkStrokeDecimation();
+    else if (name == "stroke-storage")
+        benchmarkStrokeStorage();
+    else if (name == "annotation-files")
+        benchmarkAnnotationFiles();
+    else if (name == "annotation-container")
+        benchmarkAnnotationContainer();
+    else {
+        qCritical() << "Unknown benchmark" << name << "- available benchmarks are: codecs, derived-caches, stroke-index, stroke-decimation, stroke-storage, annotation-files, annotation-container";
+        return 1;
+    }
+    return 0;
+}
+
+void benchmarkCacheCodecs(PdfDoc const* doc)
+{
+    // Use at most 20 pages, equally distributed in the document.
+    int const numPages = doc->numPages();
+    int const step = numPages > 20 ? numPages / 20 : 1;
+    QList<QImage> images;
+    for (int page=0; page<numPages; page+=step) {
+        qreal const resolution = 3840. / doc->getPageSize(page).width();
+        images.append(doc->getPage(page)->renderToImage(72*resolution, 72*resolution));
+    }
+    qInfo() << "Cache codec benchmark:" << images.size() << "pages of" << images.first().size();
+    QElapsedTimer timer;
+    for (auto it = cacheCodecMap.cbegin(); it != cacheCodecMap.cend(); it++) {
+        if (it.key() == "lz4")
+            continue;
+        qint64 encodeTime = 0, decodeTime = 0, bytes = 0;
+        for (auto const& image : images) {
+            timer.start();
+            QByteArray const* data = ImageCodec::encode(image, *it);
+            encodeTime += timer.nsecsElapsed();
+            timer.start();
+            QPixmap const pixmap = ImageCodec::decodePixmap(*data);
+            decodeTime += timer.nsecsElapsed();
+            if (pixmap.size() != image.size())
+                qWarning() << "Decoded image has wrong size:" << pixmap.size();
+            bytes += data->size();
+            delete data;
+        }
+        qInfo().noquote()
+                << it.key().leftJustified(4)
+                << "encode:" << QString::number(1e-6*encodeTime/images.size(), 'f', 2) << "ms/page,"
+                << "decode:" << QString::number(1e-6*decodeTime/images.size(), 'f', 2) << "ms/page,"
+                << "size:" << QString::number(bytes/images.size()/1024) << "KiB/page";
+    }
+}
+
+void benchmarkDerivedCaches(PdfDoc const* doc)
+{
+    // Caches as used on the control screen: presentation (1920 pixels wide),
+    // previews (640 pixels) and overview thumbnails (320 pixels).
+    // Every navigation step requests the new page in all caches.
+    int const numPages = std::min(doc->numPages(), 50);
+    qreal const pageWidth = doc->getPageSize(0).width();
+    qInfo() << "Derived cache benchmark:" << numPages << "navigation steps";
+    QElapsedTimer timer;
+    for (bool const derive : {false, true}) {
+        CacheMap presentation(doc), previews(doc), thumbnails(doc);
+        presentation.changeResolution(1920. / pageWidth);
+        previews.changeResolution(640. / pageWidth);
+        thumbnails.changeResolution(320. / pageWidth);
+        for (CacheMap* cache : {&presentation, &previews, &thumbnails})
+            cache->setHotPages(-1);
+        if (derive) {
+            previews.setDownscaleSource(&presentation);
+            thumbnails.setDownscaleSource(&presentation);
+        }
+        timer.start();
+        for (int page=0; page<numPages; page++) {
+            presentation.getPixmap(page);
+            previews.getPixmap(page);
+            thumbnails.getPixmap(page);
+        }
+        qint64 const time = timer.nsecsElapsed();
+        int const popplerCalls = 3*numPages - previews.getDerivedPages() - thumbnails.getDerivedPages();
+        qInfo().noquote()
+                << (derive ? "derived: " : "separate:")
+                << "poppler calls:" << QString::number(double(popplerCalls)/numPages, 'f', 2) << "per navigation,"
+                << "time:" << QString::number(1e-6*time/numPages, 'f', 2) << "ms per navigation";
+    }
+}
+
+void benchmarkStrokeIndex()
+{
+    // Synthetic pages of 1920x1080 pixels with random strokes of 100 nodes,
+    // erased along a horizontal line with an eraser of radius 10 pixels.
+    int const nodes = 100, steps = 1000;
+    qreal const eraser = 10.;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<qreal> x(0., 1920.), y(0., 1080.), step(-4., 4.);
+    qInfo() << "Stroke index benchmark:" << steps << "eraser positions, strokes of" << nodes << "nodes";
+    QElapsedTimer timer;
+    for (int const strokes : {100, 1000, 10000}) {
+        StrokeArena arena;
+        QList<DrawPath*> paths;
+        QVector<QPointF> points(nodes);
+        for (int i=0; i<strokes; i++) {
+            points[0] = QPointF(x(random), y(random));
+            for (int j=1; j<nodes; j++)
+                points[j] = points[j-1] + QPointF(step(random), step(random));
+            paths.append(new DrawPath(&arena, {Pen, Qt::black, 2.}, points.constData(), nodes));
+        }
+        qint64 scanTime = 0, indexTime = 0;
+        int scanHits = 0, indexHits = 0;
+        QVector<int> all(nodes-1);
+        std::iota(all.begin(), all.end(), 0);
+        QVector<qreal> sections;
+        timer.start();
+        for (int i=0; i<steps; i++) {
+            QPointF const point(1920.*i/steps, 540.);
+            for (DrawPath const* path : paths) {
+                sections.clear();
+                path->sectionsIn(point, eraser, all, sections);
+                scanHits += sections.size()/2;
+            }
+        }
+        scanTime = timer.nsecsElapsed();
+        StrokeIndex index;
+        timer.start();
+        index.rebuild("", paths);
+        qint64 const buildTime = timer.nsecsElapsed();
+        timer.start();
+        for (int i=0; i<steps; i++) {
+            QPointF const point(1920.*i/steps, 540.);
+            QMap<int, QVector<int>> const found = index.segmentsNear(point, eraser);
+            for (QMap<int, QVector<int>>::const_iterator it=found.cbegin(); it!=found.cend(); it++) {
+                sections.clear();
+                paths[it.key()]->sectionsIn(point, eraser, *it, sections);
+                indexHits += sections.size()/2;
+            }
+        }
+        indexTime = timer.nsecsElapsed();
+        if (scanHits != indexHits)
+            qWarning() << "Stroke index found" << indexHits << "erased sections, scanning found" << scanHits;
+        qInfo().noquote()
+                << QString::number(strokes).rightJustified(5) << "strokes:"
+                << "scan:" << QString::number(1e-3*scanTime/steps, 'f', 1) << "us/event,"
+                << "index:" << QString::number(1e-3*indexTime/steps, 'f', 1) << "us/event,"
+                << "build:" << QString::number(1e-6*buildTime, 'f', 2) << "ms";
+        qDeleteAll(paths);
+    }
+}
+
+void benchmarkStrokeDecimation()
+{
+    // Handwriting: 500 strokes of 0.5 to 2 seconds, sampled at 200 Hz, with
+    // loops of about 20 pixels moving right at 100 pixels per second and
+    // 0.1 pixels of sensor noise.
+    // Every 10th input sample is erased with an eraser of radius 1 pixel,
+    // which must split the stored stroke (or remove it at its ends).
+    int const strokes = 500;
+    qreal const eraser = 1.;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<qreal> duration(.5, 2.), phase(0., 6.283), frequency(2., 5.), x(0., 1920.), y(0., 1080.);
+    std::normal_distribution<qreal> noise(0., .1);
+    QList<QVector<QPointF>> samples;
+    int total = 0;
+    for (int i=0; i<strokes; i++) {
+        QPointF const start(x(random), y(random));
+        qreal const fx = frequency(random), fy = frequency(random), px = phase(random), py = phase(random);
+        int const n = int(200*duration(random));
+        QVector<QPointF> stroke(n);
+        for (int j=0; j<n; j++) {
+            qreal const t = j/200.;
+            stroke[j] = start + QPointF(100*t + 10*std::sin(6.283*fx*t + px) + noise(random), 10*std::sin(6.283*fy*t + py) + noise(random));
+        }
+        total += n;
+        samples.append(stroke);
+    }
+    qInfo() << "Stroke decimation benchmark:" << strokes << "strokes," << total << "input samples";
+    QElapsedTimer timer;
+    StrokeArena arena;
+    for (qreal const tolerance : {0., .25, .5, 1., 2.}) {
+        DrawPath::setInputFilter(tolerance, 0.);
+        int stored = 0, erased = 0, missed = 0;
+        qreal maxDeviation = 0.;
+        qint64 time = 0;
+        QVector<int> all;
+        QVector<qreal> sections;
+        for (QVector<QPointF> const& stroke : samples) {
+            timer.start();
+            DrawPath path(&arena, {Pen, Qt::black, 2.}, stroke.first());
+            for (int j=1; j<stroke.length(); j++)
+                path.append(stroke[j]);
+            path.endDrawing();
+            time += timer.nsecsElapsed();
+            stored += path.number();
+            // Distance of the input samples from the stored stroke.
+            for (QPointF const& point : stroke) {
+                qreal distance2 = 1e30;
+                for (int k=1; k<path.number(); k++)
+                    distance2 = std::min(distance2, segmentDistance2(point, path.node(k-1), path.node(k)));
+                maxDeviation = std::max(maxDeviation, std::sqrt(distance2));
+            }
+            all.resize(path.segments());
+            std::iota(all.begin(), all.end(), 0);
+            for (int j=0; j<stroke.length(); j+=10) {
+                sections.clear();
+                path.sectionsIn(stroke[j], eraser, all, sections);
+                if (sections.isEmpty()) {
+                    missed++;
+                    continue;
+                }
+                // The remaining parts must not reach into the eraser.
+                bool inside = false;
+                qreal start = 0.;
+                for (int s=0; s<=sections.size(); s+=2) {
+                    qreal const end = s < sections.size() ? sections[s] : path.number() - 1;
+                    if (end > start) {
+                        DrawPath const* const part = path.split(start, end);
+                        for (int k=0; k<part->segments(); k++)
+                            inside |= segmentDistance2(stroke[j], part->segmentStart(k), part->segmentEnd(k)) < .99*eraser*eraser;
+                        delete part;
+                    }
+                    if (s < sections.size())
+                        start = sections[s+1];
+                }
+                if (inside)
+                    missed++;
+                else
+                    erased++;
+            }
+        }
+        if (missed > 0 && tolerance <= .5)
+            qWarning() << "Erasing failed at" << missed << "of" << missed + erased << "positions";
+        qInfo().noquote()
+                << "tolerance" << QString::number(tolerance, 'f', 2) << "px:"
+                << "stored" << QString::number(100.*stored/total, 'f', 1) << "% of samples,"
+                << "max. deviation:" << QString::number(maxDeviation, 'f', 2) << "px,"
+                << "time:" << QString::number(1e-3*time/total, 'f', 3) << "us/sample,"
+                << "erased:" << erased << "of" << erased + missed << "positions";
+    }
+}
+
+void benchmarkStrokeStorage()
+{
+    // An annotated lecture: 100 pages with 200 strokes of 20 to 200 nodes each.
+    // The previous storage (one vector of QPointF and one FullDrawTool per
+    // path) is reproduced here for comparison.
+    struct LegacyPath {
+        QVector<QPointF> path;
+        QRectF outer;
+        FullDrawTool tool;
+        quint32 hash;
+    };
+    int const pages = 100, strokes = 200;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> nodes(20, 200);
+    std::uniform_real_distribution<qreal> x(0., 1920.), y(0., 1080.), step(-4., 4.);
+    FullDrawTool const tools[] = {{Pen, Qt::red, 2.}, {Pen, Qt::blue, 2.}, {Highlighter, QColor(255,255,0), 20.}};
+    QList<QList<LegacyPath*>> legacy;
+    QList<StrokeArena*> arenas;
+    QList<QList<DrawPath*>> paths;
+    qint64 nodeCount = 0;
+    // Both storages are built from the same strokes. The heap memory which
+    // remains allocated after building them is measured. No other thread
+    // should allocate memory meanwhile.
+    qint64 bytes[2];
+    for (bool const useArena : {false, true}) {
+        random.seed(42);
+        qint64 const heapBefore = heapInUse();
+        for (int page=0; page<pages; page++) {
+            if (useArena) {
+                paths.append(QList<DrawPath*>());
+                arenas.append(new StrokeArena());
+            }
+            else
+                legacy.append(QList<LegacyPath*>());
+            for (int i=0; i<strokes; i++) {
+                QVector<QPointF> points(nodes(random));
+                points[0] = QPointF(x(random), y(random));
+                for (int j=1; j<points.length(); j++)
+                    points[j] = points[j-1] + QPointF(step(random), step(random));
+                FullDrawTool const& tool = tools[i % 3];
+                if (useArena)
+                    paths.last().append(new DrawPath(arenas.last(), tool, points.constData(), points.length()));
+                else {
+                    // The legacy path keeps points.
+                    legacy.last().append(new LegacyPath{points, QPolygonF(points).boundingRect(), tool, 0});
+                    nodeCount += points.length();
+                }
+            }
+        }
+        bytes[useArena] = heapInUse() - heapBefore;
+    }
+    int const pathCount = pages*strokes;
+    qInfo() << "Stroke storage benchmark:" << pages << "pages," << pathCount << "paths," << nodeCount << "nodes";
+    if (heapMeasured) {
+        qInfo().noquote() << "legacy: memory:" << QString::number(bytes[0]/1024) << "KiB";
+        qInfo().noquote() << "arena:  memory:" << QString::number(bytes[1]/1024) << "KiB";
+    }
+    else
+        qInfo() << "Heap memory is only measured with glibc";
+
+    // Drawing and serialization (as in PathOverlay::saveXML) of 10 pages.
+    QImage image(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+    QElapsedTimer timer;
+    QStringList legacyText;
+    QString text;
+    for (bool const useArena : {false, true}) {
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        timer.start();
+        for (int page=0; page<10; page++) {
+            for (int i=0; i<strokes; i++) {
+                FullDrawTool const& tool = useArena ? paths[page][i]->getTool() : legacy[page][i]->tool;
+                painter.setPen(QPen(tool.color, tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+                if (useArena)
+                    paths[page][i]->draw(painter);
+                else
+                    painter.drawPolyline(legacy[page][i]->path.constData(), legacy[page][i]->path.length());
+            }
+        }
+        qint64 const drawTime = timer.nsecsElapsed();
+        painter.end();
+        timer.start();
+        for (int page=0; page<10; page++) {
+            for (int i=0; i<strokes; i++) {
+                if (useArena) {
+                    text.resize(0);
+                    paths[page][i]->toText(text);
+                }
+                else {
+                    legacyText.clear();
+                    for (QPointF const& point : legacy[page][i]->path)
+                        legacyText << QString::number(point.x()) << QString::number(point.y());
+                }
+            }
+        }
+        qint64 const textTime = timer.nsecsElapsed();
+        qInfo().noquote()
+                << (useArena ? "arena: " : "legacy:")
+                << "draw:" << QString::number(1e-6*drawTime/10, 'f', 2) << "ms/page,"
+                << "serialize:" << QString::number(1e-6*textTime/10, 'f', 2) << "ms/page";
+    }
+    for (QList<LegacyPath*> const& list : legacy)
+        qDeleteAll(list);
+    for (QList<DrawPath*> const& list : paths)
+        qDeleteAll(list);
+    qDeleteAll(arenas);
+}
+
+void benchmarkAnnotationFiles()
+{
+    // An annotated lecture: 50 pages with 100 strokes of 20 to 200 nodes each
+    // (about 550000 nodes), in points on an A4 page.
+    // The previous implementation (QDomDocument, QStringList and qCompress)
+    // is reproduced here for comparison.
+    int const pages = 50, strokes = 100;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> nodes(20, 200);
+    std::uniform_real_distribution<qreal> x(0., 842.), y(0., 595.), step(-2., 2.);
+    FullDrawTool const tools[] = {{Pen, Qt::red, 1.}, {Pen, Qt::blue, 1.}, {Highlighter, QColor(255,255,0), 10.}};
+    StrokeArena arena;
+    QList<QList<DrawPath*>> paths;
+    qint64 nodeCount = 0;
+    for (int page=0; page<pages; page++) {
+        paths.append(QList<DrawPath*>());
+        for (int i=0; i<strokes; i++) {
+            QVector<QPointF> points(nodes(random));
+            points[0] = QPointF(x(random), y(random));
+            for (int j=1; j<points.length(); j++)
+                points[j] = points[j-1] + QPointF(step(random), step(random));
+            paths.last().append(new DrawPath(&arena, tools[i % 3], points.constData(), points.length()));
+            nodeCount += points.length();
+        }
+    }
+    qInfo() << "Annotation file benchmark:" << pages << "pages," << pages*strokes << "strokes," << nodeCount << "nodes";
+    QElapsedTimer timer;
+
+    // Legacy: build the document in memory and compress it at once.
+    timer.start();
+    QByteArray legacyFile;
+    qint64 legacyXmlSize;
+    {
+        QDomDocument doc("BeamerPresenter");
+        QDomElement root = doc.createElement("BeamerPresenter");
+        root.setAttribute("creator", "BeamerPresenter");
+        doc.appendChild(root);
+        for (int page=0; page<pages; page++) {
+            QDomElement page_element = doc.createElement("page");
+            page_element.setAttribute("label", QString::number(page+1));
+            root.appendChild(page_element);
+            for (DrawPath const* path : paths[page]) {
+                QDomElement stroke = doc.createElement("stroke");
+                page_element.appendChild(stroke);
+                stroke.setAttribute("tool", toolNames.value(path->getTool().tool));
+                stroke.setAttribute("color", path->getTool().color.name(QColor::HexArgb));
+                stroke.setAttribute("width", path->getTool().size);
+                QStringList stringList;
+                for (int i=0; i<path->number(); i++)
+                    stringList << QString::number(path->node(i).x()) << QString::number(path->node(i).y());
+                stroke.appendChild(doc.createTextNode(stringList.join(" ")));
+            }
+        }
+        QByteArray const xml = doc.toByteArray();
+        legacyXmlSize = xml.size();
+        legacyFile = qCompress(xml);
+    }
+    qint64 const legacySaveTime = timer.nsecsElapsed();
+    timer.start();
+    qint64 legacyNodes = 0;
+    {
+        QDomDocument doc("BeamerPresenter");
+        doc.setContent(qUncompress(legacyFile));
+        QDomElement const root = doc.documentElement();
+        for (QDomElement page_element = root.firstChildElement("page"); !page_element.isNull(); page_element = page_element.nextSiblingElement("page")) {
+            for (QDomElement stroke = page_element.firstChildElement("stroke"); !stroke.isNull(); stroke = stroke.nextSiblingElement("stroke")) {
+                QStringList const data = stroke.text().split(" ");
+                QVector<QPointF> points(data.size()/2);
+                for (int i=0; i<points.size(); i++)
+                    points[i] = QPointF(data[2*i].toDouble(), data[2*i+1].toDouble());
+                DrawPath path(&arena, {Pen, Qt::black, 1.}, points.constData(), points.length());
+                legacyNodes += path.number();
+            }
+        }
+    }
+    qint64 const legacyLoadTime = timer.nsecsElapsed();
+
+    // Streaming: as in PathOverlay::saveXML and PathOverlay::loadXML.
+    timer.start();
+    QByteArray streamFile;
+    {
+        QBuffer buffer(&streamFile);
+        buffer.open(QIODevice::WriteOnly);
+        ZlibDevice device(&buffer);
+        device.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&device);
+        writer.setAutoFormatting(true);
+        writer.setAutoFormattingIndent(1);
+        writer.writeStartDocument();
+        writer.writeStartElement("BeamerPresenter");
+        writer.writeAttribute("creator", "BeamerPresenter");
+        QString text;
+        for (int page=0; page<pages; page++) {
+            writer.writeStartElement("page");
+            writer.writeAttribute("label", QString::number(page+1));
+            for (DrawPath const* path : paths[page]) {
+                writer.writeStartElement("stroke");
+                writer.writeAttribute("tool", toolNames.value(path->getTool().tool));
+                writer.writeAttribute("color", path->getTool().color.name(QColor::HexArgb));
+                writer.writeAttribute("width", QString::number(path->getTool().size));
+                text.resize(0);
+                path->toText(text);
+                writer.writeCharacters(text);
+                writer.writeEndElement();
+            }
+            writer.writeEndElement();
+        }
+        writer.writeEndDocument();
+        device.close();
+    }
+    qint64 const streamSaveTime = timer.nsecsElapsed();
+    auto const streamLoad = [&arena](QByteArray& file) -> qint64 {
+        qint64 count = 0;
+        QBuffer buffer(&file);
+        buffer.open(QIODevice::ReadOnly);
+        ZlibDevice device(&buffer);
+        device.open(QIODevice::ReadOnly);
+        QXmlStreamReader reader(&device);
+        reader.readNextStartElement();
+        QVector<QPointF> points;
+        while (reader.readNextStartElement()) {
+            while (reader.readNextStartElement()) {
+                if (DrawPath::parseText(reader.readElementText(), points)) {
+                    DrawPath path(&arena, {Pen, Qt::black, 1.}, points.constData(), points.length());
+                    count += path.number();
+                }
+            }
+        }
+        if (reader.hasError())
+            qWarning() << "Reading failed:" << reader.errorString();
+        return count;
+    };
+    timer.start();
+    qint64 const streamNodes = streamLoad(streamFile);
+    qint64 const streamLoadTime = timer.nsecsElapsed();
+
+    // Compatibility: files written by both implementations must be readable by both.
+    qint64 const legacyReadByStream = streamLoad(legacyFile);
+    QDomDocument check;
+    bool const streamReadByLegacy = check.setContent(qUncompress(streamFile));
+    if (legacyNodes != nodeCount || streamNodes != nodeCount || legacyReadByStream != nodeCount || !streamReadByLegacy)
+        qWarning() << "Nodes read: legacy" << legacyNodes << "streaming" << streamNodes << "legacy file by streaming" << legacyReadByStream << "streaming file readable by legacy:" << streamReadByLegacy;
+
+    qInfo().noquote()
+            << "legacy:   save:" << QString::number(1e-6*legacySaveTime, 'f', 1) << "ms,"
+            << "load:" << QString::number(1e-6*legacyLoadTime, 'f', 1) << "ms,"
+            << "file:" << QString::number(legacyFile.size()/1024) << "KiB,"
+            << "XML in memory:" << QString::number(legacyXmlSize/1024) << "KiB";
+    qInfo().noquote()
+            << "streaming: save:" << QString::number(1e-6*streamSaveTime, 'f', 1) << "ms,"
+            << "load:" << QString::number(1e-6*streamLoadTime, 'f', 1) << "ms,"
+            << "file:" << QString::number(streamFile.size()/1024) << "KiB,"
+            << "XML in memory: none";
+    for (QList<DrawPath*> const& list : paths)
+        qDeleteAll(list);
+}
+
+void benchmarkAnnotationContainer()
+{
+    // The same synthetic lecture as in benchmarkAnnotationFiles:
+    // 50 pages with 100 strokes of 20 to 200 nodes each.
+    int const pages = 50, strokes = 100;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> nodes(20, 200);
+    std::uniform_real_distribution<qreal> x(0., 842.), y(0., 595.), step(-2., 2.);
+    FullDrawTool const tools[] = {{Pen, Qt::red, 1.}, {Pen, Qt::blue, 1.}, {Highlighter, QColor(255,255,0), 10.}};
+    StrokeArena arena;
+    QMap<QString, QList<DrawPath*>> paths;
+    qint64 nodeCount = 0;
+    for (int page=0; page<pages; page++) {
+        QList<DrawPath*>& list = paths[QString::number(page+1)];
+        for (int i=0; i<strokes; i++) {
+            QVector<QPointF> points(nodes(random));
+            points[0] = QPointF(x(random), y(random));
+            for (int j=1; j<points.length(); j++)
+                points[j] = points[j-1] + QPointF(step(random), step(random));
+            list.append(new DrawPath(&arena, tools[i % 3], points.constData(), points.length()));
+            nodeCount += points.length();
+        }
+    }
+    // The page shown first is the last page in the files: XML must be parsed
+    // completely to reach it.
+    QString const label = paths.lastKey();
+    qInfo() << "Annotation container benchmark:" << pages << "pages," << pages*strokes << "strokes," << nodeCount << "nodes";
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        qCritical() << "Cannot create temporary directory";
+        return;
+    }
+    QElapsedTimer timer;
+
+    // Compressed XML as written and read by PathOverlay.
+    QString const xmlPath = dir.filePath("annotations.bpr");
+    timer.start();
+    {
+        QFile file(xmlPath);
+        file.open(QIODevice::WriteOnly);
+        ZlibDevice device(&file);
+        device.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&device);
+        writer.setAutoFormatting(true);
+        writer.setAutoFormattingIndent(1);
+        writer.writeStartDocument();
+        writer.writeStartElement("BeamerPresenter");
+        writer.writeAttribute("creator", "BeamerPresenter");
+        QString text;
+        for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
+            writer.writeStartElement("page");
+            writer.writeAttribute("label", page_it.key());
+            for (DrawPath const* path : *page_it) {
+                writer.writeStartElement("stroke");
+                writer.writeAttribute("tool", toolNames.value(path->getTool().tool));
+                writer.writeAttribute("color", path->getTool().color.name(QColor::HexArgb));
+                writer.writeAttribute("width", QString::number(path->getTool().size));
+                text.resize(0);
+                path->toText(text);
+                writer.writeCharacters(text);
+                writer.writeEndElement();
+            }
+            writer.writeEndElement();
+        }
+        writer.writeEndDocument();
+        device.close();
+    }
+    qint64 const xmlSaveTime = timer.nsecsElapsed();
+    // Read pages until the page stop (all pages if stop is empty). Return the number of nodes.
+    auto const xmlLoad = [&xmlPath](QString const& stop) -> qint64 {
+        qint64 count = 0;
+        StrokeArena pageArena;
+        QList<DrawPath*> list;
+        QFile file(xmlPath);
+        file.open(QIODevice::ReadOnly);
+        ZlibDevice device(&file);
+        device.open(QIODevice::ReadOnly);
+        QXmlStreamReader reader(&device);
+        reader.readNextStartElement();
+        QVector<QPointF> points;
+        while (reader.readNextStartElement()) {
+            bool const last = reader.attributes().value("label") == stop;
+            while (reader.readNextStartElement()) {
+                if (DrawPath::parseText(reader.readElementText(), points))
+                    list.append(new DrawPath(&pageArena, {Pen, Qt::black, 1.}, points.constData(), points.length()));
+            }
+            if (last)
+                break;
+        }
+        for (DrawPath const* path : list)
+            count += path->number();
+        qDeleteAll(list);
+        return count;
+    };
+    timer.start();
+    qint64 const xmlPageNodes = xmlLoad(label);
+    qint64 const xmlPageTime = timer.nsecsElapsed();
+    timer.start();
+    qint64 const xmlNodes = xmlLoad(QString());
+    qint64 const xmlLoadTime = timer.nsecsElapsed();
+    if (xmlNodes != nodeCount)
+        qWarning() << "Nodes read from XML:" << xmlNodes << "expected:" << nodeCount;
+    qInfo().noquote()
+            << "XML:              save:" << QString::number(1e-6*xmlSaveTime, 'f', 1) << "ms,"
+            << "first page:" << QString::number(1e-6*xmlPageTime, 'f', 2) << "ms (" + QString::number(xmlPageNodes) + " nodes read),"
+            << "all pages:" << QString::number(1e-6*xmlLoadTime, 'f', 1) << "ms,"
+            << "file:" << QString::number(QFileInfo(xmlPath).size()/1024) << "KiB";
+
+    for (bool const compress : {false, true}) {
+        QString const path = dir.filePath(compress ? "compressed.bpa" : "uncompressed.bpa");
+        QString error;
+        timer.start();
+        if (!AnnotationFile::write(path, QJsonObject(), paths, compress, error)) {
+            qCritical() << "Writing annotation file failed:" << error;
+            break;
+        }
+        qint64 const saveTime = timer.nsecsElapsed();
+        // As in PathOverlay::loadBinary: read the index and the page which is shown.
+        StrokeArena pageArena;
+        QList<DrawPath*> list;
+        timer.start();
+        AnnotationFile file(path);
+        bool ok = file.open() && file.readPage(label, &pageArena, list);
+        qint64 const pageTime = timer.nsecsElapsed();
+        // Paths must be equal to the paths which were written.
+        QList<DrawPath*> const& original = paths[label];
+        ok &= list.length() == original.length();
+        for (int i=0; ok && i<list.length(); i++)
+            ok &= list[i]->getHash() == original[i]->getHash() && list[i]->getTool().tool == original[i]->getTool().tool;
+        qDeleteAll(list);
+        list.clear();
+        timer.start();
+        QList<QString> const labels = file.labels();
+        for (QString const& page : labels)
+            ok &= file.readPage(page, &pageArena, list);
+        qint64 const loadTime = timer.nsecsElapsed();
+        qint64 count = 0;
+        for (DrawPath const* stroke : list)
+            count += stroke->number();
+        qDeleteAll(list);
+        if (!ok || count != nodeCount)
+            qWarning() << "Reading annotation file failed:" << file.errorString() << "nodes read:" << count << "expected:" << nodeCount;
+        qInfo().noquote()
+                << (compress ? "binary, zlib:     save:" : "binary, raw:      save:") << QString::number(1e-6*saveTime, 'f', 1) << "ms,"
+                << "first page:" << QString::number(1e-6*pageTime, 'f', 2) << "ms,"
+                << "all pages:" << QString::number(1e-6*loadTime, 'f', 1) << "ms,"
+                << "file:" << QString::number(QFileInfo(path).size()/1024) << "KiB";
+    }
+    for (QList<DrawPath*> const& list : paths)
+        qDeleteAll(list);
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QtDebug>
+#include <QString>
+#include <QElapsedTimer>
+#include "pdf/pdfdoc.h"
+
+// Benchmarks of internal components.
+// These are only compiled if ENABLE_BENCHMARKS is defined. They are started
+// with the command line option --benchmark=<name> and print their results.
+
+/// Run the benchmark with the given name on doc. Returns the exit status.
+int runBenchmark(QString const& name, PdfDoc const* doc);
+
+/// Compare encode time, decode time and size of rendered pages for all cache codecs.
+/// Pages are rendered to a width of 3840 pixels (4K projector).
+void benchmarkCacheCodecs(PdfDoc const* doc);
+
+/// Compare navigation with and without deriving previews and thumbnails from the presentation cache.
+/// Reports poppler calls and time per navigation step.
+void benchmarkDerivedCaches(PdfDoc const* doc);
+
+/// Compare hit-testing for the eraser by scanning all paths and with the spatial index
+/// on synthetic pages with many strokes. This does not use the document.
+void benchmarkStrokeIndex();
+
+/// Report the reduction of stored points by the input filter of DrawPath for
+/// different tolerances, replaying synthetic handwriting sampled at 200 Hz.
+/// This does not use the document.
+void benchmarkStrokeDecimation();
+
+/// Compare memory, drawing and serialization of paths stored in
+/// StrokeArena with the previous storage of one vector per path.
+/// Heap memory is measured using mallinfo2 (only with glibc).
+/// This does not use the document.
+void benchmarkStrokeStorage();
+
+/// Compare saving and loading annotations with the streaming XML reader and writer
+/// (as in PathOverlay) to building a QDomDocument, for files with more than 100000 nodes.
+/// Also checks that files are compatible in both directions. This does not use the document.
+void benchmarkAnnotationFiles();
+
+/// Compare the binary annotation container (AnnotationFile) with and without
+/// compression to compressed XML: file size, saving, loading the page shown
+/// first and loading all pages. Files are written to a temporary directory.
+/// This does not use the document.
+void benchmarkAnnotationContainer();
+
+#endif // BENCHMARK_H
@@ -0,0 +1,318 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "annotationfile.h"
+#include <QJsonDocument>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+/// Magic number at the beginning of the file.
+static constexpr char magic[4] = {'B', 'P', 'A', 'N'};
+/// Version of the format. Files written by later versions are rejected.
+static constexpr quint32 formatVersion = 1;
+static constexpr int headerSize = 32;
+static constexpr int entrySize = 40;
+/// Codes of the tools in stroke records.
+static constexpr quint32 penCode = 1;
+static constexpr quint32 highlighterCode = 2;
+
+/// Record of a stroke in the page data.
+struct StrokeRecord {
+    quint32 tool;
+    /// Color as #AARRGGBB.
+    quint32 color;
+    /// Stroke width in points.
+    float width;
+    quint32 nodes;
+};
+static_assert(sizeof(StrokeRecord) == 16, "Unexpected size of StrokeRecord");
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+/// Page data consist only of 32 bit words, which are stored in little endian byte order.
+static void swapWords(char* data, int const size)
+{
+    for (int i=0; i+4<=size; i+=4) {
+        quint32 word;
+        std::memcpy(&word, data + i, 4);
+        word = qbswap(word);
+        std::memcpy(data + i, &word, 4);
+    }
+}
+#endif
+
+bool AnnotationFile::hasMagic(QByteArray const& head)
+{
+    return head.size() >= 4 && std::memcmp(head.constData(), magic, 4) == 0;
+}
+
+bool AnnotationFile::open()
+{
+    close();
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    if (file.size() < headerSize || !hasMagic(file.peek(4))) {
+        error = "Not a BeamerPresenter annotation file";
+        file.close();
+        return false;
+    }
+    size = file.size();
+    modified = QFileInfo(file).lastModified();
+    // The file is not mapped to memory: reading a mapped file which is
+    // truncated by another process crashes the program.
+    QByteArray const head = file.read(headerSize);
+    uchar const* data = reinterpret_cast<uchar const*>(head.constData());
+    quint32 const version = qFromLittleEndian<quint32>(data + 4);
+    quint32 const pageCount = qFromLittleEndian<quint32>(data + 8);
+    quint32 const metadataSize = qFromLittleEndian<quint32>(data + 12);
+    quint64 const metadataOffset = qFromLittleEndian<quint64>(data + 16);
+    quint64 const indexOffset = qFromLittleEndian<quint64>(data + 24);
+    if (version > formatVersion) {
+        error = "Annotation file was written by a newer version of BeamerPresenter";
+        close();
+        return false;
+    }
+    if (head.size() != headerSize
+            || metadataOffset > quint64(size) || metadataSize > quint64(size) - metadataOffset
+            || indexOffset > quint64(size) || pageCount > (quint64(size) - indexOffset)/entrySize) {
+        error = "Annotation file is corrupt";
+        close();
+        return false;
+    }
+    // Header, metadata, labels and index precede the page data: read all of them at once.
+    quint64 const indexEnd = indexOffset + quint64(pageCount)*entrySize;
+    QByteArray contents;
+    if (indexEnd <= quint64(std::numeric_limits<int>::max()) && file.seek(0))
+        contents = file.read(qint64(indexEnd));
+    if (quint64(contents.size()) != indexEnd || metadataOffset + metadataSize > indexEnd) {
+        error = "Annotation file is corrupt";
+        close();
+        return false;
+    }
+    data = reinterpret_cast<uchar const*>(contents.constData());
+    metadata = QJsonDocument::fromJson(QByteArray::fromRawData(reinterpret_cast<char const*>(data + metadataOffset), int(metadataSize))).object();
+    for (quint32 i=0; i<pageCount; i++) {
+        uchar const* const entry = data + indexOffset + quint64(i)*entrySize;
+        Page page;
+        page.offset = qFromLittleEndian<quint64>(entry);
+        quint64 const labelOffset = qFromLittleEndian<quint64>(entry + 8);
+        quint32 const labelSize = qFromLittleEndian<quint32>(entry + 16);
+        page.size = qFromLittleEndian<quint32>(entry + 20);
+        page.rawSize = qFromLittleEndian<quint32>(entry + 24);
+        page.strokes = qFromLittleEndian<quint32>(entry + 28);
+        page.nodes = qFromLittleEndian<quint32>(entry + 32);
+        page.flags = qFromLittleEndian<quint32>(entry + 36);
+        if (labelOffset > indexEnd || labelSize > indexEnd - labelOffset
+                || page.offset > quint64(size) || page.size > quint64(size) - page.offset
+                || page.rawSize > quint32(std::numeric_limits<int>::max())) {
+            error = "Annotation file is corrupt";
+            close();
+            return false;
+        }
+        pages.insert(QString::fromUtf8(reinterpret_cast<char const*>(data + labelOffset), int(labelSize)), page);
+    }
+    return true;
+}
+
+void AnnotationFile::close()
+{
+    size = 0;
+    modified = QDateTime();
+    pages.clear();
+    metadata = QJsonObject();
+    file.close();
+}
+
+bool AnnotationFile::readPage(QString const& label, StrokeArena* arena, QList<DrawPath*>& list)
+{
+    QMap<QString, Page>::const_iterator const page = pages.constFind(label);
+    if (page == pages.cend() || !file.isOpen())
+        return false;
+    if (quint64(page->strokes)*sizeof(StrokeRecord) + quint64(page->nodes)*2*sizeof(float) != page->rawSize
+            || (!(page->flags & Compressed) && page->size != page->rawSize)) {
+        error = "Annotation file is corrupt";
+        return false;
+    }
+    // The offsets in the index are only valid for the file as it was opened.
+    QFileInfo const info(file);
+    if (info.size() != size || info.lastModified() != modified) {
+        error = "Annotation file was modified after opening it";
+        return false;
+    }
+    QByteArray buffer;
+    if (file.seek(qint64(page->offset)))
+        buffer = file.read(page->size);
+    if (buffer.size() != int(page->size)) {
+        error = "Annotation file is corrupt";
+        return false;
+    }
+    if (page->flags & Compressed) {
+        QByteArray unpacked(int(page->rawSize), Qt::Uninitialized);
+        uLongf length = page->rawSize;
+        if (uncompress(reinterpret_cast<Bytef*>(unpacked.data()), &length, reinterpret_cast<Bytef const*>(buffer.constData()), page->size) != Z_OK || length != page->rawSize) {
+            error = "Annotation file is corrupt";
+            return false;
+        }
+        buffer = unpacked;
+    }
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    swapWords(buffer.data(), buffer.size());
+#endif
+    char const* const raw = buffer.constData();
+    // Check all records before creating any path, such that a corrupt page leaves list unchanged.
+    char const* coordinates = raw + page->strokes*sizeof(StrokeRecord);
+    quint32 remaining = page->nodes;
+    for (quint32 i=0; i<page->strokes; i++) {
+        StrokeRecord record;
+        std::memcpy(&record, raw + i*sizeof(StrokeRecord), sizeof(StrokeRecord));
+        bool valid = record.nodes <= remaining && std::isfinite(record.width) && record.width >= 0;
+        float const* const nodes = reinterpret_cast<float const*>(coordinates);
+        for (quint32 j=0; valid && j<2*record.nodes; j++)
+            valid = std::isfinite(nodes[j]);
+        if (!valid) {
+            error = "Annotation file is corrupt";
+            return false;
+        }
+        remaining -= record.nodes;
+        coordinates += 2*sizeof(float)*record.nodes;
+    }
+    // Coordinates are copied to the arena without any conversion.
+    coordinates = raw + page->strokes*sizeof(StrokeRecord);
+    list.reserve(list.size() + int(page->strokes));
+    for (quint32 i=0; i<page->strokes; i++) {
+        StrokeRecord record;
+        std::memcpy(&record, raw + i*sizeof(StrokeRecord), sizeof(StrokeRecord));
+        DrawTool const tool = record.tool == penCode ? Pen : record.tool == highlighterCode ? Highlighter : NoTool;
+        if (tool != NoTool && record.nodes > 0)
+            list.append(new DrawPath(arena, {tool, QColor::fromRgba(record.color), record.width}, reinterpret_cast<float const*>(coordinates), int(record.nodes)));
+        else
+            qWarning() << "Ignoring invalid stroke on page" << label;
+        coordinates += 2*sizeof(float)*record.nodes;
+    }
+    return true;
+}
+
+bool AnnotationFile::write(QString const& filename, QJsonObject const& metadata, QMap<QString, QList<DrawPath*>> const& paths, bool const compress, QString& error)
+{
+    // Replace the file atomically: an existing file is kept if writing fails.
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    QByteArray const metadataData = QJsonDocument(metadata).toJson(QJsonDocument::Compact);
+    QByteArray labelData;
+    QVector<quint64> labelOffsets;
+    labelOffsets.reserve(paths.size() + 1);
+    quint64 const labelsOffset = headerSize + quint64(metadataData.size());
+    for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
+        labelOffsets.append(labelsOffset + quint64(labelData.size()));
+        labelData.append(page_it.key().toUtf8());
+    }
+    labelOffsets.append(labelsOffset + quint64(labelData.size()));
+    // The index and the page data are aligned to 8 bytes.
+    labelData.append(QByteArray(int((8 - labelOffsets.last() % 8) % 8), '\0'));
+    quint64 const indexOffset = labelsOffset + quint64(labelData.size());
+
+    QByteArray head(headerSize, '\0');
+    uchar* const header = reinterpret_cast<uchar*>(head.data());
+    std::memcpy(header, magic, 4);
+    qToLittleEndian<quint32>(formatVersion, header + 4);
+    qToLittleEndian<quint32>(quint32(paths.size()), header + 8);
+    qToLittleEndian<quint32>(quint32(metadataData.size()), header + 12);
+    qToLittleEndian<quint64>(headerSize, header + 16);
+    qToLittleEndian<quint64>(indexOffset, header + 24);
+    file.write(head);
+    file.write(metadataData);
+    file.write(labelData);
+    // The index is written after the pages, when the offsets are known.
+    QByteArray index(entrySize*paths.size(), '\0');
+    file.write(index);
+
+    /// Uncompressed data of the current page. The buffer is reused for all pages.
+    QByteArray raw;
+    QByteArray packed;
+    int i = 0;
+    for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++, i++) {
+        quint32 strokes = 0, nodes = 0;
+        for (QList<DrawPath*>::const_iterator path_it=page_it->cbegin(); path_it!=page_it->cend(); path_it++) {
+            DrawTool const tool = (*path_it)->getTool().tool;
+            if ((tool == Pen || tool == Highlighter) && !(*path_it)->isEmpty()) {
+                strokes++;
+                nodes += quint32((*path_it)->number());
+            }
+        }
+        raw.resize(int(strokes*sizeof(StrokeRecord) + nodes*2*sizeof(float)));
+        char* record = raw.data();
+        char* coordinates = raw.data() + strokes*sizeof(StrokeRecord);
+        for (QList<DrawPath*>::const_iterator path_it=page_it->cbegin(); path_it!=page_it->cend(); path_it++) {
+            FullDrawTool const& tool = (*path_it)->getTool();
+            if ((tool.tool != Pen && tool.tool != Highlighter) || (*path_it)->isEmpty())
+                continue;
+            StrokeRecord const stroke {
+                tool.tool == Pen ? penCode : highlighterCode,
+                tool.color.rgba(),
+                float(tool.size),
+                quint32((*path_it)->number())
+            };
+            std::memcpy(record, &stroke, sizeof(StrokeRecord));
+            record += sizeof(StrokeRecord);
+            size_t const bytes = 2*sizeof(float)*size_t(stroke.nodes);
+            std::memcpy(coordinates, (*path_it)->coordinates(), bytes);
+            coordinates += bytes;
+        }
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        swapWords(raw.data(), raw.size());
+#endif
+        quint32 flags = 0;
+        QByteArray const* out = &raw;
+        if (compress && !raw.isEmpty()) {
+            uLongf length = compressBound(uLong(raw.size()));
+            packed.resize(int(length));
+            if (compress2(reinterpret_cast<Bytef*>(packed.data()), &length, reinterpret_cast<Bytef const*>(raw.constData()), uLong(raw.size()), Z_DEFAULT_COMPRESSION) == Z_OK
+                    && length < uLongf(raw.size())) {
+                packed.resize(int(length));
+                out = &packed;
+                flags |= Compressed;
+            }
+        }
+        uchar* const entry = reinterpret_cast<uchar*>(index.data()) + i*entrySize;
+        qToLittleEndian<quint64>(quint64(file.pos()), entry);
+        qToLittleEndian<quint64>(labelOffsets[i], entry + 8);
+        qToLittleEndian<quint32>(quint32(labelOffsets[i+1] - labelOffsets[i]), entry + 16);
+        qToLittleEndian<quint32>(quint32(out->size()), entry + 20);
+        qToLittleEndian<quint32>(quint32(raw.size()), entry + 24);
+        qToLittleEndian<quint32>(strokes, entry + 28);
+        qToLittleEndian<quint32>(nodes, entry + 32);
+        qToLittleEndian<quint32>(flags, entry + 36);
+        file.write(*out);
+        if (out->size() % 8)
+            file.write(QByteArray(8 - out->size() % 8, '\0'));
+    }
+    if (!file.seek(qint64(indexOffset)) || file.write(index) != index.size() || !file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANNOTATIONFILE_H
+#define ANNOTATIONFILE_H
+
+#include <QtDebug>
+#include <QFile>
+#include <QDateTime>
+#include <QMap>
+#include <QJsonObject>
+#include "drawpath.h"
+
+/// Binary container for the drawings of all pages.
+///
+/// The file starts with a header and an index table, which maps page labels
+/// to blocks of data. Only the header, the metadata and the index are read
+/// when the file is opened. The block of a page is only read and decoded when
+/// the page is requested, such that the size of the file hardly affects the
+/// time required to show the first page. The file must not be modified while
+/// pages are pending: readPage fails if the file has changed since open().
+///
+/// All numbers are stored in little endian byte order:
+///
+///     header (32 bytes): "BPAN", version, number of pages, size of metadata,
+///                        offset of metadata (64 bit), offset of index (64 bit)
+///     metadata:          JSON object (UTF-8) with file names of the PDF files
+///     labels:            page labels (UTF-8), referenced by the index
+///     index:             40 bytes per page: offset of the data (64 bit),
+///                        offset of the label (64 bit), size of the label,
+///                        size of the data, uncompressed size of the data,
+///                        number of strokes, number of nodes, flags
+///     page data:         one block per page, optionally compressed with zlib
+///
+/// Uncompressed page data contain one record of 16 bytes per stroke (tool,
+/// color as #AARRGGBB, width as float32, number of nodes), followed by the
+/// coordinates of all nodes of all strokes as float32 in points (x and y
+/// alternating). The coordinates can be copied to a StrokeArena directly.
+class AnnotationFile
+{
+public:
+    /// Entry of the index table.
+    struct Page {
+        /// Offset of the data in the file.
+        quint64 offset;
+        /// Size of the data in the file.
+        quint32 size;
+        /// Size of the uncompressed data.
+        quint32 rawSize;
+        quint32 strokes;
+        quint32 nodes;
+        /// Combination of PageFlags.
+        quint32 flags;
+    };
+    enum PageFlags {
+        /// Data are compressed with zlib.
+        Compressed = 1,
+    };
+
+    explicit AnnotationFile(QString const& filename) : file(filename) {}
+    ~AnnotationFile() {close();}
+    AnnotationFile(AnnotationFile const&) = delete;
+    AnnotationFile& operator=(AnnotationFile const&) = delete;
+
+    /// Does head (the first bytes of a file) start with the magic number of this format?
+    static bool hasMagic(QByteArray const& head);
+    /// Open the file and read the header, the metadata and the index.
+    /// Returns false if the file is not readable or not a valid annotation file.
+    bool open();
+    /// Close the file.
+    void close();
+    QString const& errorString() const {return error;}
+    /// Metadata: "presentation" and "notes" contain objects with the keys "file", "pages" and "modified".
+    QJsonObject const& getMetadata() const {return metadata;}
+    /// Labels of all pages in the file.
+    QList<QString> const labels() const {return pages.keys();}
+    bool contains(QString const& label) const {return pages.contains(label);}
+    /// Decode the strokes of page label and append them to list. Their nodes are stored in arena.
+    /// Returns false and leaves list unchanged if the data of the page are corrupt or if
+    /// the file has been modified since it was opened.
+    bool readPage(QString const& label, StrokeArena* arena, QList<DrawPath*>& list);
+
+    /// Write paths to filename. If compress is true, pages are compressed if this reduces their size.
+    /// Returns false and sets error if writing failed. The file is replaced atomically: an existing file is kept if writing fails.
+    static bool write(QString const& filename, QJsonObject const& metadata, QMap<QString, QList<DrawPath*>> const& paths, bool const compress, QString& error);
+
+private:
+    QFile file;
+    /// Size of the file when it was opened.
+    qint64 size = 0;
+    /// Modification time of the file when it was opened.
+    QDateTime modified;
+    QJsonObject metadata;
+    /// Index table.
+    QMap<QString, Page> pages;
+    QString error;
+};
+
+#endif // ANNOTATIONFILE_H
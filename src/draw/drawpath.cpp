@@ -16,30 +16,75 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+
 #include "drawpath.h"
+#include <QPainter>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+qreal DrawPath::tolerance = 0.5;
+qreal DrawPath::smoothing = 0.;
 
 qreal square(qreal const a)
 {
     return a*a;
 }
 
-DrawPath::DrawPath(FullDrawTool const& tool, QPointF const& start) :
-    tool(tool)
+qreal segmentDistance2(QPointF const& point, QPointF const& start, QPointF const& end)
+{
+    QPointF const direction = end - start;
+    qreal const length2 = QPointF::dotProduct(direction, direction);
+    qreal const t = length2 > 0 ? qBound(0., QPointF::dotProduct(point - start, direction)/length2, 1.) : 0.;
+    QPointF const diff = point - start - t*direction;
+    return QPointF::dotProduct(diff, diff);
+}
+
+bool segmentCircleSection(QPointF const& start, QPointF const& end, QPointF const& center, qreal const radius, qreal& t0, qreal& t1)
 {
-    path.append(start);
+    // Solve |start + t*(end - start) - center|^2 = radius^2 for t.
+    QPointF const direction = end - start, diff = start - center;
+    qreal const a = QPointF::dotProduct(direction, direction);
+    qreal const b = QPointF::dotProduct(diff, direction);
+    qreal const c = QPointF::dotProduct(diff, diff) - radius*radius;
+    if (a <= 0) {
+        t0 = t1 = 0.;
+        return c < 0;
+    }
+    qreal const discriminant = b*b - a*c;
+    if (discriminant <= 0)
+        return false;
+    qreal const root = std::sqrt(discriminant);
+    t0 = (-b - root)/a;
+    t1 = (-b + root)/a;
+    if (t1 <= 0. || t0 >= 1.)
+        return false;
+    t0 = std::max(t0, 0.);
+    t1 = std::min(t1, 1.);
+    return true;
+}
+
+DrawPath::DrawPath(StrokeArena* arena, FullDrawTool const& tool, QPointF const& start) :
+    arena(arena),
+    toolId(StrokeArena::toolId(tool))
+{
+    offset = arena->allocate(this, 0);
+    appendNode(start);
     outer = QRectF(start.x(), start.y(), 0, 0);
     updateHash();
 }
 
-DrawPath::DrawPath(FullDrawTool const& tool, QPointF const* const points, int const number) :
-    path(QVector<QPointF>(number)),
-    tool(tool)
+DrawPath::DrawPath(StrokeArena* arena, FullDrawTool const& tool, QPointF const* const points, int const number) :
+    arena(arena),
+    toolId(StrokeArena::toolId(tool))
 {
+    offset = arena->allocate(this, number);
+    length = number;
     if (number == 0)
         return;
     double left=points[0].x(), right=points[0].x(), top=points[0].y(), bottom=points[0].y();
     for (int i=0; i<number; i++) {
-        path[i] = points[i];
+        setNode(i, points[i]);
         if (left > points[i].x())
             left = points[i].x();
         else if (right < points[i].x())
@@ -53,53 +98,158 @@ DrawPath::DrawPath(FullDrawTool const& tool, QPointF const* const points, int co
     updateHash();
 }
 
-DrawPath::DrawPath(DrawPath const& old, QPointF const shift, double const scale) :
-    path(QVector<QPointF>(old.path.length())),
-    tool({old.tool.tool, old.tool.color, scale*old.tool.size}),
+DrawPath::DrawPath(StrokeArena* arena, FullDrawTool const& tool, float const* const coordinates, int const number) :
+    arena(arena),
+    toolId(StrokeArena::toolId(tool))
+{
+    offset = arena->allocate(this, number);
+    length = number;
+    if (number == 0)
+        return;
+    float* const data = arena->data(offset);
+    std::memcpy(data, coordinates, 2*sizeof(float)*size_t(number));
+    float left=data[0], right=data[0], top=data[1], bottom=data[1];
+    for (int i=2; i<2*number; i+=2) {
+        if (left > data[i])
+            left = data[i];
+        else if (right < data[i])
+            right = data[i];
+        if (bottom < data[i+1])
+            bottom = data[i+1];
+        else if (top > data[i+1])
+            top = data[i+1];
+    }
+    outer = QRectF(left, top, right-left, bottom-top);
+    updateHash();
+}
+
+DrawPath::DrawPath(DrawPath const& source, qreal const start, qreal const end) :
+    arena(source.arena),
+    toolId(source.toolId)
+{
+    // Nodes strictly between start and end are copied.
+    int const first = int(std::floor(start)) + 1, last = int(std::ceil(end)) - 1;
+    int const inner = std::max(last - first + 1, 0);
+    QPolygonF nodes;
+    nodes.reserve(inner + 2);
+    auto const position = [&source](qreal const pos) {
+        int const k = std::min(int(pos), source.segments() - 1);
+        return source.segmentStart(k) + (pos - k)*(source.segmentEnd(k) - source.segmentStart(k));
+    };
+    nodes << position(start);
+    for (int i=first; i<=last; i++)
+        nodes << source.node(i);
+    if (end > start)
+        nodes << position(end);
+    length = nodes.length();
+    offset = arena->allocate(this, length);
+    for (int i=0; i<length; i++)
+        setNode(i, nodes[i]);
+    outer = nodes.boundingRect();
+    updateHash();
+}
+
+DrawPath::DrawPath(StrokeArena* arena, DrawPath const& old) :
+    arena(arena),
+    toolId(old.toolId),
+    outer(old.outer),
     hash(old.hash)
 {
-    for (int i=0; i<old.path.length(); i++)
-        path[i] = scale*old.path[i] + shift;
-    outer = QRectF(scale*old.outer.topLeft() + shift, scale*old.outer.bottomRight() + shift);
+    offset = arena->allocate(this, old.length);
+    length = old.length;
+    std::memcpy(arena->data(offset), old.arena->data(old.offset), 2*sizeof(float)*size_t(length));
 }
 
-QRect const DrawPath::update(DrawPath const& new_path, QPointF const shift, double const scale)
+QRectF const DrawPath::setNodes(int const first, QVector<QPointF> const& nodes, quint32 const newHash)
 {
-    if (new_path.tool.tool != tool.tool || new_path.tool.color != tool.color || new_path.path.length() < path.length())
-        return QRect(0,0,-1,-1);
-    if (new_path.path.length() == path.length() + 1) {
-        path.append(scale*new_path.path.last() + shift);
-        outer = QRectF(scale*new_path.outer.topLeft() + shift, scale*new_path.outer.bottomRight() + shift);
-        hash = new_path.hash;
-        return QRectF(path.last(), *(path.cend()-2)).normalized()
-                .adjusted(-tool.size/2-.5, -tool.size/2-.5, tool.size/2+.5, tool.size/2+.5)
-                .toAlignedRect();
-    }
-    for (QVector<QPointF>::const_iterator it = new_path.path.cbegin() + path.length(); it != new_path.path.cend();) {
-        path.append(scale*(*it++) + shift);
+    if (first < 0 || first > length || nodes.isEmpty())
+        return QRectF();
+    QPolygonF changed;
+    if (first > 0)
+        changed << node(first-1);
+    for (int i=first; i<length; i++)
+        changed << node(i);
+    for (int i=0; i<nodes.length(); i++) {
+        if (first + i < length)
+            setNode(first + i, nodes[i]);
+        else
+            appendNode(nodes[i]);
+        changed << nodes[i];
     }
-    outer = QRectF(scale*new_path.outer.topLeft() + shift, scale*new_path.outer.bottomRight() + shift);
-    hash = new_path.hash;
-    return getOuterDrawing().toAlignedRect();
+    outer = outer.united(changed.boundingRect());
+    hash = newHash;
+    qreal const size = getTool().size;
+    return changed.boundingRect().adjusted(-size/2, -size/2, size/2, size/2);
 }
 
 DrawPath::DrawPath(DrawPath const& old) :
-    path(old.path),
+    arena(old.arena),
+    toolId(old.toolId),
     outer(old.outer),
-    tool(old.tool),
     hash(old.hash)
-{}
+{
+    offset = arena->allocate(this, old.length);
+    length = old.length;
+    std::memcpy(arena->data(offset), arena->data(old.offset), 2*sizeof(float)*size_t(length));
+}
 
-void DrawPath::transform(QPointF const& shift, const double scale)
+void DrawPath::moveTo(StrokeArena* newArena)
 {
-    for (int i=0; i<path.length(); i++)
-        path[i] = scale*path[i] + shift;
-    outer = QRectF(scale*outer.topLeft() + shift, scale*outer.bottomRight() + shift);
-    tool.size *= scale;
+    if (newArena == arena)
+        return;
+    // A path is only listed in one arena: the nodes are copied before they are released.
+    std::vector<float> const nodes(coordinates(), coordinates() + 2*length);
+    arena->release(this, offset, length);
+    arena = newArena;
+    offset = arena->allocate(this, length);
+    std::memcpy(arena->data(offset), nodes.data(), 2*sizeof(float)*size_t(length));
 }
 
-void DrawPath::append(QPointF const& point)
+void DrawPath::draw(QPainter& painter, int const first) const
 {
+    if (first >= length)
+        return;
+    // Nodes are converted to a buffer which is kept for the next path.
+    static QVector<QPointF> buffer;
+    buffer.resize(length - first);
+    float const* data = arena->data(offset + first);
+    for (QPointF& point : buffer) {
+        point = QPointF(data[0], data[1]);
+        data += 2;
+    }
+    painter.drawPolyline(buffer.constData(), buffer.length());
+}
+
+QRectF const DrawPath::append(QPointF const& sample, qreal const resolution)
+{
+    samples++;
+    QPointF const last = length > 0 ? node(length-1) : sample;
+    QPointF const point = (smoothing > 0 && length > 0) ? last + (1-smoothing)*(sample - last) : sample;
+    QPolygonF changed;
+    changed << last << point;
+    if (tolerance > 0 && length > 1 && dropped.length() < maxDropped) {
+        // Online decimation: the last node can be replaced by point if the last
+        // node and all samples it replaced are near the section from the second
+        // to last node to point.
+        QPointF const anchor = node(length-2);
+        qreal const tolerance2 = square(tolerance/resolution);
+        bool replace = segmentDistance2(last, anchor, point) < tolerance2;
+        for (QVector<QPointF>::const_iterator it=dropped.cbegin(); replace && it!=dropped.cend(); it++)
+            replace = segmentDistance2(*it, anchor, point) < tolerance2;
+        if (replace) {
+            dropped.append(last);
+            changed << anchor;
+            setNode(length-1, point);
+        }
+        else {
+            dropped.clear();
+            appendNode(point);
+        }
+    }
+    else {
+        dropped.clear();
+        appendNode(point);
+    }
     if (point.x() < outer.left())
         outer.setLeft(point.x());
     else if (point.x() > outer.right())
@@ -108,100 +258,170 @@ void DrawPath::append(QPointF const& point)
         outer.setTop(point.y());
     else if (point.y() > outer.bottom())
         outer.setBottom(point.y());
-    path.append(point);
     hash ^= quint32(std::hash<double>{}(point.x() + 1e5*point.y())) + (hash << 6) + (hash >> 2);
+    qreal const size = getTool().size;
+    return changed.boundingRect().adjusted(-size/2, -size/2, size/2, size/2);
 }
 
-QVector<int> DrawPath::intersects(QPointF const& point, const qreal eraser_size) const
+void DrawPath::sectionsIn(QPointF const& point, qreal const radius, QVector<int> const& indices, QVector<qreal>& sections) const
 {
-    if (!(outer.adjusted(-eraser_size, -eraser_size, eraser_size, eraser_size).contains(point)))
-        return QVector<int>();
-    QVector<int> vec = QVector<int>();
-    for (int i=0; i<path.length(); i++) {
-        if (abs(point.x() - path[i].x()) < eraser_size
-                && abs(point.y() - path[i].y()) < eraser_size
-                && square(point.x() - path[i].x()) + square(point.y() - path[i].y()) < square(eraser_size))
-            vec.append(i);
+    // Segments are checked instead of nodes: after decimation, nodes can be
+    // far apart and a path with two nodes can be erased in the middle.
+    qreal t0, t1;
+    for (int const k : indices) {
+        if (k < 0 || k >= segments() || !segmentCircleSection(segmentStart(k), segmentEnd(k), point, radius, t0, t1))
+            continue;
+        if (!sections.isEmpty() && sections.last() >= k + t0)
+            sections.last() = std::max(sections.last(), k + t1);
+        else
+            sections << k + t0 << k + t1;
     }
-    return vec;
 }
 
-DrawPath* DrawPath::split(int start, int end)
+DrawPath* DrawPath::split(qreal const start, qreal const end) const
 {
-    if (start < 0) {
-        if (end >= path.length())
-            return this;
-        start = 0;
-    }
-    if (end > path.length())
-        end = path.length();
-    return new DrawPath(tool, path.data()+start, end-start);
+    qreal const last = std::max(length - 1, 0);
+    return new DrawPath(*this, qBound(0., start, last), qBound(0., end, last));
 }
 
 void DrawPath::updateHash()
 {
+    FullDrawTool const& tool = getTool();
     hash = quint32(std::hash<int>{}(tool.tool));
     hash ^= quint32(tool.color.red())   + (hash << 6) + (hash >> 2);
     hash ^= quint32(tool.color.green()) + (hash << 6) + (hash >> 2);
     hash ^= quint32(tool.color.blue())  + (hash << 6) + (hash >> 2);
     hash ^= quint32(tool.color.alpha()) + (hash << 6) + (hash >> 2);
-    for (auto& p : path)
+    for (int i=0; i<length; i++) {
+        QPointF const p = node(i);
         hash ^= quint32(std::hash<double>{}(p.x() + 1e5*p.y())) + (hash << 6) + (hash >> 2);
+    }
 }
 
-void DrawPath::toIntVector(QVector<float>& vec, int const xshift, int const yshift, int const width, int const height) const
+void DrawPath::toIntVector(QVector<float>& vec, QSizeF const& pageSize) const
 {
     // Deprecate
-    for (auto point : path) {
-        vec.append(static_cast<float>(point.x() - xshift)/width);
-        vec.append(static_cast<float>(point.y() - yshift)/height);
+    for (int i=0; i<length; i++) {
+        QPointF const point = node(i);
+        vec.append(static_cast<float>(point.x()/pageSize.width()));
+        vec.append(static_cast<float>(point.y()/pageSize.height()));
     }
 }
 
-void DrawPath::toText(QStringList &stringList, QPoint const shift, qreal const scale) const
+/// Append value with at most 3 decimal places to text.
+/// This is much faster than QString::number.
+static void appendNumber(QString& text, qreal const value)
 {
-    for (auto point : path) {
-        stringList << QString::number((point.x() - shift.x())*scale);
-        stringList << QString::number((point.y() - shift.y())*scale);
+    if (!(qAbs(value) < 1e12)) {
+        text += QString::number(value);
+        return;
     }
+    qint64 scaled = qRound64(1000*value);
+    bool const negative = scaled < 0;
+    if (negative)
+        scaled = -scaled;
+    // The number is written from the end of the buffer.
+    char buffer[24];
+    char* const end = buffer + sizeof(buffer);
+    char* begin = end;
+    int fraction = int(scaled % 1000);
+    scaled /= 1000;
+    if (fraction != 0) {
+        int digits = 3;
+        for (; fraction % 10 == 0; digits--)
+            fraction /= 10;
+        for (; digits > 0; digits--) {
+            *--begin = char('0' + fraction % 10);
+            fraction /= 10;
+        }
+        *--begin = '.';
+    }
+    do {
+        *--begin = char('0' + scaled % 10);
+        scaled /= 10;
+    } while (scaled > 0);
+    if (negative)
+        *--begin = '-';
+    text += QLatin1String(begin, int(end - begin));
 }
 
-DrawPath::DrawPath(FullDrawTool const& tool, QVector<float> const& vec, int const xshift, int const yshift, int const width, int const height) :
-    tool(tool)
+void DrawPath::toText(QString& text) const
 {
-    // Deprecated
-    double left=width+2*xshift, right=0, top=height+2*yshift, bottom=0;
-    double x, y;
-    for (QVector<float>::const_iterator it=vec.cbegin(); it!=vec.cend();) {
-        x = xshift + width*static_cast<qreal>(*it++);
-        y = yshift + height*static_cast<qreal>(*it++);
-        path.append(QPointF(x, y));
-        if (left > x)
-            left = x;
-        else if (right < x)
-            right = x;
-        if (bottom < y)
-            bottom = y;
-        else if (top > y)
-            top = y;
+    for (int i=0; i<length; i++) {
+        QPointF const point = node(i);
+        if (i > 0)
+            text += ' ';
+        appendNumber(text, point.x());
+        text += ' ';
+        appendNumber(text, point.y());
     }
-    outer = QRectF(left, top, right-left, bottom-top);
-    updateHash();
 }
 
-DrawPath::DrawPath(FullDrawTool const& tool, QStringList const& stringList, QPoint const shift, qreal const scale) :
-    tool({tool.tool, tool.color, scale*tool.size})
+bool DrawPath::parseText(QString const& text, QVector<QPointF>& nodes)
 {
-    if (stringList.size() % 2 != 0 || stringList.size() < 2)
-        return;
-    double x = shift.x() + scale*stringList[0].toDouble();
-    double y = shift.y() + scale*stringList[1].toDouble();
-    double left=x, right=x, top=y, bottom=y;
-    path.append(QPointF(x, y));
-    for (QStringList::const_iterator it=stringList.cbegin()+2; it != stringList.cend();) {
-        x = shift.x() + scale*(it++)->toDouble();
-        y = shift.y() + scale*(it++)->toDouble();
-        path.append(QPointF(x, y));
+    static constexpr double powers[] = {1., 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    nodes.clear();
+    QChar const* it = text.constData();
+    QChar const* const end = it + text.length();
+    double coordinate[2];
+    int parsed = 0;
+    while (true) {
+        while (it != end && it->isSpace())
+            it++;
+        if (it == end)
+            break;
+        QChar const* const start = it;
+        bool const negative = *it == '-';
+        if (negative || *it == '+')
+            it++;
+        // Fast path: decimal numbers with at most 18 digits. Further digits
+        // are only counted, such that mantissa cannot overflow.
+        qint64 mantissa = 0;
+        int digits = 0, decimals = 0;
+        for (; it != end && it->isDigit(); it++, digits++) {
+            if (digits < 18)
+                mantissa = 10*mantissa + it->digitValue();
+        }
+        if (it != end && *it == '.') {
+            for (it++; it != end && it->isDigit(); it++, digits++, decimals++) {
+                if (digits < 18)
+                    mantissa = 10*mantissa + it->digitValue();
+            }
+        }
+        double value;
+        if (digits > 0 && digits <= 18 && (it == end || it->isSpace()))
+            value = (negative ? -mantissa : mantissa) / powers[decimals];
+        else {
+            // Other formats (e.g. exponents) are left to Qt.
+            while (it != end && !it->isSpace())
+                it++;
+            bool ok;
+            value = QStringRef(&text, int(start - text.constData()), int(it - start)).toDouble(&ok);
+            if (!ok)
+                return false;
+        }
+        coordinate[parsed++] = value;
+        if (parsed == 2) {
+            nodes.append(QPointF(coordinate[0], coordinate[1]));
+            parsed = 0;
+        }
+    }
+    return parsed == 0;
+}
+
+DrawPath::DrawPath(StrokeArena* arena, FullDrawTool const& tool, QVector<float> const& vec, QSizeF const& pageSize) :
+    arena(arena),
+    toolId(StrokeArena::toolId(tool))
+{
+    // Deprecated
+    offset = arena->allocate(this, vec.length()/2);
+    length = vec.length()/2;
+    double left=pageSize.width(), right=0, top=pageSize.height(), bottom=0;
+    double x, y;
+    for (int i=0; i<length; i++) {
+        x = pageSize.width()*static_cast<qreal>(vec[2*i]);
+        y = pageSize.height()*static_cast<qreal>(vec[2*i+1]);
+        setNode(i, QPointF(x, y));
         if (left > x)
             left = x;
         else if (right < x)
@@ -217,14 +437,11 @@ DrawPath::DrawPath(FullDrawTool const& tool, QStringList const& stringList, QPoi
 
 void DrawPath::endDrawing()
 {
-    if (path.length() == 1)
-        path.append(path[0] + QPointF(1e-6, 0));
-}
-
-QRect const DrawPath::getOuterLast() const
-{
-    return QRectF(path.last(), *(path.cend()-2))
-            .normalized()
-            .adjusted(-tool.size/2-.5, -tool.size/2-.5, tool.size/2+.5, tool.size/2+.5)
-            .toAlignedRect();
+#ifdef DEBUG_DRAWING
+    qDebug() << "Stored" << length << "of" << samples << "input samples";
+#endif
+    dropped = QVector<QPointF>();
+    // Nodes are stored as float: the second node must differ noticeably.
+    if (length == 1)
+        appendNode(node(0) + QPointF(1e-2, 0));
 }
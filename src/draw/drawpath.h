@@ -16,6 +16,7 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+
 #ifndef DRAWPATH_H
 #define DRAWPATH_H
 
@@ -23,65 +24,136 @@
 #include <QVector>
 #include <QPointF>
 #include <QRectF>
+#include <QPolygonF>
 #include "../enumerates.h"
+#include "strokearena.h"
+
+class QPainter;
+
+/// Squared distance of point from the line segment from start to end.
+qreal segmentDistance2(QPointF const& point, QPointF const& start, QPointF const& end);
+/// Section of the line segment from start to end inside the circle of given radius around center.
+/// The section is given by t0 <= t1 in [0,1], where t=0 is start and t=1 is end.
+/// Return false if the segment does not intersect the circle.
+bool segmentCircleSection(QPointF const& start, QPointF const& end, QPointF const& center, qreal const radius, qreal& t0, qreal& t1);
 
+/// Stroke drawn with a pen or highlighter.
+/// The nodes are stored in a StrokeArena shared by all paths on a page.
+/// Coordinates and the stroke width are given in points on the page (=inch/72),
+/// independent of the resolution at which the path is shown.
 class DrawPath
 {
+    friend class StrokeArena;
+
 private:
-    QVector<QPointF> path;
+    /// Arena containing the nodes.
+    StrokeArena* arena;
+    /// Offset of the first node in arena.
+    int offset = 0;
+    /// Neighbours in the list of paths of arena, managed by StrokeArena.
+    DrawPath* arenaPrev = nullptr;
+    DrawPath* arenaNext = nullptr;
+    /// Number of nodes.
+    int length = 0;
+    /// Index of the tool in the tool table of StrokeArena.
+    quint32 toolId;
     /// Rectangle containing all nodes of the path.
     QRectF outer = QRectF();
-    FullDrawTool tool;
     quint32 hash = 0;
+    /// Input samples which replaced the last node since the second to last node was added.
+    /// Only used while drawing.
+    QVector<QPointF> dropped;
+    /// Number of input samples while drawing.
+    int samples = 1;
+    /// Maximum size of dropped. A node is kept after this number of dropped samples.
+    static constexpr int maxDropped = 64;
+    /// Input samples which deviate less than tolerance (in pixels on the screen) from the stroke are not stored.
+    static qreal tolerance;
+    /// Smoothing of input samples: 0 (no smoothing) to 1 (no movement).
+    static qreal smoothing;
+
+    /// Create new path from the section of source from position start to position end (see split()).
+    DrawPath(DrawPath const& source, qreal const start, qreal const end);
+    /// Overwrite node i.
+    void setNode(int const i, QPointF const& point) {float* const data = arena->data(offset + i); data[0] = float(point.x()); data[1] = float(point.y());}
+    /// Add a node at the end.
+    void appendNode(QPointF const& point) {offset = arena->append(this, offset, length, point); length++;}
 
 public:
     /// Created new empty path.
-    DrawPath(FullDrawTool const& tool, QPointF const& start);
+    DrawPath(StrokeArena* arena, FullDrawTool const& tool, QPointF const& start);
     /// Create new path with given points.
-    DrawPath(FullDrawTool const& tool, QPointF const* const points, int const number);
+    DrawPath(StrokeArena* arena, FullDrawTool const& tool, QPointF const* const points, int const number);
+    /// Create new path from coordinates (x and y alternating, 2*number values) in the format of StrokeArena.
+    DrawPath(StrokeArena* arena, FullDrawTool const& tool, float const* const coordinates, int const number);
     /// Deprecated: used in legacy file loading function.
-    DrawPath(FullDrawTool const& tool, QVector<float> const& vec, int const xshift, int const yshift, int const width, int const height);
-    /// Read path from string list. Used in file loading function.
-    DrawPath(FullDrawTool const& tool, QStringList const& stringList, QPoint const shift, qreal const scale);
-    DrawPath(DrawPath const& old, QPointF const shift, double const scale);
+    /// vec contains coordinates relative to pageSize (in points).
+    DrawPath(StrokeArena* arena, FullDrawTool const& tool, QVector<float> const& vec, QSizeF const& pageSize);
+    /// Copy old to arena.
+    DrawPath(StrokeArena* arena, DrawPath const& old);
     DrawPath(DrawPath const& old);
 
-    DrawPath operator=(DrawPath const& old) {path.clear(); return DrawPath(old);}
-    DrawPath operator=(DrawPath const&& old) {path.clear(); return DrawPath(old);}
+    DrawPath& operator=(DrawPath const& old) = delete;
 
-    ~DrawPath() {path.clear();}
+    ~DrawPath() {arena->release(this, offset, length);}
 
+    /// Move the nodes to another arena, e.g. when a path is moved to another page.
+    void moveTo(StrokeArena* newArena);
     /// Called when drawing ends: makes sure that a path contains at least two points such that it can be drawn.
     void endDrawing();
-    /// Deprecated: convert path in vector of floates for legacy file saving function.
-    void toIntVector(QVector<float>& vec, int const xshift, int const yshift, int const width, int const height) const;
-    /// Export path to list of strings representing numbers.
-    /// The list contains (alternately) x and y coordinates in point (=inch/72).
-    void toText(QStringList& stringList, QPoint const shift, qreal const scale) const;
-    void transform(QPointF const& shift, double const scale);
-    /// Update path and return a rectangle containing the updated region.
-    QRect const update(DrawPath const& new_path, QPointF const shift, double const scale);
+    /// Set tolerance (in pixels) and smoothing (0 to 1) of the input filter used by append().
+    static void setInputFilter(qreal const newTolerance, qreal const newSmoothing) {tolerance = newTolerance; smoothing = newSmoothing;}
+    /// Deprecated: convert path in vector of floates relative to pageSize for legacy file saving function.
+    void toIntVector(QVector<float>& vec, QSizeF const& pageSize) const;
+    /// Append the nodes to text as x and y coordinates (alternately) in point (=inch/72),
+    /// separated by spaces. Coordinates are written with at most 3 decimal places.
+    void toText(QString& text) const;
+    /// Read nodes from text containing x and y coordinates (alternately) separated by white space.
+    /// Returns false if text contains anything else or an odd number of coordinates.
+    static bool parseText(QString const& text, QVector<QPointF>& nodes);
+    /// Overwrite nodes starting from index first, appending nodes if necessary.
+    /// Set the hash to newHash and return a rectangle (in points) containing the updated region.
+    QRectF const setNodes(int const first, QVector<QPointF> const& nodes, quint32 const newHash);
     void updateHash();
 
     quint32 getHash() const {return hash;}
-    bool isEmpty() const {return path.isEmpty();}
+    /// Set hash, e.g. to the hash of the path of which this is a copy.
+    void setHash(quint32 const newHash) {hash = newHash;}
+    bool isEmpty() const {return length == 0;}
     /// Number of nodes in path.
-    int number() const {return path.length();}
-    FullDrawTool const& getTool() const {return tool;}
-    QPointF const* data() const {return path.constData();}
+    int number() const {return length;}
+    FullDrawTool const& getTool() const {return StrokeArena::tool(toolId);}
+    /// Node with index i.
+    QPointF const node(int const i) const {float const* const data = arena->data(offset + i); return QPointF(data[0], data[1]);}
+    /// Coordinates of all nodes (x and y alternating, 2*number() values) in the arena.
+    /// The pointer is invalidated when the arena is changed.
+    float const* coordinates() const {return arena->data(offset);}
+    /// Draw the nodes from index first on as polyline with the current pen of painter.
+    void draw(QPainter& painter, int const first = 0) const;
     /// Rectangle containing all nodes.
     QRectF const& getOuter() const {return outer;}
     /// Rectangle containing all nodes plus a distance of the stroke width.
-    QRectF const getOuterDrawing() const {return outer.adjusted(-tool.size/2-.5, -tool.size/2-.5, tool.size/2+.5, tool.size/2+.5);}
-    /// Return rectangle containing the last section of the stroke (last two points) as required for updating the screen.
-    QRect const getOuterLast() const;
-    /// Return all nodes in this path which are nearer to the given point than eraser_size.
-    QVector<int> intersects(QPointF const& point, qreal const eraser_size) const;
-
-    /// Append a new node to the path.
-    void append(QPointF const& point);
-    /// Extract all nodes from index start to index end as a separate path.
-    DrawPath* split(int start, int end);
+    QRectF const getOuterDrawing() const {qreal const size = getTool().size; return outer.adjusted(-size/2, -size/2, size/2, size/2);}
+    /// Number of segments. Segment k connects node k and node k+1.
+    /// A path with a single node has a single segment of length 0.
+    int segments() const {return length > 1 ? length - 1 : length;}
+    /// Start node of segment k.
+    QPointF const segmentStart(int const k) const {return node(k);}
+    /// End node of segment k.
+    QPointF const segmentEnd(int const k) const {return node(k+1 < length ? k+1 : k);}
+    /// Sections of the segments with given (sorted) indices inside the circle of given radius around point.
+    /// The sections are appended to sections as pairs of positions (see split()). Adjacent sections are merged.
+    void sectionsIn(QPointF const& point, qreal const radius, QVector<int> const& indices, QVector<qreal>& sections) const;
+
+    /// Add an input sample to the path and return the rectangle (in points) which needs to be drawn again.
+    /// The sample is smoothed and replaces the last node if the last node and all samples
+    /// it replaced lie within tolerance of the new last section of the path.
+    /// resolution (pixels per point) converts the tolerance to points.
+    QRectF const append(QPointF const& point, qreal const resolution = 1.);
+    /// Extract the section from position start to position end as a separate path.
+    /// Position k+t with 0 <= t <= 1 lies on segment k at fraction t. Nodes
+    /// are inserted at start and end if these are not positions of nodes.
+    DrawPath* split(qreal const start, qreal const end) const;
 };
 
 #endif // DRAWPATH_H
@@ -19,6 +19,11 @@
 #include "pathoverlay.h"
 #include "../slide/drawslide.h"
 #include "../names.h"
+#include "zlibdevice.h"
+#include "annotationfile.h"
+#include <QJsonObject>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 /// This function is required for sorting and searching in a QMap.
 bool operator<(FullDrawTool tool1, FullDrawTool tool2)
@@ -37,6 +42,32 @@ bool operator<(FullDrawTool tool1, FullDrawTool tool2)
     return false;
 }
 
+/// Parts of erased paths shorter than this (as difference of positions, see
+/// DrawPath::split()) are dropped instead of being kept as separate paths.
+static constexpr qreal minSection = 1e-3;
+
+/// Warn if the PDF file doc (presentation or notes, given by name) is not the
+/// file described by path, pages and modified in a drawing file.
+static void checkDocument(PdfDoc const* doc, char const* name, QString const& path, int const pages, QString const& modified)
+{
+    QFileInfo const fileinfo(doc->getPath());
+    if (path != fileinfo.absoluteFilePath())
+        qWarning() << "This drawing file was generated for a different PDF file path.";
+    if (modified != fileinfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"))
+        qWarning() << "The" << name << "file has been modified since writing the drawing file.";
+    if (pages != doc->getDoc()->numPages())
+        qWarning() << "The numbers of pages in the" << name << "and drawing file do not match!";
+}
+
+/// Description of the PDF file doc in the metadata of annotation files.
+static QJsonObject const documentInfo(PdfDoc const* doc)
+{
+    return QJsonObject({
+            {"file", QFileInfo(doc->getPath()).absoluteFilePath()},
+            {"pages", doc->getDoc()->numPages()},
+            {"modified", doc->getLastModified().toString("yyyy-MM-dd hh:mm:ss")},
+        });
+}
 
 PathOverlay::PathOverlay(DrawSlide* parent) :
     QWidget(parent),
@@ -52,7 +83,35 @@ PathOverlay::PathOverlay(DrawSlide* parent) :
 PathOverlay::~PathOverlay()
 {
     clearAllAnnotations();
-    delete enlargedPageRenderer;
+    qDeleteAll(undonePaths);
+    undonePaths.clear();
+    // All paths must be deleted before their arenas.
+    qDeleteAll(arenas);
+    delete magnifierRenderer;
+}
+
+StrokeArena* PathOverlay::getArena(QString const& label)
+{
+    StrokeArena*& arena = arenas[label];
+    if (arena == nullptr)
+        arena = new StrokeArena();
+    return arena;
+}
+
+QPointF const PathOverlay::toPage(QPointF const& point) const
+{
+    return (point - QPointF(master->shiftx, master->shifty))/master->resolution;
+}
+
+QTransform const PathOverlay::pageTransform() const
+{
+    return QTransform(master->resolution, 0., 0., master->resolution, master->shiftx, master->shifty);
+}
+
+QRect const PathOverlay::toWidget(QRectF const& rect) const
+{
+    // Antialiasing can touch one more pixel on each side.
+    return pageTransform().mapRect(rect).toAlignedRect().adjusted(-1, -1, 1, 1);
 }
 
 void PathOverlay::clearAllAnnotations()
@@ -62,9 +121,14 @@ void PathOverlay::clearAllAnnotations()
         it->clear();
     }
     paths.clear();
+    pendingPages.clear();
+    delete annotationFile;
+    annotationFile = nullptr;
+    strokeIndex.clear();
     end_cache = -1;
     if (!pixpaths.isNull())
         pixpaths = QPixmap();
+    clearMagnifiedTiles();
     update();
 }
 
@@ -73,9 +137,12 @@ void PathOverlay::clearPageAnnotations()
     end_cache = -1;
     if (!pixpaths.isNull())
         pixpaths = QPixmap();
-    if (master->page != nullptr && paths.contains(master->page->label())) {
-        qDeleteAll(paths[master->page->label()]);
-        paths[master->page->label()].clear();
+    clearMagnifiedTiles();
+    pendingPages.remove(master->pageLabel);
+    if (master->page != nullptr && paths.contains(master->pageLabel)) {
+        strokeIndex.clear();
+        qDeleteAll(paths[master->pageLabel]);
+        paths[master->pageLabel].clear();
         update();
         updateEnlargedPage();
     }
@@ -90,12 +157,17 @@ void PathOverlay::paintEvent(QPaintEvent* event)
 #endif
     QPainter painter(this);
     painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-    if (end_cache >= 0)
-        painter.drawPixmap(0, 0, pixpaths);
-    if (master->page == nullptr)
+    if (master->page == nullptr) {
+        if (end_cache >= 0)
+            painter.drawPixmap(0, 0, pixpaths);
         return;
+    }
     painter.setRenderHint(QPainter::Antialiasing);
-    drawPaths(painter, master->page->label(), event->region());
+    if (end_cache >= 0) {
+        painter.drawPixmap(event->rect(), pixpaths, event->rect());
+        drawUncachedPaths(painter, event->region());
+    }
+    drawPaths(painter, master->pageLabel, event->region());
     if (!pointerPosition.isNull() || !stylusPosition.isNull()) {
         FullDrawTool const* thetool = &tool;
         QPointF const* position = &pointerPosition;
@@ -140,18 +212,8 @@ void PathOverlay::paintEvent(QPaintEvent* event)
             break;
         }
         case Magnifier:
-            if (!enlargedPage.isNull()) {
-                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-                painter.setClipping(true);
-                QPainterPath path;
-                path.addEllipse(*position, thetool->size, thetool->size);
-                painter.setClipPath(path, Qt::ReplaceClip);
-                painter.drawPixmap(QRectF(position->x()-thetool->size, position->y()-thetool->size, 2*thetool->size, 2*thetool->size),
-                                  enlargedPage,
-                                  QRectF(thetool->extras.magnification*position->x() - thetool->size, thetool->extras.magnification*position->y() - thetool->size, 2*thetool->size, 2*thetool->size));
-                painter.setPen(QPen(thetool->color, 2));
-                painter.drawEllipse(*position, thetool->size, thetool->size);
-            }
+            if (thetool->extras.magnification > 1e-12)
+                drawMagnifier(painter, *thetool, *position);
             break;
         default:
             break;
@@ -162,17 +224,216 @@ void PathOverlay::paintEvent(QPaintEvent* event)
 #endif
 }
 
-void PathOverlay::rescale(qint16 const oldshiftx, qint16 const oldshifty, double const oldRes)
+void PathOverlay::drawMagnifier(QPainter& painter, FullDrawTool const& magnifier, QPointF const& position)
+{
+    qreal const magnification = magnifier.extras.magnification;
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setClipping(true);
+    QPainterPath path;
+    path.addEllipse(position, magnifier.size, magnifier.size);
+    painter.setClipPath(path, Qt::ReplaceClip);
+    // A point p of the slide is shown at position + magnification*(p - position).
+    QTransform transform;
+    transform.translate(position.x(), position.y());
+    transform.scale(magnification, magnification);
+    transform.translate(-position.x(), -position.y());
+    // Region of the slide shown in the magnifier.
+    QRectF const region(position.x() - magnifier.size/magnification, position.y() - magnifier.size/magnification, 2*magnifier.size/magnification, 2*magnifier.size/magnification);
+    // Part of the magnifier which is not covered by sharp tiles.
+    QRegion uncovered(QRectF(position.x() - magnifier.size, position.y() - magnifier.size, 2*magnifier.size, 2*magnifier.size).toAlignedRect());
+    if (magnifierRenderer != nullptr && magnifierRenderer->getPage() == master->pageIndex) {
+        // Region of the enlarged page image shown in the magnifier.
+        QRectF const source(
+                    magnification*(position.x() - master->shiftx) - magnifier.size,
+                    magnification*(position.y() - master->shifty) - magnifier.size,
+                    2*magnifier.size,
+                    2*magnifier.size
+                    );
+        // Requesting tiles here covers all ways of moving the magnifier
+        // (mouse, tablet and synchronized overlays).
+        magnifierRenderer->request(source);
+        magnifierPosition = position;
+        syncMagnifiedTiles(magnification);
+        QPointF const offset = position - QPointF(magnifier.size, magnifier.size) - source.topLeft();
+        for (int const tile : magnifierRenderer->tilesIn(source)) {
+            if (!magnifiedTiles.contains(tile)) {
+                // Compose the tile from the page and all paths.
+                QPixmap composed = magnifierRenderer->getTile(tile);
+                if (composed.isNull())
+                    continue;
+                QTransform const tileTransform = magnifiedTileTransform(tile, magnification);
+                QPainter tilePainter(&composed);
+                tilePainter.setTransform(tileTransform);
+                tilePainter.setRenderHint(QPainter::Antialiasing);
+                drawPathsPlain(tilePainter, tileTransform.inverted().mapRect(QRectF(QPointF(0,0), composed.size())), 0);
+                tilePainter.end();
+                magnifiedTiles[tile] = composed;
+            }
+            else
+                // Mark the tile as recently used in magnifierRenderer.
+                magnifierRenderer->getTile(tile);
+            QRect const target = magnifierRenderer->tileRect(tile).translated(offset.toPoint());
+            painter.drawPixmap(target.topLeft(), magnifiedTiles[tile]);
+            uncovered -= target;
+        }
+    }
+    if (!uncovered.isEmpty()) {
+        // Show the scaled slide and paths until the sharp tiles are rendered.
+        painter.save();
+        painter.setClipRegion(uncovered, Qt::IntersectClip);
+        painter.setTransform(transform, true);
+        painter.drawPixmap(master->shiftx, master->shifty, master->pixmap);
+        painter.setRenderHint(QPainter::Antialiasing);
+        drawPathsPlain(painter, region, 0);
+        painter.restore();
+    }
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setPen(QPen(magnifier.color, 2));
+    painter.drawEllipse(position, magnifier.size, magnifier.size);
+}
+
+QTransform const PathOverlay::magnifiedTileTransform(int const tile, qreal const magnification) const
+{
+    // A point p of the slide is at magnification*(p - shift) in the enlarged page image.
+    QRect const rect = magnifierRenderer->tileRect(tile);
+    QTransform transform;
+    transform.translate(-rect.x(), -rect.y());
+    transform.scale(magnification, magnification);
+    transform.translate(-master->shiftx, -master->shifty);
+    return transform;
+}
+
+void PathOverlay::drawPathsPlain(QPainter& painter, QRectF const& region, int const start, int const startNode)
+{
+    if (!paths.contains(master->pageLabel))
+        return;
+    QList<DrawPath*> const& list = paths[master->pageLabel];
+    painter.save();
+    painter.setTransform(pageTransform(), true);
+    for (int i=start; i<list.size(); i++) {
+        DrawPath const* drawPath = list[i];
+        if (!region.intersects(toWidget(drawPath->getOuterDrawing())))
+            continue;
+        FullDrawTool const& pathTool = drawPath->getTool();
+        switch (pathTool.tool) {
+        case Pen:
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            break;
+        case Highlighter:
+            painter.setCompositionMode(QPainter::CompositionMode_Darken);
+            break;
+        default:
+            continue;
+        }
+        painter.setPen(QPen(pathTool.color, pathTool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        // Only the new nodes of a growing path are drawn. The last node which
+        // was already drawn connects the new section to the old one.
+        int const first = (i == start && startNode > 0) ? std::min(startNode - 1, drawPath->number() - 1) : 0;
+        drawPath->draw(painter, first);
+    }
+    painter.restore();
+}
+
+bool PathOverlay::magnifiedTilesSynced() const
+{
+    QList<DrawPath*> const list = paths.value(master->pageLabel);
+    if (magnifiedLabel != master->pageLabel || magnifiedEnd != list.size())
+        return false;
+    return magnifiedEnd == 0 || (
+                list.last() == magnifiedLast
+                && magnifiedLast->number() == magnifiedLastNodes
+                && magnifiedLast->node(magnifiedLastNodes-1) == magnifiedLastPoint
+                );
+}
+
+void PathOverlay::syncMagnifiedTiles(qreal const magnification)
+{
+    // Tiles which were dropped by magnifierRenderer are dropped here, too.
+    for (QMap<int, QPixmap>::iterator it=magnifiedTiles.begin(); it!=magnifiedTiles.end();) {
+        if (magnifierRenderer->contains(it.key()))
+            it++;
+        else
+            it = magnifiedTiles.erase(it);
+    }
+    if (magnifiedTilesSynced())
+        return;
+    QList<DrawPath*> const list = paths.value(master->pageLabel);
+    // The tiles can be updated incrementally if paths were only appended or the last path has grown.
+    bool const incremental = magnifiedLabel == master->pageLabel
+            && magnifiedEnd <= list.size()
+            && (magnifiedEnd == 0 || (list[magnifiedEnd-1] == magnifiedLast && magnifiedLast->number() >= magnifiedLastNodes));
+    if (!incremental)
+        clearMagnifiedTiles();
+    else {
+        // Draw only what was added since the last update. If the input filter
+        // moved the last node, the section ending there is drawn again.
+        int const startNode = (magnifiedEnd > 0 && magnifiedLast->node(magnifiedLastNodes-1) != magnifiedLastPoint) ? magnifiedLastNodes - 1 : magnifiedLastNodes;
+        for (QMap<int, QPixmap>::iterator it=magnifiedTiles.begin(); it!=magnifiedTiles.end(); it++) {
+            QTransform const tileTransform = magnifiedTileTransform(it.key(), magnification);
+            QPainter tilePainter(&*it);
+            tilePainter.setTransform(tileTransform);
+            tilePainter.setRenderHint(QPainter::Antialiasing);
+            QRectF const region = tileTransform.inverted().mapRect(QRectF(QPointF(0,0), it->size()));
+            if (magnifiedEnd > 0)
+                drawPathsPlain(tilePainter, region, magnifiedEnd-1, startNode);
+            else
+                drawPathsPlain(tilePainter, region, 0);
+            tilePainter.end();
+        }
+    }
+    magnifiedLabel = master->pageLabel;
+    magnifiedEnd = list.size();
+    magnifiedLast = list.isEmpty() ? nullptr : list.last();
+    magnifiedLastNodes = list.isEmpty() ? 0 : list.last()->number();
+    magnifiedLastPoint = list.isEmpty() ? QPointF() : list.last()->node(magnifiedLastNodes-1);
+}
+
+void PathOverlay::invalidateMagnifiedTiles(QRectF const& region, bool const synced)
+{
+    if (!synced || magnifierRenderer == nullptr) {
+        clearMagnifiedTiles();
+        return;
+    }
+    FullDrawTool const& magnifier = tool.tool == Magnifier ? tool : stylusTool;
+    for (QMap<int, QPixmap>::iterator it=magnifiedTiles.begin(); it!=magnifiedTiles.end();) {
+        if (magnifiedTileTransform(it.key(), magnifier.extras.magnification).inverted().mapRect(QRectF(QPointF(0,0), it->size())).intersects(region))
+            it = magnifiedTiles.erase(it);
+        else
+            it++;
+    }
+    // All remaining tiles show the current paths.
+    QList<DrawPath*> const list = paths.value(master->pageLabel);
+    magnifiedEnd = list.size();
+    magnifiedLast = list.isEmpty() ? nullptr : list.last();
+    magnifiedLastNodes = list.isEmpty() ? 0 : list.last()->number();
+    magnifiedLastPoint = list.isEmpty() ? QPointF() : list.last()->node(magnifiedLastNodes-1);
+}
+
+void PathOverlay::deletePath(DrawPath* path)
+{
+    if (path == magnifiedLast)
+        clearMagnifiedTiles();
+    delete path;
+}
+
+void PathOverlay::clearMagnifiedTiles()
 {
+    magnifiedTiles.clear();
+    magnifiedEnd = 0;
+    magnifiedLast = nullptr;
+    magnifiedLastNodes = 0;
+}
+
+void PathOverlay::rescale(double const oldRes)
+{
+    // Paths (and strokeIndex) are in page coordinates. Only the rasterized
+    // paths depend on the resolution.
     end_cache = -1;
-    enlargedPage = QPixmap();
-    delete enlargedPageRenderer;
-    enlargedPageRenderer = nullptr;
+    // The resolution changes: all tiles of the magnifier are rendered again.
+    if (magnifierRenderer != nullptr)
+        magnifierRenderer->clear();
+    clearMagnifiedTiles();
     eraserSize *= master->getResolution()/oldRes;
-    QPointF shift = QPointF(master->shiftx, master->shifty) - master->resolution/oldRes*QPointF(oldshiftx, oldshifty);
-    for (QMap<QString, QList<DrawPath*>>::iterator page_it = paths.begin(); page_it != paths.end(); page_it++)
-        for (QList<DrawPath*>::iterator path_it = page_it->begin(); path_it != page_it->end(); path_it++)
-            (*path_it)->transform(shift, master->resolution/oldRes);
 }
 
 void PathOverlay::setTool(FullDrawTool const& newtool, qreal const resolution)
@@ -247,7 +508,7 @@ void PathOverlay::updatePathCache()
 #ifdef DEBUG_DRAWING
     qDebug() << "update path cache" << end_cache << this;
 #endif
-    if (paths[master->page->label()].isEmpty()) {
+    if (paths[master->pageLabel].isEmpty()) {
         end_cache = -1;
         if (!pixpaths.isNull())
             pixpaths = QPixmap();
@@ -258,11 +519,12 @@ void PathOverlay::updatePathCache()
         if (end_cache == -1) {
             pixpaths = QPixmap(size());
             pixpaths.fill(QColor(0,0,0,0));
+            uncachedPaths.clear();
         }
         QPainter painter;
         painter.begin(&pixpaths);
         painter.setRenderHint(QPainter::Antialiasing);
-        drawPaths(painter, master->page->label(), QRegion(rect()), false, true);
+        drawPaths(painter, master->pageLabel, QRegion(rect()), false, true);
     }
 }
 
@@ -277,23 +539,29 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
     // Drawing with the highlighter on transparent edges can look ugly.
     painter.setCompositionMode(QPainter::CompositionMode_DestinationOver);
 
+    // Paths are drawn in page coordinates, everything else in widget coordinates.
+    QTransform const widgetTransform = painter.transform();
+    QTransform const strokeTransform = pageTransform()*widgetTransform;
+
     // Draw the paths.
     if (paths.contains(label)) {
         QList<DrawPath*>::const_iterator path_it = paths[label].cbegin();
         if (!plain) {
             // If end_cache >= 0: some paths have been drawn already. Skip them.
-            if (label == master->page->label() && end_cache > 0)
+            if (label == master->pageLabel && end_cache > 0)
                 path_it += end_cache;
         }
         // Iterate over all remaining paths.
         for (; path_it!=paths[label].cend(); path_it++) {
-            if (region.intersects((*path_it)->getOuterDrawing().toAlignedRect())) {
+            if (region.intersects(toWidget((*path_it)->getOuterDrawing()))) {
                 FullDrawTool const& tool = (*path_it)->getTool();
                 switch (tool.tool) {
                 case Pen:
                     painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
                     painter.setPen(QPen(tool.color, tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-                    painter.drawPolyline((*path_it)->data(), (*path_it)->number());
+                    painter.setTransform(strokeTransform);
+                    (*path_it)->draw(painter);
+                    painter.setTransform(widgetTransform);
                     break;
                 case Highlighter:
                 {
@@ -301,14 +569,16 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
                         // Highlighter needs a background to draw on (because of CompositionMode_Darken).
                         // Drawing this background is only reasonable if there is no video widget in the background.
                         // Check this.
-                        QRect const outer = (*path_it)->getOuterDrawing().toAlignedRect();
+                        QRect const outer = toWidget((*path_it)->getOuterDrawing());
                         if (hasVideoOverlap(outer)) {
                             if (toCache) {
-                                end_cache = path_it - paths[label].cbegin();
+                                // This path is drawn on top of the cache instead.
+                                if (!uncachedPaths.contains(*path_it))
+                                    uncachedPaths.append(*path_it);
 #ifdef DEBUG_DRAWING
-                                qDebug() << "Stopped caching paths:" << end_cache;
+                                qDebug() << "Not caching highlighter path on video:" << path_it - paths[label].cbegin();
 #endif
-                                return;
+                                continue;
                             }
                         }
                         else {
@@ -326,7 +596,9 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
                     // Draw the highlighter path.
                     painter.setCompositionMode(QPainter::CompositionMode_Darken);
                     painter.setPen(QPen(tool.color, tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-                    painter.drawPolyline((*path_it)->data(), (*path_it)->number());
+                    painter.setTransform(strokeTransform);
+                    (*path_it)->draw(painter);
+                    painter.setTransform(widgetTransform);
                 }
                     break;
                 default:
@@ -336,7 +608,39 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
         }
     }
     if (toCache)
-        end_cache = paths[master->page->label()].length();
+        end_cache = paths[master->pageLabel].length();
+}
+
+void PathOverlay::drawUncachedPaths(QPainter& painter, QRegion const& region)
+{
+    painter.setCompositionMode(QPainter::CompositionMode_Darken);
+    painter.save();
+    painter.setTransform(pageTransform(), true);
+    for (DrawPath const* path : uncachedPaths) {
+        if (region.intersects(toWidget(path->getOuterDrawing()))) {
+            painter.setPen(QPen(path->getTool().color, path->getTool().size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+            path->draw(painter);
+        }
+    }
+    painter.restore();
+}
+
+void PathOverlay::repaintPathCache(QRegion const& region)
+{
+    if (end_cache < 0 || pixpaths.isNull())
+        return;
+#ifdef DEBUG_DRAWING
+    qDebug() << "repaint path cache" << region.boundingRect() << this;
+#endif
+    QPainter painter;
+    painter.begin(&pixpaths);
+    painter.setClipRegion(region);
+    painter.setCompositionMode(QPainter::CompositionMode_Clear);
+    painter.fillRect(region.boundingRect(), Qt::transparent);
+    painter.setRenderHint(QPainter::Antialiasing);
+    // All paths intersecting region are drawn again. The clip region keeps everything else.
+    end_cache = 0;
+    drawPaths(painter, master->pageLabel, region, false, true);
 }
 
 bool PathOverlay::hasVideoOverlap(QRectF const& rect) const
@@ -388,9 +692,7 @@ bool PathOverlay::event(QEvent *event)
             {
             case Pen:
             case Highlighter:
-                if (!paths.contains(master->page->label()))
-                    paths[master->page->label()] = QList<DrawPath*>();
-                paths[master->page->label()].append(new DrawPath(stylusTool, tabletEvent->posF()));
+                beginPath(stylusTool, tabletEvent->posF());
                 break;
             case Eraser:
                 erase(tabletEvent->posF());
@@ -436,11 +738,7 @@ bool PathOverlay::event(QEvent *event)
             case Pen:
             case Highlighter:
                 // TODO: handle pointer simultaneously
-                if (!paths[master->page->label()].isEmpty()) {
-                    paths[master->page->label()].last()->append(tabletEvent->posF());
-                    update(paths[master->page->label()].last()->getOuterLast());
-                    emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
-                }
+                appendToPath(tabletEvent->posF());
                 break;
             case Eraser:
                 erase(tabletEvent->posF());
@@ -510,10 +808,11 @@ bool PathOverlay::event(QEvent *event)
                 break;
             case Pen:
             case Highlighter:
-                if (!paths.contains(master->page->label()) || paths[master->page->label()].isEmpty())
+                if (!paths.contains(master->pageLabel) || paths[master->pageLabel].isEmpty())
                     return false;
-                paths[master->page->label()].last()->endDrawing();
-                emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+                paths[master->pageLabel].last()->endDrawing();
+                strokeIndex.update(master->pageLabel, paths[master->pageLabel].last(), 0);
+                emit pathOperation(newOperation(PathOperation::EndPath, master->pageLabel));
                 update();
                 [[clang::fallthrough]];
             case Eraser:
@@ -558,9 +857,7 @@ void PathOverlay::mousePressEvent(QMouseEvent *event)
         {
         case Pen:
         case Highlighter:
-            if (!paths.contains(master->page->label()))
-                paths[master->page->label()] = QList<DrawPath*>();
-            paths[master->page->label()].append(new DrawPath(tool, event->localPos()));
+            beginPath(tool, event->localPos());
             break;
         case Eraser:
             erase(event->localPos());
@@ -619,10 +916,11 @@ void PathOverlay::mouseReleaseEvent(QMouseEvent *event)
             break;
         case Pen:
         case Highlighter:
-            if (!paths.contains(master->page->label()) || paths[master->page->label()].isEmpty())
+            if (!paths.contains(master->pageLabel) || paths[master->pageLabel].isEmpty())
                 break;
-            paths[master->page->label()].last()->endDrawing();
-            emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+            paths[master->pageLabel].last()->endDrawing();
+            strokeIndex.update(master->pageLabel, paths[master->pageLabel].last(), 0);
+            emit pathOperation(newOperation(PathOperation::EndPath, master->pageLabel));
             update();
             [[clang::fallthrough]];
         case Eraser:
@@ -675,11 +973,7 @@ void PathOverlay::mouseMoveEvent(QMouseEvent* event)
         {
         case Pen:
         case Highlighter:
-            if (!paths[master->page->label()].isEmpty()) {
-                paths[master->page->label()].last()->append(event->localPos());
-                update(paths[master->page->label()].last()->getOuterLast());
-                emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
-            }
+            appendToPath(event->localPos());
             break;
         case Eraser:
             erase(event->localPos());
@@ -714,99 +1008,236 @@ void PathOverlay::mouseMoveEvent(QMouseEvent* event)
 
 void PathOverlay::erase(const QPointF &point)
 {
-    if (master->page == nullptr || paths[master->page->label()].isEmpty())
+    if (master->page == nullptr || paths[master->pageLabel].isEmpty())
+        return;
+    QList<DrawPath*> const& path_list = paths[master->pageLabel];
+    // Only segments near point are checked. The index is kept up to date
+    // while drawing and erasing, and only rebuilt after other changes.
+    if (!strokeIndex.isValid(master->pageLabel, path_list.size()))
+        strokeIndex.rebuild(master->pageLabel, path_list);
+    QPointF const center = toPage(point);
+    qreal const radius = (tool.tool == Eraser ? tool.size : eraserSize)/master->resolution;
+    QMap<int, QVector<int>> const found = strokeIndex.segmentsNear(center, radius);
+    QMap<int, QVector<qreal>> hits;
+    for (QMap<int, QVector<int>>::const_iterator it=found.cbegin(); it!=found.cend(); it++) {
+        if (it.key() < 0 || it.key() >= path_list.size())
+            continue;
+        QVector<qreal> sections;
+        path_list[it.key()]->sectionsIn(center, radius, *it, sections);
+        if (!sections.isEmpty())
+            hits[i] = sections;
+    }
+    if (hits.isEmpty())
         return;
-    QList<DrawPath*>& path_list = paths[master->page->label()];
-    int const oldsize = path_list.size();
+    PathOperation operation = newOperation(PathOperation::ErasePaths, master->pageLabel);
+    operation.hits = hits;
+    for (QMap<int, QVector<qreal>>::const_iterator it=hits.cbegin(); it!=hits.cend(); it++)
+        operation.hitHashes.append(path_list[it.key()]->getHash());
+    erasePaths(master->pageLabel, hits);
+    emit pathOperation(operation);
+}
+
+void PathOverlay::erasePaths(QString const& label, QMap<int, QVector<qreal>> const& hits)
+{
+    QList<DrawPath*>& path_list = paths[label];
+    bool const current = label == master->pageLabel;
+    bool const synced = current && magnifiedTilesSynced();
+    // Is pixpaths up to date? Then only the erased region needs to be drawn again.
+    bool const cached = current && end_cache == path_list.size() && !pixpaths.isNull();
     QRegion updateRegion;
-    for (int i=0; i<oldsize; i++) {
-        QVector<int> splits = path_list[i]->intersects(point, tool.tool == Eraser ? tool.size : eraserSize);
-        if (splits.isEmpty())
+    int first = path_list.size();
+    // Paths are split starting from the end, such that the indices of the
+    // remaining paths in hits stay valid.
+    QMapIterator<int, QVector<qreal>> hit(hits);
+    hit.toBack();
+    while (hit.hasPrevious()) {
+        hit.previous();
+        int const i = hit.key();
+        QVector<qreal> const& sections = hit.value();
+        if (i >= path_list.size() || sections.isEmpty() || sections.size() % 2 != 0) {
+            qWarning() << "Erasing paths failed: paths are not synchronized.";
             continue;
-        updateRegion += path_list[i]->getOuterDrawing().toAlignedRect();
-        if (splits.first() > 1)
-            path_list.insert(i+1, path_list[i]->split(0, splits.first()-1));
-        for (int s=0; s<splits.size()-1; s++) {
-            if (splits[s+1]-splits[s] > 3) {
-                path_list.insert(i+1, path_list[i]->split(splits[s]+1, splits[s+1]-1));
-                s++;
-            }
         }
-        if (splits.last() < path_list[i]->number()-2)
-            path_list.insert(i+1, path_list[i]->split(splits.last()+1, path_list[i]->number()));
-        delete path_list[i];
-        path_list[i] = nullptr;
-    }
-    for (int i=0; i<path_list.size();) {
-        if (path_list[i] == nullptr)
-            path_list.removeAt(i);
-#ifdef DEBUG_DRAWING
-        // TODO: check again:
-        else if (path_list[i]->isEmpty()) { // this should never happen...
-            qDebug() << "this should never happen.";
-            delete path_list[i];
-            path_list.removeAt(i);
+        DrawPath* const path = path_list[i];
+        updateRegion += toWidget(path->getOuterDrawing());
+        strokeIndex.remove(label, path);
+        // Keep the parts between the erased sections. They end exactly at
+        // the boundary of the eraser, where new nodes are inserted.
+        qreal const last = std::max(path->number() - 1, 0);
+        qreal start = 0.;
+        int position = i + 1;
+        for (int s=0; s<=sections.size(); s+=2) {
+            qreal const end = s < sections.size() ? sections[s] : last;
+            if (end - start > minSection) {
+                path_list.insert(position, path->split(start, end));
+                strokeIndex.insert(label, path_list[position], position);
+                position++;
+            }
+            if (s < sections.size())
+                start = sections[s+1];
         }
-#endif
-        else
-            i++;
+        uncachedPaths.removeOne(path);
+        deletePath(path);
+        path_list.removeAt(i);
+        first = i;
     }
-    if (!updateRegion.isEmpty()) {
+    // Only paths after the first erased path have moved.
+    strokeIndex.renumber(label, path_list, first);
+    if (!current || updateRegion.isEmpty())
+        return;
+    if (cached)
+        repaintPathCache(updateRegion);
+    else
         end_cache = -1;
-        update(updateRegion);
-        emit pathsChanged(master->page->label(), path_list, master->shiftx, master->shifty, master->resolution);
+    invalidateMagnifiedTiles(updateRegion.boundingRect(), synced);
+    update(updateRegion);
+}
+
+void PathOverlay::beginPath(FullDrawTool const& newTool, QPointF const& point)
+{
+    QList<DrawPath*>& list = paths[master->pageLabel];
+    // The size of the tool is given in pixels, the size of the path in points.
+    FullDrawTool pathTool = newTool;
+    pathTool.size /= master->resolution;
+    PathOperation operation = newOperation(PathOperation::BeginPath, master->pageLabel);
+    list.append(new DrawPath(getArena(master->pageLabel), pathTool, toPage(point)));
+    strokeIndex.insert(master->pageLabel, list.last(), list.size() - 1);
+    operation.tool = pathTool;
+    operation.nodes.append(list.last()->node(0));
+    operation.hash = list.last()->getHash();
+    emit pathOperation(operation);
+}
+
+void PathOverlay::appendToPath(QPointF const& point)
+{
+    QList<DrawPath*> const& list = paths[master->pageLabel];
+    if (list.isEmpty())
+        return;
+    DrawPath* const path = list.last();
+    PathOperation operation = newOperation(PathOperation::UpdatePath, master->pageLabel);
+    update(toWidget(path->append(toPage(point), master->resolution)));
+    // The input filter either appended a node or moved the last node.
+    operation.first = path->number() - 1;
+    strokeIndex.update(master->pageLabel, path, operation.first);
+    operation.nodes.append(path->node(path->number() - 1));
+    operation.hash = path->getHash();
+    emit pathOperation(operation);
+}
+
+PathOperation const PathOverlay::newOperation(PathOperation::Type const type, QString const& label) const
+{
+    QList<DrawPath*> const list = paths.value(label);
+    PathOperation operation {type, label};
+    operation.count = list.size();
+    if (!list.isEmpty())
+        operation.target = list.last()->getHash();
+    return operation;
+}
+
+bool PathOverlay::isSynchronized(PathOperation const& operation) const
+{
+    QList<DrawPath*> const list = paths.value(operation.label);
+    if (list.size() != operation.count)
+        return false;
+    switch (operation.type) {
+    case PathOperation::UpdatePath:
+    case PathOperation::EndPath:
+    case PathOperation::UndoPath:
+        return !list.isEmpty() && list.last()->getHash() == operation.target;
+    case PathOperation::ErasePaths:
+    {
+        if (operation.hitHashes.size() != operation.hits.size())
+            return false;
+        QVector<quint32>::const_iterator hash = operation.hitHashes.cbegin();
+        for (QMap<int, QVector<qreal>>::const_iterator it=operation.hits.cbegin(); it!=operation.hits.cend(); it++, hash++) {
+            if (it.key() < 0 || it.key() >= list.size() || list[it.key()]->getHash() != *hash)
+                return false;
+        }
+        return true;
+    }
+    default:
+        return true;
     }
 }
 
-void PathOverlay::setPathsQuick(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
+void PathOverlay::sendPaths(QString const pagelabel)
 {
-    QPointF shift = QPointF(master->shiftx, master->shifty) - master->resolution/refresolution*QPointF(refshiftx, refshifty);
-    int const diff = list.length() - paths[pagelabel].length();
-    if (diff == 0) {
-        QRect const rect = paths[pagelabel].last()->update(*list.last(), shift, master->resolution/refresolution);
-        if (rect.isValid())
-            update(rect);
-        else
-            setPaths(pagelabel, list, refshiftx, refshifty, refresolution);
+    loadPage(pagelabel);
+    emit pathsChanged(pagelabel, paths.value(pagelabel));
+}
+
+void PathOverlay::applyOperation(PathOperation const& operation)
+{
+    loadPage(operation.label);
+    // Index based operations would change the wrong paths: copy all paths instead.
+    if (!isSynchronized(operation)) {
+        qWarning() << "Paths are not synchronized: copying all paths of page" << operation.label;
+        emit requestPaths(operation.label);
+        return;
     }
-    else if (diff == 1) {
-        paths[pagelabel].append(new DrawPath(*list.last(), shift, master->resolution/refresolution));
-        update(paths[pagelabel].last()->getOuterDrawing().toAlignedRect());
+    bool const current = operation.label == master->pageLabel;
+    QList<DrawPath*>& list = paths[operation.label];
+    switch (operation.type) {
+    case PathOperation::BeginPath:
+    {
+        if (operation.nodes.isEmpty())
+            return;
+        list.append(new DrawPath(getArena(operation.label), operation.tool, operation.nodes.first()));
+        list.last()->setHash(operation.hash);
+        strokeIndex.insert(operation.label, list.last(), list.size() - 1);
+        if (current)
+            update(toWidget(list.last()->getOuterDrawing()));
+        break;
     }
-    else if (diff < 0) {
-        if (diff == -1 && paths[pagelabel].length() >= 1) {
-           DrawPath* path = paths[pagelabel].takeLast();
-           update(path->getOuterDrawing().toAlignedRect());
-           delete path;
-        }
-        else if (-diff >= paths[pagelabel].length()) {
-            qDeleteAll(paths[pagelabel]);
-            paths[pagelabel].clear();
-            update();
-        }
-        else {
-            for (int i=diff; i++<0;)
-                delete paths[pagelabel].takeLast();
-            update();
+    case PathOperation::UpdatePath:
+    {
+        if (list.isEmpty())
+            return;
+        QRectF const rect = list.last()->setNodes(operation.first, operation.nodes, operation.hash);
+        strokeIndex.update(operation.label, list.last(), operation.first);
+        if (!rect.isValid()) {
+            qWarning() << "Updating path failed: copying all paths of page" << operation.label;
+            emit requestPaths(operation.label);
         }
-        end_cache = -1;
-        pixpaths = QPixmap();
+        else if (current)
+            update(toWidget(rect));
+        break;
     }
-    else {
-#ifdef DEBUG_DRAWING
-        qDebug() << "set paths quick failed!" << this;
-#endif
-        setPaths(pagelabel, list, refshiftx, refshifty, refresolution);
+    case PathOperation::EndPath:
+        if (list.isEmpty())
+            return;
+        list.last()->endDrawing();
+        strokeIndex.update(operation.label, list.last(), 0);
+        if (current)
+            update(toWidget(list.last()->getOuterDrawing()));
+        break;
+    case PathOperation::ErasePaths:
+        erasePaths(operation.label, operation.hits);
+        break;
+    case PathOperation::UndoPath:
+        removeLastPath(operation.label);
+        break;
+    case PathOperation::RedoPath:
+        // The undone paths of the overlays can differ: the path is sent with the operation.
+        if (undonePaths.isEmpty() || undonePaths.last()->getHash() != operation.hash) {
+            if (operation.nodes.isEmpty())
+                return;
+            DrawPath* const path = new DrawPath(getArena(operation.label), operation.tool, operation.nodes.constData(), operation.nodes.size());
+            path->setHash(operation.hash);
+            undonePaths.append(path);
+        }
+        restorePath(operation.label);
+        break;
     }
 }
 
-void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
+void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list)
 {
-    QPointF shift = QPointF(master->shiftx, master->shifty) - master->resolution/refresolution*QPointF(refshiftx, refshifty);
+    loadPage(pagelabel);
     if (!paths.contains(pagelabel)) {
         paths[pagelabel] = QList<DrawPath*>();
         for (QList<DrawPath*>::const_iterator it = list.cbegin(); it!=list.cend(); it++)
-            paths[pagelabel].append(new DrawPath(**it, shift, master->resolution/refresolution));
+            paths[pagelabel].append(new DrawPath(getArena(pagelabel), **it));
     }
     else {
         // Basic assumption: If list and paths[pagelabel] both contain two elements, then these elements appear in the same order in both lists.
@@ -815,11 +1246,11 @@ void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list
         for (;new_it<list.cend() && old_it<paths[pagelabel].end() && (*new_it)->getHash() == (*old_it)->getHash(); new_it++, old_it++) {}
         if (old_it >= paths[pagelabel].end()-1) {
             if (old_it == paths[pagelabel].end()-1) {
-                delete *old_it;
+                deletePath(*old_it);
                 paths[pagelabel].pop_back();
             }
             while (new_it < list.cend())
-                paths[pagelabel].append(new DrawPath(**(new_it++), shift, master->resolution/refresolution));
+                paths[pagelabel].append(new DrawPath(getArena(pagelabel), **(new_it++)));
         }
         else {
             // create look up table for new hashs
@@ -831,21 +1262,24 @@ void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list
                 // next new path which exists already in the old paths:
                 next = newHashs.value((*old_it)->getHash(), list.cend());
                 if (next == list.cend()) {
-                    delete *old_it;
+                    deletePath(*old_it);
                     old_it = paths[pagelabel].erase(old_it);
                 }
                 else {
                     while (new_it < next)
-                        old_it = paths[pagelabel].insert(old_it, new DrawPath(**(new_it++), shift, master->resolution/refresolution)) + 1;
+                        old_it = paths[pagelabel].insert(old_it, new DrawPath(getArena(pagelabel), **(new_it++))) + 1;
                     new_it++;
                     old_it++;
                 }
             }
             while (new_it < list.cend())
-                paths[pagelabel].append(new DrawPath(**(new_it++), shift, master->resolution/refresolution));
+                paths[pagelabel].append(new DrawPath(getArena(pagelabel), **(new_it++)));
         }
     }
     end_cache = -1;
+    clearMagnifiedTiles();
+    // Paths may have been replaced by new paths at the same address.
+    strokeIndex.clear();
     updatePathCache();
     update();
 }
@@ -853,7 +1287,7 @@ void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list
 void PathOverlay::setPointerPosition(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
 {
     pointerPosition = (point - QPointF(refshiftx, refshifty)) * master->resolution/refresolution + QPointF(master->shiftx, master->shifty);
-    if (tool.tool == Magnifier && enlargedPage.isNull())
+    if (tool.tool == Magnifier && (magnifierRenderer == nullptr || magnifierRenderer->getPage() != master->pageIndex))
         updateEnlargedPage();
     if (tool.tool == Pointer || tool.tool == Magnifier || tool.tool == Torch)
         update();
@@ -862,7 +1296,7 @@ void PathOverlay::setPointerPosition(QPointF const point, qint16 const refshiftx
 void PathOverlay::setStylusPosition(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
 {
     stylusPosition = (point - QPointF(refshiftx, refshifty)) * master->resolution/refresolution + QPointF(master->shiftx, master->shifty);
-    if (stylusTool.tool == Magnifier && enlargedPage.isNull())
+    if (stylusTool.tool == Magnifier && (magnifierRenderer == nullptr || magnifierRenderer->getPage() != master->pageIndex))
         updateEnlargedPage();
     if (stylusTool.tool == Pointer || stylusTool.tool == Torch || stylusTool.tool == Magnifier)
         update();
@@ -883,84 +1317,40 @@ void PathOverlay::updateEnlargedPage()
     FullDrawTool const* thetool = &tool;
     if (tool.tool != Magnifier)
         thetool = &stylusTool;
-    // Check whether an update is required.
+    // Check whether the magnifier is used.
     if (thetool->tool != Magnifier || master->page == nullptr || thetool->extras.magnification < 1e-12) {
-        if (!enlargedPage.isNull())
-            enlargedPage = QPixmap();
+        if (magnifierRenderer != nullptr)
+            magnifierRenderer->clear();
+        clearMagnifiedTiles();
         return;
     }
-    // Create enlargedPageRenderer if necessary.
-    if (enlargedPageRenderer == nullptr) {
-        enlargedPageRenderer = new SingleRenderer(master->doc, master->pagePart, this);
-        connect(enlargedPageRenderer, &BasicRenderer::cacheThreadFinished, this, &PathOverlay::updateEnlargedPage);
-    }
-    // Render page using enlargedPageRenderer if necessary (the rendering is done in a separate thread).
-    if (enlargedPageRenderer->getPage() != master->pageIndex || abs(enlargedPageRenderer->getResolution() - thetool->extras.magnification*master->resolution) > 1e-6 ) {
-        enlargedPageRenderer->changeResolution(thetool->extras.magnification*master->resolution);
-        enlargedPage = QPixmap();
-#ifdef DEBUG_DRAWING
-        qDebug() << "Rendering enlarged page" << master->pageIndex;
-#endif
-        enlargedPageRenderer->renderPage(master->pageIndex);
-        // Return if the enlarged page image is not needed right now.
-        // This makes scanning through the slides much faster.
-        if (QApplication::mouseButtons() != Qt::LeftButton)
-            return;
-    }
-    // Draw enlargedPage.
-    enlargedPage = QPixmap(thetool->extras.magnification*size());
-    enlargedPage.fill(QColor(0,0,0,0));
-    QPainter painter;
-    painter.begin(&enlargedPage);
-    // Draw the slide.
-    if (enlargedPageRenderer->resultReady())
-        // If a rendered page is ready in enlargedPageRenderer: show it in enlargedPage.
-        painter.drawPixmap(
-                    int(thetool->extras.magnification*master->shiftx),
-                    int(thetool->extras.magnification*master->shifty),
-                    enlargedPageRenderer->getPixmap()
-                    );
-    else
-        // Otherwise: show a scaled version of the page image.
-        painter.drawPixmap(
-                    int(thetool->extras.magnification*master->shiftx),
-                    int(thetool->extras.magnification*master->shifty),
-                    master->pixmap.scaled(thetool->extras.magnification*master->pixmap.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
-                    );
-    // Draw annotations.
-    painter.setRenderHint(QPainter::Antialiasing);
-    if (paths.contains(master->page->label())) {
-        for (QList<DrawPath*>::const_iterator path_it=paths[master->page->label()].cbegin(); path_it!=paths[master->page->label()].cend(); path_it++) {
-            FullDrawTool const& tool = (*path_it)->getTool();
-            switch (tool.tool) {
-            case Pen:
-            {
-                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-                painter.setPen(QPen(tool.color, thetool->extras.magnification*tool.size));
-                DrawPath tmp(**path_it, QPointF(0,0), thetool->extras.magnification);
-                painter.drawPolyline(tmp.data(), tmp.number());
-                break;
-            }
-            case Highlighter:
-            {
-                painter.setCompositionMode(QPainter::CompositionMode_Darken);
-                painter.setPen(QPen(tool.color, thetool->extras.magnification*tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-                DrawPath tmp(**path_it, QPointF(0,0), thetool->extras.magnification);
-                painter.drawPolyline(tmp.data(), tmp.number());
-                break;
-            }
-            default:
-                break;
-            }
-        }
+    // Create magnifierRenderer if necessary.
+    if (magnifierRenderer == nullptr) {
+        magnifierRenderer = new TileRenderer(master->doc, master->pagePart, this);
+        magnifierRenderer->setObjectName("magnifier");
+        connect(magnifierRenderer, &TileRenderer::tileReady, this, [this](){update();});
+        emit magnifierRendererCreated(magnifierRenderer);
     }
+    // This drops the tiles if the page or the resolution changed.
+    if (magnifierRenderer->setPage(master->pageIndex, thetool->extras.magnification*master->resolution))
+        clearMagnifiedTiles();
+    // Render the tiles around the last position of the magnifier in advance.
+    // All other tiles are rendered when the magnifier is painted.
+    if (!magnifierPosition.isNull())
+        magnifierRenderer->request(QRectF(
+                    thetool->extras.magnification*(magnifierPosition.x() - master->shiftx) - thetool->size,
+                    thetool->extras.magnification*(magnifierPosition.y() - master->shifty) - thetool->size,
+                    2*thetool->size,
+                    2*thetool->size
+                    ));
     update();
 }
 
-void PathOverlay::saveDrawings(QString const& filename, QString const& notefile) const
+void PathOverlay::saveDrawings(QString const& filename, QString const& notefile)
 {
     // Deprecated
     // Save drawings in a strange data format.
+    loadPendingPages();
     qWarning() << "The binary file type is deprecated.";
     qWarning() << "The saved file will be unreadable for later versions of BeamerPresenter!";
     QFile file(filename);
@@ -982,12 +1372,13 @@ void PathOverlay::saveDrawings(QString const& filename, QString const& notefile)
         stream << newsizes;
     }
     stream << quint16(paths.size());
-    qint16 const w = qint16(width()-2*master->shiftx), h = qint16(height()-2*master->shifty);
+    // Size of the page in points.
+    QSizeF const pageSize = QSizeF(width()-2*master->shiftx, height()-2*master->shifty)/master->resolution;
     for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
         stream << page_it.key() << quint16(page_it->length());
         for (QList<DrawPath*>::const_iterator path_it=page_it->cbegin(); path_it!=page_it->cend(); path_it++) {
             QVector<float> vec;
-            (*path_it)->toIntVector(vec, master->shiftx, master->shifty, w, h);
+            (*path_it)->toIntVector(vec, pageSize);
             stream << static_cast<quint16>((*path_it)->getTool().tool) << (*path_it)->getTool().color << vec;
         }
     }
@@ -999,8 +1390,7 @@ void PathOverlay::saveDrawings(QString const& filename, QString const& notefile)
 
 void PathOverlay::loadXML(QString const& filename, PdfDoc const* notesDoc)
 {
-    // Load drawings from (compressed) XML.
-    // TODO: use gunzip and open Xournal files directly.
+    // Load drawings from (compressed) XML. The file is read as a stream.
     qInfo() << "Loading files is experimental. Files might contain errors or might be unreadable for later versions of BeamerPresenter";
     QFile file(filename);
     if (!file.exists()) {
@@ -1011,313 +1401,353 @@ void PathOverlay::loadXML(QString const& filename, PdfDoc const* notesDoc)
         qCritical() << "Loading file failed: file is not readable.";
         return;
     }
-    QDomDocument doc("BeamerPresenter");
-    if (!doc.setContent(&file)) {
+    if (AnnotationFile::hasMagic(file.peek(4))) {
         file.close();
-        file.open(QIODevice::ReadOnly);
-        if (!doc.setContent(qUncompress(file.readAll()))) {
-            file.close();
-            loadDrawings(filename);
-            return;
-        }
+        loadBinary(filename, notesDoc);
+        return;
     }
-    QDomElement const root = doc.documentElement();
-    if (root.attribute("creator").contains("beamerpresenter", Qt::CaseInsensitive)) {
-
-        // Check whether the presentation file is as expected and warn otherwise.
-        {
-            QDomElement const pres = root.firstChildElement("presentation");
-            QFileInfo const& presentation_fileinfo = QFileInfo(master->doc->getPath());
-            if (pres.attribute("file") != presentation_fileinfo.absoluteFilePath())
-                qWarning() << "This drawing file was generated for a different PDF file path.";
-            if (pres.attribute("modified") != presentation_fileinfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"))
-                qWarning() << "The presentation file has been modified since writing the drawing file.";
-            if (pres.attribute("pages").toInt() != master->doc->getDoc()->numPages())
-                qWarning() << "The numbers of pages in the presentation and drawing file do not match!";
-        }
-
-        // Check whether the notes file is as expected and warn otherwise.
-        {
-            QDomElement const notes = root.firstChildElement("notes");
-            QFileInfo const& notes_fileinfo = QFileInfo(notesDoc->getPath());
-            if (notes.attribute("file") != notes_fileinfo.absoluteFilePath())
-                qWarning() << "This drawing file was generated for a different PDF file path.";
-            if (notes.attribute("modified") != notes_fileinfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"))
-                qWarning() << "The notes file has been modified since writing the drawing file.";
-            if (notes.attribute("pages").toInt() != notesDoc->getDoc()->numPages())
-                qWarning() << "The numbers of pages in the notes and drawing file do not match!";
-        }
-
-        for (QDomElement page_element = root.firstChildElement("page"); !page_element.isNull(); page_element = page_element.nextSiblingElement("page")) {
-            QString const label = page_element.attribute("label");
-            qreal scale;
-            QPoint shift;
-            Poppler::Page const* page = master->doc->getPage(label);
-            QSizeF size;
-            if (page == nullptr)
-                size = master->page->pageSizeF();
-            else
-                size = page->pageSizeF();
-            if (size.width() * height() >= width() * size.height()) {
-                shift.setY(( height() - size.height()/size.width() * width() )/2);
-                scale = width() / size.width();
-            }
-            else {
-                shift.setX((width() - size.width()/size.height() * height() )/2);
-                scale = height() / size.height();
-            }
-            if (paths.contains(label)) {
-                qDeleteAll(paths[label]);
-                paths[label].clear();
+    // Pages of a previously opened annotation file could be overwritten by this file.
+    loadPendingPages();
+    // Compressed (qCompress or gzip) and uncompressed files are detected automatically.
+    ZlibDevice device(&file);
+    if (!device.open(QIODevice::ReadOnly)) {
+        qCritical() << "Loading file failed:" << device.errorString();
+        return;
+    }
+    QXmlStreamReader reader(&device);
+    if (!reader.readNextStartElement()) {
+        device.close();
+        file.close();
+        loadDrawings(filename);
+        return;
+    }
+    QString const creator = reader.attributes().value("creator").toString();
+    if (creator.contains("beamerpresenter", Qt::CaseInsensitive)) {
+        while (reader.readNextStartElement()) {
+            if (reader.name() == "presentation" || reader.name() == "notes") {
+                // Check whether the PDF files are as expected and warn otherwise.
+                QXmlStreamAttributes const attributes = reader.attributes();
+                bool const presentation = reader.name() == "presentation";
+                checkDocument(
+                            presentation ? master->doc : notesDoc,
+                            presentation ? "presentation" : "notes",
+                            attributes.value("file").toString(),
+                            attributes.value("pages").toInt(),
+                            attributes.value("modified").toString()
+                        );
+                reader.skipCurrentElement();
             }
-            else
-                paths[label] = QList<DrawPath*>();
-            for (QDomElement stroke = page_element.firstChildElement("stroke"); !stroke.isNull(); stroke = stroke.nextSiblingElement("stroke")) {
-                DrawTool const tool = toolNames.key(stroke.attribute("tool"), NoTool);
-                if (tool != NoTool) {
-                    QColor const color = QColor(stroke.attribute("color"));
-                    bool ok;
-                    qreal size = stroke.attribute("width").toDouble(&ok);
-                    if (!ok)
-                        size = defaultToolConfig[tool].size;
-                    QStringList const data = stroke.text().split(" ");
-                    paths[label].append(new DrawPath({tool, color, size}, data, shift, scale));
+            else if (reader.name() == "page") {
+                QString const label = reader.attributes().value("label").toString();
+                if (paths.contains(label)) {
+                    clearMagnifiedTiles();
+                    qDeleteAll(paths[label]);
+                    paths[label].clear();
+                    strokeIndex.clear();
                 }
-            }
-            emit pathsChanged(label, paths[label], master->shiftx, master->shifty, master->resolution);
-        }
-
-    }
-    else if (root.attribute("creator").contains("xournal", Qt::CaseInsensitive)) {
-        // Try to import strokes from uncompressed Xournal or Xournal++ file
-        // Get filename and compare it to presentation file.
-        {
-            QDomElement const first_page = root.firstChildElement("page");
-            if (!first_page.isNull()) {
-                QDomElement const first_bg = first_page.firstChildElement("background");
-                if (!first_bg.isNull() && first_bg.hasAttribute("filename")) {
-                    QFileInfo const& presentation_fileinfo = QFileInfo(master->doc->getPath());
-                    if (first_bg.attribute("filename") != presentation_fileinfo.absoluteFilePath())
-                        qWarning() << "This Xournal(++) file uses a different PDF file path.";
+                else
+                    paths[label] = QList<DrawPath*>();
+                while (reader.readNextStartElement()) {
+                    if (reader.name() == "stroke")
+                        readStroke(reader, label, false);
+                    else
+                        reader.skipCurrentElement();
                 }
+                emit pathsChanged(label, paths[label]);
             }
+            else
+                reader.skipCurrentElement();
         }
-        for (QDomElement page_element = root.firstChildElement("page"); !page_element.isNull(); page_element = page_element.nextSiblingElement("page")) {
-            QDomElement bg = page_element.firstChildElement("background");
-            if (bg.isNull())
-                continue;
-            QDomElement layer = page_element.firstChildElement("layer");
-            if (layer.isNull() || !layer.hasChildNodes())
-                continue;
-            bool ok;
-            int const pageno = bg.attribute("pageno").remove(QRegExp("[a-z]")).toInt(&ok) - 1;
-            if (!ok)
+    }
+    else if (creator.contains("xournal", Qt::CaseInsensitive)) {
+        // Try to import strokes from Xournal or Xournal++ files.
+        bool checkedPath = false;
+        while (reader.readNextStartElement()) {
+            if (reader.name() != "page") {
+                reader.skipCurrentElement();
                 continue;
-            QString const label = master->doc->getLabel(pageno);
-            // TODO: handle text.
-            qreal scale;
-            QPoint shift;
-            Poppler::Page const* page = master->doc->getPage(label);
-            QSizeF size;
-            if (page == nullptr)
-                size = master->page->pageSizeF();
-            else
-                size = page->pageSizeF();
-            if (size.width() * height() >= width() * size.height()) {
-                shift.setY(( height() - size.height()/size.width() * width() )/2);
-                scale = width() / size.width();
-            }
-            else {
-                shift.setX((width() - size.width()/size.height() * height() )/2);
-                scale = height() / size.height();
             }
-            for (QDomElement stroke = layer.firstChildElement("stroke"); !stroke.isNull(); stroke = stroke.nextSiblingElement("stroke")) {
-                // This requires that tool names are compatible with those used by Xournal(++).
-                // But since the only stroke tools are "pen" and "highlighter", this is not a problem.
-                DrawTool const tool = toolNames.key(stroke.attribute("tool"), NoTool);
-                if (tool != NoTool) {
-                    QString colorstr = stroke.attribute("color");
-                    // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
-                    // Try to convert between the two formats.
-                    if (colorstr[0] == '#' && colorstr.size() == 9) {
-                        colorstr.insert(1, colorstr.mid(7));
-                        colorstr.truncate(9);
+            // The background defines the page in the PDF file. It comes before the layers.
+            QString label;
+            bool hasLabel = false;
+            while (reader.readNextStartElement()) {
+                if (reader.name() == "background") {
+                    QXmlStreamAttributes const attributes = reader.attributes();
+                    // Compare the file name of the first page to the presentation file.
+                    if (!checkedPath && attributes.hasAttribute("filename")) {
+                        checkedPath = true;
+                        if (attributes.value("filename") != QFileInfo(master->doc->getPath()).absoluteFilePath())
+                            qWarning() << "This Xournal(++) file uses a different PDF file path.";
                     }
-                    QColor const color = QColor(colorstr);
                     bool ok;
-                    qreal size = stroke.attribute("width").toDouble(&ok);
-                    if (!ok)
-                        size = defaultToolConfig[tool].size;
-                    QStringList const data = stroke.text().split(" ");
-                    paths[label].append(new DrawPath({tool, color, size}, data, shift, scale));
+                    int const pageno = attributes.value("pageno").toString().remove(QRegExp("[a-z]")).toInt(&ok) - 1;
+                    if (ok) {
+                        label = master->doc->getLabel(pageno);
+                        hasLabel = true;
+                    }
+                    reader.skipCurrentElement();
+                }
+                else if (reader.name() == "layer" && hasLabel) {
+                    // TODO: handle text.
+                    while (reader.readNextStartElement()) {
+                        if (reader.name() == "stroke")
+                            readStroke(reader, label, true);
+                        else
+                            reader.skipCurrentElement();
+                    }
                 }
+                else
+                    reader.skipCurrentElement();
             }
-            emit pathsChanged(label, paths[label], master->shiftx, master->shifty, master->resolution);
+            if (hasLabel)
+                emit pathsChanged(label, paths[label]);
         }
     }
     else {
-        qWarning() << "Could not understand file: Unknown creator" << root.attribute("creator");
+        qWarning() << "Could not understand file: Unknown creator" << creator;
     }
+    if (reader.hasError())
+        qCritical() << "Error while reading file:" << reader.errorString();
+    device.close();
     file.close();
     update();
 }
 
-void PathOverlay::saveXML(QString const& filename, PdfDoc const* notedoc, bool const compress) const
+void PathOverlay::readStroke(QXmlStreamReader& reader, QString const& label, bool const xournal)
 {
-    // Save drawings in compressed XML.
-    qInfo() << "Saving files is experimental. Files might contain errors or might be unreadable for later versions of BeamerPresenter";
-    QDomDocument doc("BeamerPresenter");
-    QDomElement root = doc.createElement("BeamerPresenter");
-    root.setAttribute("creator", "BeamerPresenter");
-    root.setAttribute("version", APP_VERSION);
-    doc.appendChild(root);
-
-    QString const presentation_file = QFileInfo(master->doc->getPath()).absoluteFilePath();
-    QString const notes_file = QFileInfo(notedoc->getPath()).absoluteFilePath();
-
-    QDomElement pres = doc.createElement("presentation");
-    pres.setAttribute("file", presentation_file);
-    pres.setAttribute("pages", master->doc->getDoc()->numPages());
-    pres.setAttribute("modified", master->doc->getLastModified().toString("yyyy-MM-dd hh:mm:ss"));
-    root.appendChild(pres);
-
-    QDomElement notes = doc.createElement("notes");
-    notes.setAttribute("file", notes_file);
-    notes.setAttribute("pages", notedoc->getDoc()->numPages());
-    notes.setAttribute("modified", notedoc->getLastModified().toString("yyyy-MM-dd hh:mm:ss"));
-    root.appendChild(notes);
+    QXmlStreamAttributes const attributes = reader.attributes();
+    // This requires that tool names are compatible with those used by Xournal(++).
+    // But since the only stroke tools are "pen" and "highlighter", this is not a problem.
+    DrawTool const tool = toolNames.key(attributes.value("tool").toString(), NoTool);
+    QString colorstr = attributes.value("color").toString();
+    bool ok;
+    // Stroke width is saved in points.
+    qreal size = attributes.value("width").toDouble(&ok);
+    // This also moves the reader to the end of the element.
+    QString const text = reader.readElementText();
+    if (tool == NoTool)
+        return;
+    if (!ok)
+        size = defaultToolConfig[tool].size/master->resolution;
+    // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
+    // Try to convert between the two formats.
+    if (xournal && colorstr.startsWith('#') && colorstr.size() == 9) {
+        colorstr.insert(1, colorstr.mid(7));
+        colorstr.truncate(9);
+    }
+    QVector<QPointF> nodes;
+    if (!DrawPath::parseText(text, nodes) || nodes.isEmpty()) {
+        qWarning() << "Ignoring invalid stroke on page" << label;
+        return;
+    }
+    paths[label].append(new DrawPath(getArena(label), {tool, QColor(colorstr), size}, nodes.constData(), nodes.length()));
+}
 
-    for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
-        QDomElement page_element = doc.createElement("page");
-        page_element.setAttribute("label", page_it.key());
-        root.appendChild(page_element);
-        Poppler::Page const* page = master->doc->getPage(page_it.key());
-        /// size of the page in points
-        QSizeF size;
-        if (page == nullptr)
-            size = master->page->pageSizeF();
-        else
-            size = page->pageSizeF();
-        /// scale page in points / pixel
-        qreal scale;
-        /// upper right corner of the page, in pixels
-        QPoint shift;
-        if (size.width() * height() >= width() * size.height()) {
-            shift.setY(( height() - size.height()/size.width() * width() )/2);
-            scale = size.width() / width();
-        }
-        else {
-            shift.setX((width() - size.width()/size.height() * height() )/2);
-            scale = size.height() / height();
-        }
-        for (QList<DrawPath*>::const_iterator path_it=page_it->cbegin(); path_it!=page_it->cend(); path_it++) {
-            QDomElement stroke = doc.createElement("stroke");
-            page_element.appendChild(stroke);
-            FullDrawTool const& tool = (*path_it)->getTool();
-            stroke.setAttribute("tool", toolNames.value(tool.tool, "unkown"));
-            // Colors are saved in #AARRGGBB format.
-            stroke.setAttribute("color", tool.color.name(QColor::HexArgb));
-            // Stroke width is saved in points.
-            stroke.setAttribute("width", tool.size*scale);
-            // Save data as list of x and y coordinates (alternating) in points.
-            QStringList stringList;
-            (*path_it)->toText(stringList, shift, scale);
-            QDomText const data = doc.createTextNode(stringList.join(" "));
-            stroke.appendChild(data);
-        }
+void PathOverlay::writeStroke(QXmlStreamWriter& writer, DrawPath const* path, bool const xournal, QString& buffer)
+{
+    FullDrawTool const& tool = path->getTool();
+    writer.writeStartElement("stroke");
+    writer.writeAttribute("tool", toolNames.value(tool.tool, xournal ? "pen" : "unkown"));
+    // Colors are saved in #AARRGGBB format.
+    QString colorstr = tool.color.name(QColor::HexArgb);
+    if (xournal) {
+        // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
+        // Convert between the two formats.
+        colorstr.append(colorstr.mid(1, 2));
+        colorstr.remove(1, 2);
     }
+    writer.writeAttribute("color", colorstr);
+    // Stroke width is saved in points.
+    writer.writeAttribute("width", QString::number(tool.size));
+    // Save data as list of x and y coordinates (alternating) in points.
+    buffer.resize(0);
+    path->toText(buffer);
+    writer.writeCharacters(buffer);
+    writer.writeEndElement();
+}
 
+void PathOverlay::saveXML(QString const& filename, PdfDoc const* notedoc, bool const compress)
+{
+    // Save drawings in (compressed) XML. The file is written as a stream.
+    loadPendingPages();
+    qInfo() << "Saving files is experimental. Files might contain errors or might be unreadable for later versions of BeamerPresenter";
     QFile file(filename);
-    file.open(QIODevice::WriteOnly);
-    if (compress)
-        file.write(qCompress(doc.toByteArray()));
-        // In order to unzip this compressed file using zlib, you need to remove the first four bytes:
-        // tail -c+5 compressed.bp | zlib-flate -uncompress > uncompressed.bp
-    else
-        file.write(doc.toByteArray());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Saving file failed: file is not writable.";
+        return;
+    }
+    // Compressed files are written in the format of qCompress.
+    // In order to unzip this compressed file using zlib, you need to remove the first four bytes:
+    // tail -c+5 compressed.bp | zlib-flate -uncompress > uncompressed.bp
+    ZlibDevice device(&file);
+    if (compress && !device.open(QIODevice::WriteOnly)) {
+        qCritical() << "Saving file failed:" << device.errorString();
+        return;
+    }
+    QXmlStreamWriter writer(compress ? static_cast<QIODevice*>(&device) : &file);
+    writer.setAutoFormatting(true);
+    writer.setAutoFormattingIndent(1);
+    writer.writeStartDocument();
+    writer.writeDTD("<!DOCTYPE BeamerPresenter>");
+    writer.writeStartElement("BeamerPresenter");
+    writer.writeAttribute("creator", "BeamerPresenter");
+    writer.writeAttribute("version", APP_VERSION);
+
+    writer.writeEmptyElement("presentation");
+    writer.writeAttribute("file", QFileInfo(master->doc->getPath()).absoluteFilePath());
+    writer.writeAttribute("pages", QString::number(master->doc->getDoc()->numPages()));
+    writer.writeAttribute("modified", master->doc->getLastModified().toString("yyyy-MM-dd hh:mm:ss"));
+
+    writer.writeEmptyElement("notes");
+    writer.writeAttribute("file", QFileInfo(notedoc->getPath()).absoluteFilePath());
+    writer.writeAttribute("pages", QString::number(notedoc->getDoc()->numPages()));
+    writer.writeAttribute("modified", notedoc->getLastModified().toString("yyyy-MM-dd hh:mm:ss"));
+
+    /// Text of the current stroke. The buffer is reused for all strokes.
+    QString buffer;
+    for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
+        writer.writeStartElement("page");
+        writer.writeAttribute("label", page_it.key());
+        for (QList<DrawPath*>::const_iterator path_it=page_it->cbegin(); path_it!=page_it->cend(); path_it++)
+            writeStroke(writer, *path_it, false, buffer);
+        writer.writeEndElement();
+    }
+    writer.writeEndDocument();
+    device.close();
+    if (writer.hasError() || file.error() != QFileDevice::NoError)
+        qCritical() << "Error occurred while writing to file.";
     file.close();
 }
 
-void PathOverlay::saveXournal(QString const& filename) const
+void PathOverlay::saveXournal(QString const& filename)
 {
     // Save drawings in a format, which can hopefully be read by Xournal(++).
+    loadPendingPages();
     qInfo() << "Saving to this Xournal compatibility format is experimental.";
-    QDomDocument doc("Xournal-readable");
-    QDomElement root = doc.createElement("xournal");
-    root.setAttribute("creator", "BeamerPresenter " APP_VERSION);
-    doc.appendChild(root);
-
-    // Set title.
-    {
-        QDomElement title = doc.createElement("title");
-        root.appendChild(title);
-        QDomText const title_text = doc.createTextNode("Xournal++ readable XML file created by BeamerPresenter");
-        title.appendChild(title_text);
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Saving file failed: file is not writable.";
+        return;
     }
+    QXmlStreamWriter writer(&file);
+    writer.setAutoFormatting(true);
+    writer.setAutoFormattingIndent(1);
+    writer.writeStartDocument();
+    writer.writeDTD("<!DOCTYPE Xournal-readable>");
+    writer.writeStartElement("xournal");
+    writer.writeAttribute("creator", "BeamerPresenter " APP_VERSION);
+    writer.writeTextElement("title", "Xournal++ readable XML file created by BeamerPresenter");
 
-    QString presentation_file = QFileInfo(master->doc->getPath()).absoluteFilePath();
-
+    /// Text of the current stroke. The buffer is reused for all strokes.
+    QString buffer;
     for (int i=0; i<master->doc->getDoc()->numPages(); i++) {
-        QDomElement page = doc.createElement("page");
+        writer.writeStartElement("page");
         QSizeF const size = master->doc->getPageSize(i);
-        page.setAttribute("width", QString::number(size.width()));
-        page.setAttribute("height", QString::number(size.height()));
-        root.appendChild(page);
-
-        QDomElement bg = doc.createElement("background");
-        bg.setAttribute("type", "pdf");
-        bg.setAttribute("domain", "absolute");
-        bg.setAttribute("filename", master->doc->getPath());
-        bg.setAttribute("pageno", QString::number(i+1) + "ll");
-        page.appendChild(bg);
-
-        QDomElement layer = doc.createElement("layer");
-        page.appendChild(layer);
-
-        /// scale page in points / pixel
-        qreal scale;
-        /// upper right corner of the page, in pixels
-        QPoint shift;
-        if (size.width() * height() >= width() * size.height()) {
-            shift.setY(( height() - size.height()/size.width() * width() )/2);
-            scale = size.width() / width();
-        }
-        else {
-            shift.setX((width() - size.width()/size.height() * height() )/2);
-            scale = size.height() / height();
-        }
+        writer.writeAttribute("width", QString::number(size.width()));
+        writer.writeAttribute("height", QString::number(size.height()));
+
+        writer.writeEmptyElement("background");
+        writer.writeAttribute("type", "pdf");
+        writer.writeAttribute("domain", "absolute");
+        writer.writeAttribute("filename", master->doc->getPath());
+        writer.writeAttribute("pageno", QString::number(i+1) + "ll");
+
+        writer.writeStartElement("layer");
         QList<DrawPath*> const& pathlist = paths.value(master->doc->getLabel(i));
-        for (QList<DrawPath*>::const_iterator path_it=pathlist.cbegin(); path_it!=pathlist.cend(); path_it++) {
-            QDomElement stroke = doc.createElement("stroke");
-            layer.appendChild(stroke);
-            FullDrawTool const& tool = (*path_it)->getTool();
-            stroke.setAttribute("tool", toolNames.value(tool.tool, "pen"));
-            // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
-            // Convert between the two formats.
-            QString colorstr = tool.color.name(QColor::HexArgb);
-            colorstr.append(colorstr.mid(1, 2));
-            colorstr.remove(1, 2);
-            stroke.setAttribute("color", colorstr);
-            // Stroke width is saved in points.
-            stroke.setAttribute("width", tool.size*scale);
-            // Save data as list of x and y coordinates (alternating) in points.
-            QStringList stringList;
-            (*path_it)->toText(stringList, shift, scale);
-            QDomText const data = doc.createTextNode(stringList.join(" "));
-            stroke.appendChild(data);
-        }
+        for (QList<DrawPath*>::const_iterator path_it=pathlist.cbegin(); path_it!=pathlist.cend(); path_it++)
+            writeStroke(writer, *path_it, true, buffer);
+        writer.writeEndElement();
+        writer.writeEndElement();
     }
-
-    QFile file(filename);
-    file.open(QIODevice::WriteOnly);
-    file.write(doc.toByteArray());
+    writer.writeEndDocument();
+    if (writer.hasError() || file.error() != QFileDevice::NoError)
+        qCritical() << "Error occurred while writing to file.";
     file.close();
 }
 
+void PathOverlay::saveBinary(QString const& filename, PdfDoc const* notedoc, bool const compress)
+{
+    // All pages must be loaded before writing: filename could be the file from which they are read.
+    loadPendingPages();
+    QJsonObject const metadata({
+            {"creator", "BeamerPresenter"},
+            {"version", APP_VERSION},
+            {"presentation", documentInfo(master->doc)},
+            {"notes", documentInfo(notedoc)},
+        });
+    QString error;
+    if (!AnnotationFile::write(filename, metadata, paths, compress, error))
+        qCritical() << "Saving file failed:" << error;
+}
+
+void PathOverlay::loadBinary(QString const& filename, PdfDoc const* notesDoc)
+{
+    // Pages of a previously opened annotation file could be overwritten by this file.
+    loadPendingPages();
+    AnnotationFile* file = new AnnotationFile(filename);
+    if (!file->open()) {
+        qCritical() << "Loading file failed:" << file->errorString();
+        delete file;
+        return;
+    }
+    // Check whether the PDF files are as expected and warn otherwise.
+    QJsonObject const presentation = file->getMetadata().value("presentation").toObject();
+    checkDocument(master->doc, "presentation", presentation.value("file").toString(), presentation.value("pages").toInt(), presentation.value("modified").toString());
+    QJsonObject const notes = file->getMetadata().value("notes").toObject();
+    checkDocument(notesDoc, "notes", notes.value("file").toString(), notes.value("pages").toInt(), notes.value("modified").toString());
+    QList<QString> const labels = file->labels();
+    if (labels.isEmpty()) {
+        delete file;
+        return;
+    }
+    annotationFile = file;
+    for (QList<QString>::const_iterator it=labels.cbegin(); it!=labels.cend(); it++)
+        pendingPages.insert(*it);
+    // Other pages are loaded when they are shown.
+    if (master->page != nullptr)
+        loadPage(master->pageLabel);
+}
+
+void PathOverlay::loadPage(QString const& label)
+{
+    if (annotationFile == nullptr || !pendingPages.remove(label))
+        return;
+    // Pages in the annotation file replace the paths which were drawn before the file was opened.
+    QList<DrawPath*>& list = paths[label];
+    if (!list.isEmpty()) {
+        clearMagnifiedTiles();
+        qDeleteAll(list);
+        list.clear();
+        strokeIndex.clear();
+    }
+    if (!annotationFile->readPage(label, getArena(label), list))
+        qCritical() << "Loading page" << label << "failed:" << annotationFile->errorString();
+    if (pendingPages.isEmpty()) {
+        delete annotationFile;
+        annotationFile = nullptr;
+    }
+    if (master->page != nullptr && label == master->pageLabel) {
+        end_cache = -1;
+        clearMagnifiedTiles();
+        updatePathCache();
+        update();
+    }
+    emit pathsChanged(label, list);
+}
+
+void PathOverlay::loadPendingPages()
+{
+    // loadPage closes annotationFile after loading the last page.
+    QList<QString> const labels = pendingPages.values();
+    for (QList<QString>::const_iterator it=labels.cbegin(); it!=labels.cend(); it++)
+        loadPage(*it);
+}
+
 void PathOverlay::loadDrawings(QString const& filename)
 {
     // Deprecated
     // Load drawings from the strange data format.
+    loadPendingPages();
     QFile file(filename);
     if (!file.exists()) {
         qCritical() << "Loading file failed: file does not exist.";
@@ -1369,7 +1799,8 @@ void PathOverlay::loadDrawings(QString const& filename)
         return;
     }
     clearAllAnnotations();
-    qint16 const w = qint16(width()-2*master->shiftx), h = qint16(height()-2*master->shifty);
+    // Size of the page in points.
+    QSizeF const pageSize = QSizeF(width()-2*master->shiftx, height()-2*master->shifty)/master->resolution;
     QString pagelabel;
     quint16 tool;
     QColor color;
@@ -1387,9 +1818,9 @@ void PathOverlay::loadDrawings(QString const& filename)
                 qCritical() << "Interrupted reading file: File is corrupt.";
                 break;
             }
-            paths[pagelabel].append(new DrawPath({static_cast<DrawTool>(tool), color, defaultToolConfig[static_cast<DrawTool>(tool)].size}, vec, master->shiftx, master->shifty, w, h));
+            paths[pagelabel].append(new DrawPath(getArena(pagelabel), {static_cast<DrawTool>(tool), color, defaultToolConfig[static_cast<DrawTool>(tool)].size/master->resolution}, vec, pageSize));
         }
-        emit pathsChanged(pagelabel, paths[pagelabel], master->shiftx, master->shifty, master->resolution);
+        emit pathsChanged(pagelabel, paths[pagelabel]);
     }
     update();
 }
@@ -1417,32 +1848,68 @@ void PathOverlay::drawPointer(QPainter& painter)
 
 void PathOverlay::undoPath()
 {
-    if (!paths[master->page->label()].isEmpty()) {
-        undonePaths.append(paths[master->page->label()].takeLast());
+    PathOperation const operation = newOperation(PathOperation::UndoPath, master->pageLabel);
+    if (removeLastPath(master->pageLabel))
+        emit pathOperation(operation);
+}
+
+void PathOverlay::redoPath()
+{
+    PathOperation operation = newOperation(PathOperation::RedoPath, master->pageLabel);
+    if (!restorePath(master->pageLabel))
+        return;
+    DrawPath const* const path = paths[master->pageLabel].last();
+    operation.tool = path->getTool();
+    operation.nodes.reserve(path->number());
+    for (int i=0; i<path->number(); i++)
+        operation.nodes.append(path->node(i));
+    operation.hash = path->getHash();
+    emit pathOperation(operation);
+}
+
+bool PathOverlay::removeLastPath(QString const& label)
+{
+    if (paths[label].isEmpty())
+        return false;
+    bool const current = label == master->pageLabel;
+    bool const synced = current && magnifiedTilesSynced();
+    bool const cached = current && end_cache == paths[label].length() && !pixpaths.isNull();
+    undonePaths.append(paths[label].takeLast());
+    strokeIndex.remove(label, undonePaths.last());
+    uncachedPaths.removeOne(undonePaths.last());
+    if (!current)
+        return true;
+    if (cached)
+        repaintPathCache(toWidget(undonePaths.last()->getOuterDrawing()));
+    else {
         end_cache = -1;
         pixpaths = QPixmap();
-        update(undonePaths.last()->getOuterDrawing().toAlignedRect());
-        emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
     }
+    invalidateMagnifiedTiles(toWidget(undonePaths.last()->getOuterDrawing()), synced);
+    update(toWidget(undonePaths.last()->getOuterDrawing()));
+    return true;
 }
 
-void PathOverlay::redoPath()
+bool PathOverlay::restorePath(QString const& label)
 {
-    if (!undonePaths.isEmpty()) {
-        DrawPath* path = undonePaths.takeLast();
-        paths[master->page->label()].append(path);
-        update(path->getOuterDrawing().toAlignedRect());
-        emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
-    }
+    if (undonePaths.isEmpty())
+        return false;
+    DrawPath* path = undonePaths.takeLast();
+    // The path can have been undone on another page.
+    path->moveTo(getArena(label));
+    paths[label].append(path);
+    strokeIndex.insert(label, path, paths[label].size() - 1);
+    if (label == master->pageLabel)
+        update(toWidget(path->getOuterDrawing()));
+    return true;
 }
 
 void PathOverlay::resetCache()
 {
      end_cache = -1;
-     if (tool.tool != Magnifier) {
-         delete enlargedPageRenderer;
-         enlargedPageRenderer = nullptr;
-     }
+     clearMagnifiedTiles();
+     if (tool.tool != Magnifier && magnifierRenderer != nullptr)
+         magnifierRenderer->clear();
 }
 
 void PathOverlay::togglePointerVisibility()
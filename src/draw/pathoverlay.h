@@ -22,10 +22,56 @@
 #include <QWidget>
 #include <QApplication>
 #include <QRegExp>
+#include <QTransform>
+#include <QSet>
 #include "drawpath.h"
-#include "../pdf/singlerenderer.h"
+#include "strokeindex.h"
+#include "../pdf/tilerenderer.h"
 
 class DrawSlide;
+class AnnotationFile;
+class QXmlStreamReader;
+class QXmlStreamWriter;
+
+/// Operation on the paths of a page, which is sent to synchronized overlays.
+/// Both overlays apply the same operations, such that their lists of paths
+/// stay equal. Coordinates and sizes are given in points on the page
+/// (independent of the resolution). Paths are identified by their index.
+/// The number of paths and the hashes of the affected paths describe the
+/// state of the sender before the operation. A receiver in a different state
+/// does not apply the operation, but requests all paths of the page instead.
+struct PathOperation {
+    enum Type {
+        /// Append a new path drawn with tool, starting at nodes.first().
+        BeginPath,
+        /// Overwrite the nodes of the last path starting at index first with nodes. Append nodes if necessary.
+        UpdatePath,
+        /// Finish drawing the last path.
+        EndPath,
+        /// Erase sections of paths and split them: hits maps the index of a path to its erased sections.
+        ErasePaths,
+        /// Move the last path to the undone paths.
+        UndoPath,
+        /// Append the path with tool, nodes and hash, which was undone before.
+        RedoPath,
+    };
+    Type type;
+    /// Page label.
+    QString label;
+    FullDrawTool tool = {NoTool, Qt::black, 0.};
+    int first = 0;
+    QVector<QPointF> nodes = {};
+    /// Hash of the path after the operation.
+    quint32 hash = 0;
+    /// Erased sections: pairs of positions along the path (see DrawPath::split()).
+    QMap<int, QVector<qreal>> hits = {};
+    /// Number of paths on the page before the operation.
+    int count = 0;
+    /// Hash of the last path before the operation (UpdatePath, EndPath and UndoPath).
+    quint32 target = 0;
+    /// Hashes of the paths in hits before the operation, in the order of hits (ErasePaths).
+    QVector<quint32> hitHashes = {};
+};
 
 class PathOverlay : public QWidget
 {
@@ -42,19 +88,32 @@ public:
 
     QMap<QString, QList<DrawPath*>> const& getPaths() const {return paths;}
     FullDrawTool const& getTool() const {return tool;}
-    SingleRenderer* getEnlargedPageRenderer() {return enlargedPageRenderer;}
+    TileRenderer* getMagnifierRenderer() {return magnifierRenderer;}
 
     /// Deprecated
-    void saveDrawings(QString const& filename, QString const& notefile = "") const;
+    void saveDrawings(QString const& filename, QString const& notefile = "");
     /// Deprecated
     void loadDrawings(QString const& filename);
     /// Save drawings to compressed or uncompressed BeamerPresenter XML file.
-    void saveXML(QString const& filename, PdfDoc const* notedoc, bool const compress = true) const;
+    void saveXML(QString const& filename, PdfDoc const* notedoc, bool const compress = true);
     /// Save drawings to an XML file which should be readable for Xournal(++).
-    void saveXournal(QString const& filename) const;
+    void saveXournal(QString const& filename);
+    /// Save drawings to a binary BeamerPresenter annotation file (see AnnotationFile).
+    /// If compress is true, pages are compressed if this reduces their size.
+    void saveBinary(QString const& filename, PdfDoc const* notedoc, bool const compress = true);
     /// Load drawings from compressed or uncompressed BeamerPresenter XML file.
-    /// This function also supports reading uncompressed Xournal(++) XML files.
-    void loadXML(QString const& filename, PdfDoc const* nodesDoc);
+    /// This function also supports reading Xournal(++) XML files (gzip compressed or uncompressed)
+    /// and binary annotation files, which are passed on to loadBinary.
+    /// Files are read as a stream without keeping the XML document in memory.
+    void loadXML(QString const& filename, PdfDoc const* notesDoc);
+    /// Open a binary annotation file. Only the index of the file is read:
+    /// the paths of a page are loaded when the page is shown (see loadPage).
+    void loadBinary(QString const& filename, PdfDoc const* notesDoc);
+    /// Load the paths of page label from the annotation file if they have not been loaded yet.
+    /// The paths are sent to synchronized overlays.
+    void loadPage(QString const& label);
+    /// Load all pages from the annotation file which have not been loaded yet and close the file.
+    void loadPendingPages();
 
     /// Set size of eraser (in point).
     void setEraserSize(qreal const size) {eraserSize = size;}
@@ -81,10 +140,39 @@ protected:
     virtual void mouseMoveEvent(QMouseEvent* event) override;
     /// Overwrite QWidget::event to handle touch and tablet events
     virtual bool event(QEvent* event) override;
-    /// Resize this widget and rescale all paths.
-    void rescale(qint16 const oldshiftx, qint16 const oldshifty, double const oldRes);
+    /// Drop everything depending on the resolution after the widget was resized.
+    /// Paths are stored in points and are not changed.
+    void rescale(double const oldRes);
+    /// Read the stroke element at the current position of reader and append it to the paths on page label.
+    /// If xournal is true, colors are read in the format of Xournal (#RRGGBBAA).
+    void readStroke(QXmlStreamReader& reader, QString const& label, bool const xournal);
+    /// Write path as stroke element. buffer is used for the coordinates.
+    /// If xournal is true, colors are written in the format of Xournal (#RRGGBBAA).
+    static void writeStroke(QXmlStreamWriter& writer, DrawPath const* path, bool const xournal, QString& buffer);
     /// Erase paths at given point.
     void erase(QPointF const& point);
+    /// Erase sections of paths on page label and keep the remaining parts as separate paths.
+    /// hits maps indices of paths to sorted, disjoint sections given as pairs of positions (see DrawPath::split()).
+    void erasePaths(QString const& label, QMap<int, QVector<qreal>> const& hits);
+    /// Start a new path on the current page.
+    void beginPath(FullDrawTool const& newTool, QPointF const& point);
+    /// Add an input sample to the last path on the current page.
+    void appendToPath(QPointF const& point);
+    /// Move the last path on page label to undonePaths. Return false if there is no path.
+    bool removeLastPath(QString const& label);
+    /// Move the last path in undonePaths to page label. Return false if there is no undone path.
+    bool restorePath(QString const& label);
+    /// Operation of given type on page label, describing the current state of the page.
+    PathOperation const newOperation(PathOperation::Type const type, QString const& label) const;
+    /// Is page operation.label in the state in which operation was sent?
+    bool isSynchronized(PathOperation const& operation) const;
+    /// Convert widget coordinates to page coordinates (points).
+    QPointF const toPage(QPointF const& point) const;
+    /// Transformation from page coordinates (points) to widget coordinates.
+    /// Paths are drawn with this transformation as world transform of the painter.
+    QTransform const pageTransform() const;
+    /// Rectangle of pixels in the widget covering rect (in points), including pixels touched by antialiasing.
+    QRect const toWidget(QRectF const& rect) const;
     /// Radius of eraser in pixel.
     qreal eraserSize = 10.;
     /// Current draw tool.
@@ -93,6 +181,20 @@ protected:
     FullDrawTool stylusTool = {Pen, Qt::black, 2.5};
     /// Currently visible paths.
     QMap<QString, QList<DrawPath*>> paths;
+    /// Binary annotation file from which pages are loaded lazily. nullptr if all pages are loaded.
+    AnnotationFile* annotationFile = nullptr;
+    /// Labels of pages in annotationFile which have not been loaded yet.
+    QSet<QString> pendingPages;
+    /// Storage of the nodes of paths for each page label.
+    QMap<QString, StrokeArena*> arenas;
+    /// Arena for paths on the page with the given label.
+    /// This is only called when a path is created. Nodes are appended through
+    /// the arena pointer of the path, without any lookup by label.
+    StrokeArena* getArena(QString const& label);
+    /// Spatial index of the paths on one page, used for erasing.
+    /// It is updated when paths are drawn, erased, undone or restored, and
+    /// cleared when the paths are replaced. The eraser rebuilds it if necessary.
+    StrokeIndex strokeIndex;
     /// Undisplayed paths which could be restored.
     QList<DrawPath*> undonePaths;
     /// Current position of the pointer.
@@ -101,23 +203,71 @@ protected:
     /// Current position of the stylus.
     /// (0,0) indicates that no stylus pointing tool is currently active.
     QPointF stylusPosition = QPointF();
-    /// Page enlarged by magnification factor: used for magnifier.
-    QPixmap enlargedPage;
-    /// Renderer for enlarged page: enables rendering of enlarged page in separate thread.
-    SingleRenderer* enlargedPageRenderer = nullptr;
+    /// Renderer for tiles of the enlarged page shown in the magnifier.
+    /// Tiles are rendered in the RenderPool around the magnifier position.
+    TileRenderer* magnifierRenderer = nullptr;
+    /// Last position of the magnifier. Tiles around this position are rendered in advance.
+    QPointF magnifierPosition = QPointF();
+    /// Tiles of the magnifier: tiles of magnifierRenderer with the paths of the
+    /// current page drawn on top (persistent stroke layer of the magnifier).
+    /// Only tiles which are available in magnifierRenderer are kept.
+    QMap<int, QPixmap> magnifiedTiles;
+    /// Number of paths of the current page drawn to magnifiedTiles.
+    int magnifiedEnd = 0;
+    /// Last path drawn to magnifiedTiles. This path can grow while it is drawn.
+    DrawPath const* magnifiedLast = nullptr;
+    /// Number of nodes of magnifiedLast drawn to magnifiedTiles.
+    int magnifiedLastNodes = 0;
+    /// Last node of magnifiedLast drawn to magnifiedTiles. The input filter of DrawPath can move it.
+    QPointF magnifiedLastPoint;
+    /// Label of the page shown in magnifiedTiles.
+    QString magnifiedLabel;
+    /// Draw the magnifier at position.
+    void drawMagnifier(QPainter& painter, FullDrawTool const& magnifier, QPointF const& position);
+    /// Transformation from widget coordinates to pixels of the magnified tile.
+    QTransform const magnifiedTileTransform(int const tile, qreal const magnification) const;
+    /// Draw paths of the current page from index start on (starting at node startNode of the first path) with painter.
+    /// Only paths intersecting region (in widget coordinates) are drawn.
+    void drawPathsPlain(QPainter& painter, QRectF const& region, int const start, int const startNode = 0);
+    /// Bring magnifiedTiles up to date with the paths of the current page.
+    /// New paths and new nodes are drawn incrementally. If paths were removed or changed, all tiles are dropped.
+    void syncMagnifiedTiles(qreal const magnification);
+    /// Are magnifiedTiles up to date with the paths of the current page?
+    bool magnifiedTilesSynced() const;
+    /// Drop tiles of the magnifier showing region (widget coordinates) after paths in region were removed.
+    /// All tiles are dropped if magnifiedTiles were not up to date before the paths were removed.
+    void invalidateMagnifiedTiles(QRectF const& region, bool const synced);
+    /// Delete a path. A new path can be allocated at the same
+    /// address, so the magnifier must not take it for magnifiedLast afterwards.
+    void deletePath(DrawPath* path);
+    /// Drop all tiles of the magnifier.
+    void clearMagnifiedTiles();
     /// Pixmap containing only paths.
     QPixmap pixpaths;
     /// Index of last path (of current slide) which is already rendered to pixpaths.
     int end_cache = -1;
+    /// Highlighter paths before end_cache which overlap videos and are therefore not drawn to pixpaths.
+    /// These are drawn on top of pixpaths.
+    QList<DrawPath const*> uncachedPaths;
+    /// Draw uncachedPaths to painter.
+    void drawUncachedPaths(QPainter& painter, QRegion const& region);
+    /// Draw region of pixpaths again after paths in region have been removed.
+    /// This requires that pixpaths contained all paths before they were removed.
+    void repaintPathCache(QRegion const& region);
     /// Master slide to which this overlay is attached.
     DrawSlide const* master;
 
 public slots:
-    /// Update enlarged page (required for magnifier) if necessary.
-    /// The page is rendered in a separate thread.
+    /// Update the magnifier after the page, the tool or the paths have changed.
+    /// Tiles of the enlarged page are rendered in the RenderPool.
     void updateEnlargedPage();
-    void setPaths(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
-    void setPathsQuick(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
+    /// Replace the paths on page pagelabel by copies of list.
+    void setPaths(QString const pagelabel, QList<DrawPath*> const& list);
+    /// Apply an operation sent by a synchronized overlay.
+    /// If the paths are not synchronized, all paths of the page are requested instead.
+    void applyOperation(PathOperation const& operation);
+    /// Send all paths on page pagelabel to synchronized overlays.
+    void sendPaths(QString const pagelabel);
     void setPointerPosition(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     void setStylusPosition(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     void setTool(FullDrawTool const& newtool, qreal const resolution=-1.);
@@ -133,12 +283,17 @@ public slots:
 signals:
     void pointerPositionChanged(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     void stylusPositionChanged(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
-    void pathsChangedQuick(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
-    void pathsChanged(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
+    /// Paths were changed by operation. Synchronized overlays apply the same operation.
+    void pathOperation(PathOperation const& operation);
+    void pathsChanged(QString const pagelabel, QList<DrawPath*> const& list);
+    /// An operation could not be applied: the synchronized overlay should send all paths on page pagelabel.
+    void requestPaths(QString const pagelabel);
     void sendToolChanged(FullDrawTool const tool, qreal const resolution);
     void sendUpdateEnlargedPage();
     void sendRelax();
     void sendUpdatePathCache();
+    /// The renderer of the magnifier was created. Its tiles should be counted in the memory budget.
+    void magnifierRendererCreated(BasicRenderer* renderer);
 };
 
 #endif // PATHOVERLAY_H
@@ -0,0 +1,113 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "strokearena.h"
+#include "drawpath.h"
+#include <cstring>
+
+std::deque<FullDrawTool> StrokeArena::tools;
+
+int StrokeArena::allocate(DrawPath* path, int const number)
+{
+    path->arenaPrev = nullptr;
+    path->arenaNext = first;
+    if (first != nullptr)
+        first->arenaPrev = path;
+    first = path;
+    count++;
+    int const offset = coordinates.size()/2;
+    coordinates.resize(coordinates.size() + 2*number);
+    return offset;
+}
+
+int StrokeArena::append(DrawPath* path, int offset, int const number, QPointF const& point)
+{
+    if (2*(offset + number) != coordinates.size()) {
+        // Move the nodes to the end. This only happens if a path grows after
+        // another path was added, e.g. when paths are synchronized between screens.
+        int const newOffset = coordinates.size()/2;
+        coordinates.resize(coordinates.size() + 2*number);
+        std::memmove(coordinates.data() + 2*newOffset, coordinates.constData() + 2*offset, 2*sizeof(float)*size_t(number));
+        unused += number;
+        offset = newOffset;
+    }
+    coordinates.append(float(point.x()));
+    coordinates.append(float(point.y()));
+    return offset;
+}
+
+void StrokeArena::release(DrawPath* path, int const offset, int const number)
+{
+    if (path->arenaPrev == nullptr && first != path)
+        return;
+    if (path->arenaPrev == nullptr)
+        first = path->arenaNext;
+    else
+        path->arenaPrev->arenaNext = path->arenaNext;
+    if (path->arenaNext != nullptr)
+        path->arenaNext->arenaPrev = path->arenaPrev;
+    path->arenaPrev = path->arenaNext = nullptr;
+    count--;
+    if (2*(offset + number) == coordinates.size())
+        coordinates.resize(2*offset);
+    else
+        unused += number;
+    if (first == nullptr) {
+        coordinates.clear();
+        unused = 0;
+    }
+    else if (unused > 1024 && 4*unused > coordinates.size())
+        compact();
+}
+
+void StrokeArena::compact()
+{
+    QVector<float> compacted;
+    compacted.reserve(coordinates.size() - 2*unused);
+    for (DrawPath* path = first; path != nullptr; path = path->arenaNext) {
+        int const offset = compacted.size()/2;
+        compacted.resize(compacted.size() + 2*path->length);
+        std::memcpy(compacted.data() + 2*offset, coordinates.constData() + 2*path->offset, 2*sizeof(float)*size_t(path->length));
+        path->offset = offset;
+    }
+    coordinates.swap(compacted);
+    unused = 0;
+}
+
+quint32 StrokeArena::toolId(FullDrawTool const& tool)
+{
+    // The table only contains few entries: the tools used for drawing and
+    // the tools of paths read from files. Only the pointer and the magnifier
+    // use extras. Members of the union are compared separately, because the
+    // padding of the pointer struct is not initialized.
+    for (quint32 id=0; id<tools.size(); id++) {
+        FullDrawTool const& other = tools[id];
+        if (other.tool != tool.tool || other.color != tool.color || other.size != tool.size)
+            continue;
+        if (tool.tool == Magnifier && other.extras.magnification != tool.extras.magnification)
+            continue;
+        if (tool.tool == Pointer
+                && (other.extras.pointer.alpha != tool.extras.pointer.alpha
+                    || other.extras.pointer.composition != tool.extras.pointer.composition
+                    || other.extras.pointer.inner != tool.extras.pointer.inner))
+            continue;
+        return id;
+    }
+    tools.push_back(tool);
+    return quint32(tools.size() - 1);
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STROKEARENA_H
+#define STROKEARENA_H
+
+#include <deque>
+#include <QVector>
+#include <QPointF>
+#include "../enumerates.h"
+
+class DrawPath;
+
+/// Storage for the nodes of all paths on one page.
+/// Coordinates are stored as floats (x and y alternating) in one contiguous
+/// array instead of one heap allocated vector of doubles per path. A path
+/// only keeps the offset and number of its nodes in the arena.
+/// Removed paths leave unused ranges, which are freed by compacting the
+/// arena once they make up more than half of it.
+/// The paths of an arena form an intrusive list (DrawPath::arenaPrev and
+/// DrawPath::arenaNext), such that registering a path does not allocate.
+/// Tools of paths are deduplicated in a global table, such that each path
+/// only stores an index in this table.
+class StrokeArena
+{
+public:
+    StrokeArena() {}
+    /// Paths must be deleted before their arena.
+    ~StrokeArena() {}
+    StrokeArena(StrokeArena const&) = delete;
+    StrokeArena& operator=(StrokeArena const&) = delete;
+
+    /// Reserve space for number nodes of path at the end of the arena. Return the offset.
+    int allocate(DrawPath* path, int const number);
+    /// Append a node to the nodes of path at offset. If path is not at the end of
+    /// the arena, its nodes are moved to the end. Return the (new) offset.
+    int append(DrawPath* path, int const offset, int const number, QPointF const& point);
+    /// Mark the nodes of path as unused. This can compact the arena.
+    void release(DrawPath* path, int const offset, int const number);
+    /// Coordinates of the node at offset.
+    float const* data(int const offset) const {return coordinates.constData() + 2*offset;}
+    float* data(int const offset) {return coordinates.data() + 2*offset;}
+
+    /// Number of paths in the arena.
+    int paths() const {return count;}
+    /// Memory used by the arena in bytes.
+    qint64 bytes() const {return qint64(sizeof(float))*coordinates.capacity();}
+
+    /// Index of tool in the global tool table. Equal tools have equal indices.
+    static quint32 toolId(FullDrawTool const& tool);
+    /// Tool with the given index. The reference stays valid.
+    static FullDrawTool const& tool(quint32 const id) {return tools[id];}
+
+private:
+    /// x and y coordinates of nodes, alternating.
+    QVector<float> coordinates;
+    /// First path with nodes in this arena. Offsets of all paths in the list are updated when the arena is compacted.
+    DrawPath* first = nullptr;
+    /// Number of paths in the list.
+    int count = 0;
+    /// Number of nodes in unused ranges.
+    int unused = 0;
+    /// Remove unused ranges.
+    void compact();
+
+    /// Global table of tools. A deque keeps references to its elements valid.
+    static std::deque<FullDrawTool> tools;
+};
+
+#endif // STROKEARENA_H
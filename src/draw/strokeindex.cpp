@@ -0,0 +1,145 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "strokeindex.h"
+#include <algorithm>
+
+void StrokeIndex::rebuild(QString const& label, QList<DrawPath*> const& list)
+{
+    clear();
+    indexedLabel = label;
+    for (int i=0; i<list.size(); i++)
+        insert(label, list[i], i);
+}
+
+void StrokeIndex::insert(QString const& label, DrawPath* path, int const position)
+{
+    if (label != indexedLabel || indexedLabel.isNull())
+        return;
+    records[path] = {position, path->getOuter()};
+    addSegments(path, 0);
+}
+
+void StrokeIndex::update(QString const& label, DrawPath* path, int const first)
+{
+    if (label != indexedLabel || indexedLabel.isNull())
+        return;
+    QHash<DrawPath const*, Record>::iterator const record = records.find(path);
+    if (record == records.end())
+        return;
+    if (first <= 0) {
+        removeSegments(path, *record);
+        record->outer = path->getOuter();
+        addSegments(path, 0);
+        return;
+    }
+    // Segment first-1 ends at the changed node. The old entries stay in the
+    // cells, but hits are checked with the current nodes. The rectangle of
+    // the path only grows, such that removeSegments() finds the old entries.
+    record->outer = record->outer.united(path->getOuter());
+    addSegments(path, first - 1);
+}
+
+void StrokeIndex::addSegments(DrawPath* path, int const start)
+{
+    for (int k=start; k<path->segments(); k++) {
+        QPointF const a = path->segmentStart(k), b = path->segmentEnd(k);
+        int const left = qFloor(std::min(a.x(), b.x())/cellSize), right = qFloor(std::max(a.x(), b.x())/cellSize);
+        int const top = qFloor(std::min(a.y(), b.y())/cellSize), bottom = qFloor(std::max(a.y(), b.y())/cellSize);
+        for (int x=left; x<=right; x++) {
+            for (int y=top; y<=bottom; y++) {
+                QVector<Segment>& cell = cells[cellKey(x, y)];
+                // A re-indexed last segment is often still in the same cell.
+                if (cell.isEmpty() || cell.last().path != path || cell.last().index != k)
+                    cell.append({path, k});
+            }
+        }
+    }
+}
+
+void StrokeIndex::remove(QString const& label, DrawPath const* path)
+{
+    if (label != indexedLabel || indexedLabel.isNull())
+        return;
+    QHash<DrawPath const*, Record>::iterator const record = records.find(path);
+    if (record == records.end())
+        return;
+    removeSegments(path, *record);
+    records.erase(record);
+}
+
+void StrokeIndex::removeSegments(DrawPath const* path, Record const& record)
+{
+    // All indexed segments of path lie in record.outer.
+    int const left = qFloor(record.outer.left()/cellSize), right = qFloor(record.outer.right()/cellSize);
+    int const top = qFloor(record.outer.top()/cellSize), bottom = qFloor(record.outer.bottom()/cellSize);
+    for (int x=left; x<=right; x++) {
+        for (int y=top; y<=bottom; y++) {
+            QHash<quint64, QVector<Segment>>::iterator const cell = cells.find(cellKey(x, y));
+            if (cell == cells.end())
+                continue;
+            cell->erase(std::remove_if(cell->begin(), cell->end(), [path](Segment const& segment){return segment.path == path;}), cell->end());
+            if (cell->isEmpty())
+                cells.erase(cell);
+        }
+    }
+}
+
+void StrokeIndex::renumber(QString const& label, QList<DrawPath*> const& list, int const start)
+{
+    if (label != indexedLabel || indexedLabel.isNull())
+        return;
+    for (int i=std::max(start, 0); i<list.size(); i++) {
+        QHash<DrawPath const*, Record>::iterator const record = records.find(list[i]);
+        if (record != records.end())
+            record->position = i;
+    }
+}
+
+void StrokeIndex::clear()
+{
+    cells.clear();
+    records.clear();
+    indexedLabel = QString();
+}
+
+QMap<int, QVector<int>> const StrokeIndex::segmentsNear(QPointF const& point, qreal const radius) const
+{
+    QMap<int, QVector<int>> segments;
+    qreal const radius2 = radius*radius;
+    int const left = qFloor((point.x() - radius)/cellSize), right = qFloor((point.x() + radius)/cellSize);
+    int const top = qFloor((point.y() - radius)/cellSize), bottom = qFloor((point.y() + radius)/cellSize);
+    for (int x=left; x<=right; x++) {
+        for (int y=top; y<=bottom; y++) {
+            QHash<quint64, QVector<Segment>>::const_iterator const cell = cells.constFind(cellKey(x, y));
+            if (cell == cells.cend())
+                continue;
+            for (Segment const& segment : *cell) {
+                if (segment.index < segment.path->segments()
+                        && segmentDistance2(point, segment.path->segmentStart(segment.index), segment.path->segmentEnd(segment.index)) < radius2)
+                    segments[records.value(segment.path).position].append(segment.index);
+            }
+        }
+    }
+    // Segments are collected cell by cell and can be indexed in several cells.
+    for (QVector<int>& indices : segments) {
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    }
+    return segments;
+}
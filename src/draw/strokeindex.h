@@ -0,0 +1,95 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STROKEINDEX_H
+#define STROKEINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QList>
+#include <QVector>
+#include <QtMath>
+#include "drawpath.h"
+
+/// Spatial index of the segments of all paths on one page: a uniform grid of
+/// square cells, each listing the path segments whose bounding box overlaps it.
+/// Erasing and hit-testing only look at the cells around the point of
+/// interest instead of all segments of all paths. Segments are indexed
+/// instead of nodes, because nodes can be far apart after decimation.
+/// The index does not own the paths. Every change of the paths on the
+/// indexed page must be reported by insert(), update() and remove(), or the
+/// index must be cleared. Changes of other pages are ignored. A cleared
+/// index is rebuilt by rebuild() when it is needed.
+class StrokeIndex
+{
+public:
+    /// Edge length of the grid cells in points.
+    static constexpr qreal cellSize = 16.;
+
+    /// Check whether the index contains the count paths on page label.
+    bool isValid(QString const& label, int const count) const {return !indexedLabel.isNull() && label == indexedLabel && records.size() == count;}
+    /// Index all paths in list on page label.
+    void rebuild(QString const& label, QList<DrawPath*> const& list);
+    /// Add path with given position in the list of paths on page label.
+    /// Positions of the following paths must be updated by renumber().
+    void insert(QString const& label, DrawPath* path, int const position);
+    /// Index the segments of path on page label after its nodes were changed
+    /// or appended starting from index first. Stale entries of moved nodes are
+    /// kept until the path is indexed again with first = 0, e.g. when drawing ends.
+    void update(QString const& label, DrawPath* path, int const first);
+    /// Remove all segments of path on page label from the index. This does not access the nodes of path.
+    /// Positions of the following paths must be updated by renumber().
+    void remove(QString const& label, DrawPath const* path);
+    /// Update the positions of the paths in list on page label starting from index start.
+    void renumber(QString const& label, QList<DrawPath*> const& list, int const start);
+    /// Remove all paths from the index.
+    void clear();
+
+    /// Indices of all segments which are nearer to point than radius, sorted
+    /// for each path. The map keys are the positions of the paths.
+    QMap<int, QVector<int>> const segmentsNear(QPointF const& point, qreal const radius) const;
+
+private:
+    /// Segment index of a path.
+    struct Segment {
+        DrawPath* path;
+        int index;
+    };
+    /// Indexed path.
+    struct Record {
+        /// Position of the path in the list of paths.
+        int position;
+        /// Rectangle containing all indexed segments.
+        QRectF outer;
+    };
+    /// Cells of the grid, only non-empty cells are stored.
+    QHash<quint64, QVector<Segment>> cells;
+    /// Indexed paths.
+    QHash<DrawPath const*, Record> records;
+    /// Page label of the indexed paths, null if the index is not valid.
+    QString indexedLabel;
+
+    /// Key of cell (x, y).
+    static quint64 cellKey(int const x, int const y) {return (quint64(quint32(x)) << 32) | quint32(y);}
+    /// Add segments of path starting from index start.
+    void addSegments(DrawPath* path, int const start);
+    /// Remove all entries of the path in record.
+    void removeSegments(DrawPath const* path, Record const& record);
+};
+
+#endif // STROKEINDEX_H
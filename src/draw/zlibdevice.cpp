@@ -0,0 +1,154 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "zlibdevice.h"
+#include <cstring>
+#include <algorithm>
+
+ZlibDevice::~ZlibDevice()
+{
+    close();
+}
+
+bool ZlibDevice::open(OpenMode mode)
+{
+    if (device == nullptr || (mode & ReadWrite) == ReadWrite || (mode & ReadWrite) == NotOpen) {
+        setErrorString("Invalid mode for compressed device");
+        return false;
+    }
+    std::memset(&stream, 0, sizeof(stream));
+    finished = false;
+    if (mode & ReadOnly) {
+        QByteArray const head = device->peek(6);
+        if (head.size() >= 2 && uchar(head[0]) == 0x1f && uchar(head[1]) == 0x8b) {
+            // gzip header.
+            compressed = true;
+            if (inflateInit2(&stream, 15 + 16) != Z_OK)
+                return false;
+        }
+        else if (head.size() >= 6 && uchar(head[4]) == 0x78) {
+            // qCompress: uncompressed size (4 bytes), followed by a zlib stream with 32KiB window.
+            compressed = true;
+            device->read(4);
+            if (inflateInit(&stream) != Z_OK)
+                return false;
+        }
+        else
+            compressed = false;
+    }
+    else {
+        compressed = true;
+        headerPosition = device->pos();
+        if (device->write(QByteArray(4, '\0')) != 4 || deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            setErrorString(device->errorString());
+            return false;
+        }
+    }
+    if (compressed)
+        buffer.resize(chunkSize);
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void ZlibDevice::close()
+{
+    if (!isOpen())
+        return;
+    if (compressed) {
+        if (openMode() & WriteOnly) {
+            stream.next_in = nullptr;
+            stream.avail_in = 0;
+            bool const ok = deflateToDevice(Z_FINISH);
+            quint32 const size = quint32(stream.total_in);
+            deflateEnd(&stream);
+            // Write the uncompressed size in big endian as qCompress does.
+            char const header[4] = {char(size >> 24), char(size >> 16), char(size >> 8), char(size)};
+            qint64 const end = device->pos();
+            if (!ok || !device->seek(headerPosition) || device->write(header, 4) != 4 || !device->seek(end))
+                qWarning() << "Writing compressed data failed:" << device->errorString();
+        }
+        else
+            inflateEnd(&stream);
+    }
+    buffer.clear();
+    QIODevice::close();
+}
+
+qint64 ZlibDevice::readData(char* data, qint64 maxSize)
+{
+    if (!compressed)
+        return device->read(data, maxSize);
+    if (finished)
+        return 0;
+    stream.next_out = reinterpret_cast<Bytef*>(data);
+    stream.avail_out = uInt(std::min(maxSize, qint64(chunkSize)));
+    uInt const requested = stream.avail_out;
+    while (stream.avail_out > 0) {
+        if (stream.avail_in == 0) {
+            qint64 const size = device->read(buffer.data(), buffer.size());
+            if (size <= 0) {
+                setErrorString("Unexpected end of compressed data");
+                break;
+            }
+            stream.next_in = reinterpret_cast<Bytef*>(buffer.data());
+            stream.avail_in = uInt(size);
+        }
+        int const result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            finished = true;
+            break;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            setErrorString(stream.msg == nullptr ? "Corrupt compressed data" : stream.msg);
+            return -1;
+        }
+    }
+    qint64 const size = requested - stream.avail_out;
+    return (size == 0 && !finished) ? -1 : size;
+}
+
+qint64 ZlibDevice::writeData(char const* data, qint64 maxSize)
+{
+    // The input size of zlib is limited to 32 bit.
+    for (qint64 done = 0; done < maxSize;) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + done));
+        stream.avail_in = uInt(std::min(maxSize - done, qint64(1) << 30));
+        done += stream.avail_in;
+        if (!deflateToDevice(Z_NO_FLUSH)) {
+            setErrorString(device->errorString());
+            return -1;
+        }
+    }
+    return maxSize;
+}
+
+bool ZlibDevice::deflateToDevice(int const flush)
+{
+    while (true) {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+        stream.avail_out = uInt(buffer.size());
+        int const result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR)
+            return false;
+        qint64 const size = buffer.size() - stream.avail_out;
+        if (size > 0 && device->write(buffer.constData(), size) != size)
+            return false;
+        // Without Z_FINISH all input is consumed once output space is left.
+        if (flush == Z_FINISH ? result == Z_STREAM_END : stream.avail_out != 0)
+            return true;
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZLIBDEVICE_H
+#define ZLIBDEVICE_H
+
+#include <QtDebug>
+#include <QIODevice>
+#include <QByteArray>
+#include <zlib.h>
+
+/// Sequential device which compresses data written to it or decompresses
+/// data read from it while passing them on to (from) another device.
+/// Only a small buffer of compressed data is kept in memory.
+///
+/// Reading detects the format of the data: zlib data as written by qCompress
+/// (with the uncompressed size in the first 4 bytes), gzip data (e.g. Xournal
+/// files) or uncompressed data, which are passed on unchanged.
+/// Writing creates the format of qCompress, such that files stay readable with
+/// qUncompress. The size in the header is written when the device is closed,
+/// which requires that the underlying device is seekable.
+class ZlibDevice : public QIODevice
+{
+public:
+    /// Create device for reading from or writing to device, which must be opened
+    /// in the same mode before this is opened. device is not owned.
+    explicit ZlibDevice(QIODevice* device) : device(device) {}
+    ~ZlibDevice() override;
+
+    bool open(OpenMode mode) override;
+    /// Finish the compressed stream. This does not close the underlying device.
+    void close() override;
+    bool isSequential() const override {return true;}
+    /// True if all data have been read.
+    bool atEnd() const override {return compressed ? finished : device->atEnd();}
+    /// Was the data read from the underlying device compressed?
+    bool isCompressed() const {return compressed;}
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(char const* data, qint64 maxSize) override;
+
+private:
+    /// Size of chunks of compressed data read from or written to device.
+    static constexpr int chunkSize = 1 << 16;
+    /// Underlying device.
+    QIODevice* device;
+    z_stream stream;
+    /// Buffer of compressed data.
+    QByteArray buffer;
+    /// Position of the header in device when writing.
+    qint64 headerPosition = 0;
+    /// Is the data compressed? Uncompressed data are read directly from device.
+    bool compressed = false;
+    /// Has the end of the compressed stream been reached?
+    bool finished = false;
+    /// Compress the input of stream and write the output to device.
+    bool deflateToDevice(int const flush);
+};
+
+#endif // ZLIBDEVICE_H
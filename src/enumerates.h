@@ -33,6 +33,17 @@ enum PagePart {
     RightHalf = -1,
 };
 
+/// Cache codec:
+/// Format in which rendered pages are stored in the compressed cache.
+enum CacheCodec {
+    /// PNG images: small, but slow to encode and decode.
+    PngCodec = 0,
+    /// Uncompressed 32 bit pixels: fastest, but large.
+    RawCodec,
+    /// Fast lossless LZ compression of 32 bit pixels.
+    LzCodec,
+};
+
 /// KeyAction: Actions handled by ControlScreen
 enum KeyAction {
     /// No Key Action. Used to indicate errors and missing KeyActions.
@@ -177,6 +188,8 @@ enum KeyAction {
     SaveDrawingsLegacy,
     /// Save drawings to Xournal(++) compatibility XML format
     SaveDrawingsXournal,
+    /// Save drawings to binary annotation file with random access to pages
+    SaveDrawingsBinary,
 
     // Hard coded keys used to directly pass raw key events.
     // Arrow keys
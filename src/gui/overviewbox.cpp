@@ -17,15 +17,14 @@
  */
 
 #include "overviewbox.h"
+#include "../pdf/renderpool.h"
 
 OverviewBox::OverviewBox(QWidget *parent) :
     QScrollArea(parent),
-    layout(new QGridLayout(this)),
     client(new QWidget(this))
 {
-    setWidgetResizable(true);
     setWidget(client);
-    client->setLayout(layout);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &OverviewBox::updateVisible);
     //setShortcutEnabled(false); // TODO: check what this does
     // TODO: handle keyboard shortcuts
 }
@@ -34,49 +33,193 @@ OverviewBox::~OverviewBox()
 {
     qDeleteAll(frames);
     frames.clear();
+    qDeleteAll(spareFrames);
+    spareFrames.clear();
 }
 
-void OverviewBox::create(PdfDoc const* doc, PagePart const pagePart)
+void OverviewBox::create(PdfDoc const* doc, PagePart const pagePart, CacheMap const* source)
 {
-    qDeleteAll(frames);
-    frames.clear();
-    // TODO: get the real width of the scroll area (instead of width()-16).
-    client->setFixedWidth(width() - 16);
-    QList<Poppler::Page*> const pages = *doc->getPages();
-    double const frameWidth = double(client->width() - 2*columns - 2)/columns;
-    int i=0;
-    double resolution;
-    for (QList<Poppler::Page*>::const_iterator page_it=pages.cbegin(); page_it!=pages.cend(); page_it++, i++) {
-        OverviewFrame* frame = new OverviewFrame(i, this);
-        frames.append(frame);
-        resolution = 72*frameWidth / (*page_it)->pageSize().width();
-        layout->addWidget(frame, i/columns, i%columns);
-        QPixmap pixmap;
-        if (pagePart == FullPage)
-            pixmap = QPixmap::fromImage((*page_it)->renderToImage(resolution, resolution));
-        else {
-            QImage image = (*page_it)->renderToImage(2*resolution, 2*resolution);
-            if (pagePart == LeftHalf)
-                pixmap = QPixmap::fromImage(image.copy(0, 0, image.width()/2, image.height()));
-            else
-                pixmap = QPixmap::fromImage(image.copy(image.width()/2, 0, image.width()/2, image.height()));
+    // Thumbnails are kept as long as the document and page part do not change.
+    if (thumbnails == nullptr || thumbnails->getDoc() != doc || thumbnails->getPagePart() != pagePart) {
+        delete thumbnails;
+        thumbnails = new CacheMap(doc, pagePart, this);
+        // Frames store the decoded pixmaps. PNG keeps the compressed
+        // thumbnails of large documents small and is fast for small images.
+        thumbnails->setHotPages(-1);
+        thumbnails->setCodec(PngCodec);
+        thumbnails->setDownscaleSource(source);
+        thumbnails->setObjectName("overview");
+        connect(thumbnails, &CacheMap::pageCached, this, &OverviewBox::receiveThumbnail);
+        outdated = true;
+    }
+    // Changed pages are rendered again.
+    thumbnails->clearPages(outdatedPages);
+
+    if (outdated || doc->numPages() != numPages) {
+        numPages = doc->numPages();
+        // TODO: get the real width of the scroll area (instead of width()-16).
+        int const clientWidth = width() - 16;
+        cellWidth = clientWidth / columns;
+        // All thumbnails are rendered with the resolution of the first page.
+        QSizeF pageSize = doc->getPageSize(0);
+        if (pagePart != FullPage)
+            pageSize.rwidth() /= 2;
+        // This clears the cached thumbnails only if their size changes.
+        thumbnails->changeResolution((cellWidth - spacing) / pageSize.width());
+        placeholder = QPixmap((thumbnails->getResolution()*pageSize).toSize());
+        placeholder.fill(Qt::lightGray);
+        rowHeight = placeholder.height() + spacing;
+        client->setFixedSize(clientWidth, ((numPages + columns - 1) / columns) * rowHeight);
+        // Recycle all frames.
+        for (OverviewFrame* frame : frames) {
+            frame->hide();
+            spareFrames.append(frame);
         }
-        frame->setPixmap(pixmap);
-        connect(frame, &OverviewFrame::activated, this, &OverviewBox::sendPageNumber);
-        connect(frame, &OverviewFrame::activated, this, &OverviewBox::setFocused);
+        frames.clear();
+        if (focused >= numPages)
+            focused = 0;
     }
+    else {
+        for (int const page : outdatedPages) {
+            if (frames.contains(page))
+                frames[page]->setPixmap(placeholder);
+        }
+    }
+    outdatedPages.clear();
     outdated = false;
+    // Request thumbnails again: pages may have been cleared.
+    requestedRows = {-1, -1};
     show();
+    updateVisible();
+}
+
+QPair<int, int> OverviewBox::visibleRows(int const extra) const
+{
+    int const top = verticalScrollBar()->value();
+    int const lastRow = (numPages - 1) / columns;
+    return {
+        std::max(0, top / rowHeight - extra),
+        std::min(lastRow, (top + viewport()->height()) / rowHeight + extra)
+    };
+}
+
+void OverviewBox::updateVisible()
+{
+    if (thumbnails == nullptr || numPages == 0)
+        return;
+    QPair<int, int> const rows = visibleRows(marginRows);
+    int const first = rows.first * columns, last = std::min(numPages - 1, (rows.second + 1) * columns - 1);
+    // Recycle frames outside the visible region.
+    for (QMap<int, OverviewFrame*>::iterator it=frames.begin(); it!=frames.end();) {
+        if (it.key() < first || it.key() > last) {
+            (*it)->hide();
+            // Release the pixmap.
+            (*it)->clear();
+            spareFrames.append(*it);
+            it = frames.erase(it);
+        }
+        else
+            it++;
+    }
+    // Materialize frames in the visible region.
+    for (int page=first; page<=last; page++) {
+        if (frames.contains(page))
+            continue;
+        OverviewFrame* frame;
+        if (spareFrames.isEmpty()) {
+            frame = new OverviewFrame(page, client);
+            connect(frame, &OverviewFrame::activated, this, &OverviewBox::sendPageNumber);
+            connect(frame, &OverviewFrame::activated, this, &OverviewBox::setFocused);
+        }
+        else {
+            frame = spareFrames.takeLast();
+            frame->setPage(page);
+        }
+        frame->setGeometry((page % columns) * cellWidth, (page / columns) * rowHeight, cellWidth, rowHeight);
+        fillFrame(frame);
+        if (page == focused)
+            frame->activate();
+        else
+            frame->deactivate();
+        frame->show();
+        frames[page] = frame;
+    }
+    requestThumbnails();
+}
+
+void OverviewBox::fillFrame(OverviewFrame* frame)
+{
+    QPixmap const pixmap = thumbnails->getCachedPixmap(frame->getPage());
+    frame->setPixmap(pixmap.isNull() ? placeholder : pixmap);
+}
+
+void OverviewBox::requestThumbnails()
+{
+    QPair<int, int> const rows = visibleRows(prefetchRows);
+    if (rows != requestedRows) {
+        requestedRows = rows;
+        QPair<int, int> const keep = visibleRows(keepRows);
+        QSet<int> far;
+        for (int page=0; page<numPages; page++) {
+            // Skip the pages which are kept.
+            if (page == keep.first * columns)
+                page = (keep.second + 1) * columns;
+            if (page < numPages && thumbnails->contains(page))
+                far.insert(page);
+        }
+        thumbnails->clearPages(far);
+        int const last = std::min(numPages - 1, (rows.second + 1) * columns - 1);
+        for (int page=rows.first*columns; page<=last; page++)
+            thumbnails->updateCache(page, -abs(page - focused));
+    }
+    prioritizeVisible();
+}
+
+bool OverviewBox::isFar(int const page) const
+{
+    QPair<int, int> const rows = visibleRows(keepRows);
+    return page < rows.first * columns || page >= (rows.second + 1) * columns;
+}
+
+void OverviewBox::prioritizeVisible()
+{
+    if (thumbnails == nullptr || numPages == 0 || !isVisible())
+        return;
+    QPair<int, int> const rows = visibleRows(1);
+    int const last = std::min(numPages - 1, (rows.second + 1) * columns - 1);
+    for (int page=rows.first*columns; page<=last; page++) {
+        if (thumbnails->contains(page))
+            continue;
+        if (thumbnails->isPending(page))
+            RenderPool::instance()->prioritize(thumbnails, page, visiblePriority);
+        else
+            thumbnails->updateCache(page, visiblePriority);
+    }
+}
+
+void OverviewBox::receiveThumbnail(int const page)
+{
+    // The overview may have been scrolled away while the thumbnail was rendered.
+    if (isFar(page))
+        thumbnails->clearPages({page});
+    else if (frames.contains(page))
+        fillFrame(frames[page]);
 }
 
 void OverviewBox::setFocused(int page)
 {
+    if (numPages == 0)
+        return;
     if (page < 0)
         page = 0;
-    else if (page >= frames.length())
-        page = frames.length()-1;
-    frames[focused]->deactivate();
+    else if (page >= numPages)
+        page = numPages-1;
+    if (frames.contains(focused))
+        frames[focused]->deactivate();
     focused = page;
-    frames[focused]->activate();
-    ensureWidgetVisible(frames[focused]);
+    // Scroll to the focused page. This materializes its frame.
+    ensureVisible((page % columns) * cellWidth + cellWidth/2, (page / columns) * rowHeight + rowHeight/2, cellWidth/2, rowHeight/2);
+    updateVisible();
+    if (frames.contains(focused))
+        frames[focused]->activate();
 }
@@ -21,22 +21,66 @@
 
 #include <QtDebug>
 #include <QScrollArea>
-#include <QGridLayout>
+#include <QScrollBar>
 #include "overviewframe.h"
 #include "../pdf/pdfdoc.h"
+#include "../pdf/cachemap.h"
 #include "../enumerates.h"
 
+/// Overview of all slides as thumbnails.
+/// The overview is shown immediately with placeholder frames. Thumbnails of
+/// the visible rows and some rows around them are rendered in the RenderPool,
+/// starting with the visible pages. They are kept (compressed) in a CacheMap
+/// which survives updates of the layout. Thumbnails far away from the visible
+/// rows are removed, such that the cache stays small for large documents.
+/// Only the visible rows plus a margin are materialized as OverviewFrames.
+/// Frames which leave this region are recycled for other pages.
 class OverviewBox : public QScrollArea
 {
     Q_OBJECT
 
 private:
-    QGridLayout* layout;
-    QList<OverviewFrame*> frames;
+    /// Frames of the materialized pages.
+    QMap<int, OverviewFrame*> frames;
+    /// Hidden frames, which can be reused.
+    QList<OverviewFrame*> spareFrames;
     QWidget* client;
     bool outdated = true;
+    /// Pages which need to be rendered again when the overview is shown.
+    QSet<int> outdatedPages;
     quint8 columns = 5;
     int focused = 0;
+    /// Number of pages in the overview.
+    int numPages = 0;
+    /// Width of a column in pixels.
+    int cellWidth = 1;
+    /// Height of a row in pixels.
+    int rowHeight = 1;
+    /// Number of rows above and below the visible rows which are materialized.
+    static constexpr int marginRows = 2;
+    /// Number of rows above and below the visible rows for which thumbnails are rendered.
+    static constexpr int prefetchRows = 8;
+    /// Thumbnails of pages more than this number of rows away from the visible rows are removed.
+    static constexpr int keepRows = 32;
+    /// Rows for which thumbnails were last requested.
+    QPair<int, int> requestedRows {-1, -1};
+    /// Space between thumbnails in pixels.
+    static constexpr int spacing = 2;
+    /// Cached thumbnails. This is created in create().
+    CacheMap* thumbnails = nullptr;
+    /// Shown in frames until the thumbnail is rendered.
+    QPixmap placeholder;
+    /// Render priority of visible thumbnails. Pages of the presentation are rendered first.
+    static constexpr int visiblePriority = 1 << 19;
+    /// Render thumbnails of the visible rows and prefetchRows around them, and
+    /// remove thumbnails outside keepRows. Pages close to the focused page are rendered first.
+    void requestThumbnails();
+    /// Is page more than keepRows away from the visible rows?
+    bool isFar(int const page) const;
+    /// First and last visible row, extended by extra rows.
+    QPair<int, int> visibleRows(int const extra) const;
+    /// Show the thumbnail or the placeholder in frame.
+    void fillFrame(OverviewFrame* frame);
 
 protected:
     void keyPressEvent(QKeyEvent* event) override {event->setAccepted(false);}
@@ -44,10 +88,19 @@ protected:
 public:
     explicit OverviewBox(QWidget* parent = nullptr);
     ~OverviewBox();
-    void create(PdfDoc const* doc, PagePart const pagePart = PagePart::FullPage);
+    /// Create the grid for all pages or update outdated frames. Thumbnails are rendered in the background.
+    /// Thumbnails of pages which are cached in source are derived from source instead of being rendered.
+    void create(PdfDoc const* doc, PagePart const pagePart = PagePart::FullPage, CacheMap const* source = nullptr);
     void setColumns(quint8 const cols) {columns = cols;}
-    bool needsUpdate() const {return outdated;}
+    bool needsUpdate() const {return outdated || !outdatedPages.isEmpty();}
+    /// Create the grid again when the overview is shown. Cached thumbnails are kept if their size does not change.
     void setOutdated() {outdated=true;}
+    /// Render thumbnails of pages again when the overview is shown.
+    void setOutdated(QSet<int> const& pages) {outdatedPages += pages;}
+    /// Cancel rendering thumbnails, e.g. before the document is reloaded.
+    void cancelRendering() {if (thumbnails != nullptr) thumbnails->cancelJobs();}
+    /// Cached thumbnails, nullptr before create() was called.
+    CacheMap* getThumbnails() const {return thumbnails;}
     void setFocused(int const page);
     void moveFocusDown() {setFocused(focused+columns);}
     void moveFocusUp() {setFocused(focused-columns);}
@@ -55,6 +108,14 @@ public:
     void moveFocusRight() {setFocused(focused+1);}
     int getPage() const {return focused;}
 
+private slots:
+    /// Materialize frames for the visible rows and recycle all other frames.
+    void updateVisible();
+    /// Render visible thumbnails before all others.
+    void prioritizeVisible();
+    /// Show a thumbnail which was rendered in the background.
+    void receiveThumbnail(int const page);
+
 signals:
     void sendPageNumber(int const page);
     void sendReturn();
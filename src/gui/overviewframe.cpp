@@ -29,6 +29,15 @@ OverviewFrame::OverviewFrame(int const page, QWidget* parent) :
 #endif
 }
 
+void OverviewFrame::setPage(int const newPage)
+{
+    page = newPage;
+#ifdef DISABLE_TOOL_TIP
+#else
+    setToolTip("page " + QString::number(page));
+#endif
+}
+
 void OverviewFrame::mousePressEvent(QMouseEvent* event)
 {
     emit activated(page);
@@ -37,6 +37,9 @@ protected:
 
 public:
     OverviewFrame(int const page, QWidget* parent = nullptr);
+    /// Reuse this frame for a different page.
+    void setPage(int const newPage);
+    int getPage() const {return page;}
     void activate();
     void deactivate();
 
@@ -23,8 +23,16 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QMimeDatabase>
+#include <QXmlStreamReader>
+#include <QTimer>
 #include "screens/controlscreen.h"
+#include "pdf/diskcache.h"
+#include "draw/zlibdevice.h"
+#include "draw/annotationfile.h"
 #include "names.h"
+#ifdef ENABLE_BENCHMARKS
+#include "benchmark.h"
+#endif
 
 
 /// Read real value from string (handling % sign correctly).
@@ -476,6 +484,7 @@ int main(int argc, char *argv[])
 #endif
         {{"b", "blinds"}, "Number of blinds in binds slide transition", "int"},
         {{"c", "cache"}, "Number of slides that will be cached. A negative number is treated as infinity.", "int"},
+        {{"C", "cache-mode"}, "Format of cached slides: \"lz\" (default, fast compression), \"raw\" (fastest, uses more memory) or \"png\" (smallest, but slow).", "mode"},
         {{"d", "no-transitions"}, "Disable slide transitions."},
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
         {{"e", "embed"}, "file1,file2,... Mark these files for embedding if an execution link points to them.", "files"},
@@ -507,9 +516,22 @@ int main(int argc, char *argv[])
         {"mute-presentation", "Mute presentation (default: false)", "bool"},
         {"mute-notes", "Mute notes (default: true)", "bool"},
         {"eraser-size", "Radius of eraser.", "pixels"},
+        {"stroke-tolerance", "Input samples of drawn strokes which deviate less than <pixels> from the stroke are not stored. 0 stores all samples. Default: 0.5", "pixels"},
+        {"stroke-smoothing", "Smoothing of drawn strokes, between 0 (no smoothing) and 1. Default: 0", "float"},
+        {"cache-weights", "Weights of the caches in the memory budget, e.g. \"presentation=8,notes=4,previews=1,draw=2\". Pages are freed from caches with small weights first.", "list"},
+        {"disk-cache", "Keep rendered slides on disk, such that they are available immediately when the same PDF file is opened again (default: false)", "bool"},
+        {"disk-cache-size", "Maximum size of the disk cache in MiB. The least recently used slides are removed first. 0 disables the limit. Default: 1024", "int"},
+        {"hot-pages", "Number of slides before and after the current slide, which are kept decoded in memory (ready to be shown). A negative number disables this.", "int"},
+        {"hot-memory", "Maximum memory in MiB used by the decoded slides of each cache. A negative number means unlimited. Default: 64", "int"},
+        {"tile-size", "Render slides larger than <int> x <int> pixels as tiles in parallel. 0 disables tiles.", "int"},
+        {"render-threads", "Number of threads used for rendering slides to cache. Default: number of CPU cores.", "int"},
+        {"renderer-workers", "Number of persistent processes of the external renderer per document. 0 starts a new process for each page. Default: 0", "int"},
         {"icon-path", "Set path for default icons, e.g. /usr/share/icons/default", "path"},
         {"presentation", "Presentation PDF file (usually first positional argument)", "path"},
         {"notes", "Notes PDF file (usually second positional argument)", "path"},
+#ifdef ENABLE_BENCHMARKS
+        {"benchmark", "Run a benchmark on the presentation file and exit. Available benchmarks: codecs, derived-caches, stroke-index, stroke-decimation, stroke-storage, annotation-files, annotation-container", "name"},
+#endif
     });
     parser.process(app);
 
@@ -692,74 +714,87 @@ int main(int argc, char *argv[])
                     file.open(QIODevice::ReadOnly);
                 }
 
-                // Only remaining possibilitys file cannot be interpreted or is a BeamerPresenter drawing (XML, compressed XML, or legacy binary format) or an Xournal(++) file.
+                // Only remaining possibilitys file cannot be interpreted or is a BeamerPresenter drawing (XML, compressed XML, binary annotation file or legacy binary format) or an Xournal(++) file.
                 // Set the drawings file as a drawings file in local configuration.
                 // Later this option in local will be used to load the drawings saved in the drawings file.
                 local["drawings"] = *argument;
                 // Try to extract file names from this file if necessary (i.e. if file names are no known yet).
                 if (presentation.isEmpty() || notes.isEmpty()) {
-                    // Try to read file as BeamerPresenter drawing or Xournal(++) file (XML, compressed XML or legacy binary format).
-                    // Try to open the file as (compressed) XML document.
-                    QDomDocument doc("BeamerPresenter");
-                    // Try to open file as XML file.
-                    if (!doc.setContent(&file)) {
-                        // Failed: reopen file.
-                        file.close();
-                        file.open(QIODevice::ReadOnly);
-                        // Try to open file as compressed XML file.
-                        if (!doc.setContent(qUncompress(file.readAll())))
-                            doc.clear();
-                    }
-                    if (doc.isNull()) {
-                        // Deprecated
-                        // Try to read deprecated binary file format.
-                        // Read the file in a QDataStream.
-                        file.close();
-                        file.open(QIODevice::ReadOnly);
-                        QDataStream stream(&file);
-                        stream.setVersion(QDataStream::Qt_5_0);
-                        // Read "magic bytes" from the stream and compare.
-                        quint32 magic;
-                        stream >> magic;
-                        // Check for errors and whether the magic bytes match the ones defined for BeamerPresenter binaries.
-                        if (stream.status() == QDataStream::Ok && magic == 0x2CA7D9F8) {
-                            // Read QDataStream version from stream.
-                            quint16 version;
-                            stream >> version;
-                            // Overwrite QDataStream version with the version read from the stream.
-                            stream.setVersion(version);
-                            // Read file paths for presentation and notes.
-                            stream >> presentation >> notes;
-                            // Check for errors.
-                            if (stream.status() != QDataStream::Ok) {
-                                file.close();
-                                qCritical() << "Failed to open drawings file" << *argument << ". File is corrupt";
-                                throw -1;
+                    // Try to read file as BeamerPresenter drawing or Xournal(++) file (XML, compressed XML, binary annotation file or legacy binary format).
+                    // Try to open the file as (compressed) XML document. Only the first elements are read.
+                    ZlibDevice device(&file);
+                    device.open(QIODevice::ReadOnly);
+                    QXmlStreamReader reader(&device);
+                    if (!reader.readNextStartElement()) {
+                        device.close();
+                        AnnotationFile annotations(*argument);
+                        if (annotations.open()) {
+                            // Binary annotation file: file names are given in the metadata.
+                            if (presentation.isEmpty())
+                                presentation = annotations.getMetadata().value("presentation").toObject().value("file").toString();
+                            if (notes.isEmpty())
+                                notes = annotations.getMetadata().value("notes").toObject().value("file").toString();
+                        }
+                        else {
+                            // Deprecated
+                            // Try to read deprecated binary file format.
+                            // Read the file in a QDataStream.
+                            file.close();
+                            file.open(QIODevice::ReadOnly);
+                            QDataStream stream(&file);
+                            stream.setVersion(QDataStream::Qt_5_0);
+                            // Read "magic bytes" from the stream and compare.
+                            quint32 magic;
+                            stream >> magic;
+                            // Check for errors and whether the magic bytes match the ones defined for BeamerPresenter binaries.
+                            if (stream.status() == QDataStream::Ok && magic == 0x2CA7D9F8) {
+                                // Read QDataStream version from stream.
+                                quint16 version;
+                                stream >> version;
+                                // Overwrite QDataStream version with the version read from the stream.
+                                stream.setVersion(version);
+                                // Read file paths for presentation and notes.
+                                stream >> presentation >> notes;
+                                // Check for errors.
+                                if (stream.status() != QDataStream::Ok) {
+                                    file.close();
+                                    qCritical() << "Failed to open drawings file" << *argument << ". File is corrupt";
+                                    throw -1;
+                                }
                             }
                         }
                     }
                     else {
-                        QDomElement const root = doc.documentElement();
-                        if (root.attribute("creator").contains("beamerpresenter", Qt::CaseInsensitive)) {
-                            // Try to get file names.
-                            if (presentation.isEmpty())
-                                presentation = root.firstChildElement("presentation").attribute("file");
-                            if (notes.isEmpty())
-                                notes = root.firstChildElement("notes").attribute("file");
+                        QString const creator = reader.attributes().value("creator").toString();
+                        if (creator.contains("beamerpresenter", Qt::CaseInsensitive)) {
+                            // Try to get file names. These are given before the pages.
+                            while (reader.readNextStartElement() && reader.name() != "page") {
+                                if (reader.name() == "presentation" && presentation.isEmpty())
+                                    presentation = reader.attributes().value("file").toString();
+                                else if (reader.name() == "notes" && notes.isEmpty())
+                                    notes = reader.attributes().value("file").toString();
+                                reader.skipCurrentElement();
+                            }
                         }
-                        else if (root.attribute("creator").contains("xournal", Qt::CaseInsensitive)) {
-                            // Try to get a file name.
-                            if (presentation.isEmpty()) {
-                                QDomElement const first_page = root.firstChildElement("page");
-                                QDomElement const first_bg = first_page.firstChildElement("background");
-                                presentation = first_bg.attribute("filename");
+                        else if (creator.contains("xournal", Qt::CaseInsensitive)) {
+                            // Try to get a file name from the background of the first page.
+                            while (presentation.isEmpty() && reader.readNextStartElement()) {
+                                if (reader.name() != "page") {
+                                    reader.skipCurrentElement();
+                                    continue;
+                                }
+                                while (reader.readNextStartElement() && reader.name() != "background")
+                                    reader.skipCurrentElement();
+                                presentation = reader.attributes().value("filename").toString();
+                                break;
                             }
                         }
                         else {
-                            qCritical() << "Failed to understand file: Unknown creator" << root.attribute("creator");
+                            qCritical() << "Failed to understand file: Unknown creator" << creator;
                             file.close();
                             throw 4;
                         }
+                        device.close();
                         file.close();
                     }
                 }
@@ -776,7 +811,19 @@ int main(int argc, char *argv[])
         qCritical() << "Presentation PDF file does not exist:" << presentation;
         return 1;
     }
+#ifdef ENABLE_BENCHMARKS
+    if (parser.isSet("benchmark")) {
+        PdfDoc doc(presentation);
+        if (!doc.loadDocument())
+            return 1;
+        return runBenchmark(parser.value("benchmark"), &doc);
+    }
+#endif
+
 
+    // The disk cache needs to be enabled before documents are loaded.
+    DiskCache::setEnabled(boolFromConfig(parser, local, settings, "disk-cache", false));
+    DiskCache::setMaxSize(1048576L * intFromConfig<int>(parser, local, settings, "disk-cache-size", 1024));
 
     /// ControlScreen widget managing everything.
     ControlScreen* ctrlScreen;
@@ -1248,6 +1295,10 @@ int main(int argc, char *argv[])
         // Set radius of eraser tool.
         value  = qrealFromConfig(parser, local, settings, "eraser-size", 10, 1e5);
         ctrlScreen->getPresentationSlide()->getPathOverlay()->setEraserSize(value);
+
+        // Set input filter for drawn strokes.
+        value = qrealFromConfig(parser, local, settings, "stroke-tolerance", 0.5, 100.);
+        DrawPath::setInputFilter(value, qrealFromConfig(parser, local, settings, "stroke-smoothing", 0., 0.99));
     }
 
     // Settings with integer values
@@ -1265,6 +1316,46 @@ int main(int argc, char *argv[])
         value = intFromConfig<quint32>(parser, local, settings, "memory", 200);
         ctrlScreen->setCacheSize(1048576L * value);
     }
+
+    // Set the format in which slides are stored in cache.
+    {
+        QString mode;
+        if (parser.isSet("C"))
+            mode = parser.value("C").toLower();
+        else if (local.contains("cache-mode"))
+            mode = local.value("cache-mode").toString().toLower();
+        else if (settings.contains("cache-mode"))
+            mode = settings.value("cache-mode").toString().toLower();
+        if (cacheCodecMap.contains(mode))
+            ctrlScreen->setCacheCodec(cacheCodecMap[mode]);
+        else if (!mode.isEmpty())
+            qCritical() << "option \"" << mode << "\" to cache-mode not understood.";
+    }
+
+    // Set the weights of the caches in the memory budget.
+    {
+        QString list;
+        if (parser.isSet("cache-weights"))
+            list = parser.value("cache-weights");
+        else if (local.contains("cache-weights"))
+            list = local.value("cache-weights").toStringList().join(",");
+        else if (settings.contains("cache-weights"))
+            // Settings interpret a comma separated list as string list.
+            list = settings.value("cache-weights").toStringList().join(",");
+        if (!list.isEmpty()) {
+            QMap<QString, qreal> weights;
+            for (QString const& entry : list.split(",", QString::SkipEmptyParts)) {
+                QStringList const pair = entry.split("=");
+                bool ok = false;
+                qreal const weight = pair.length() == 2 ? pair[1].trimmed().toDouble(&ok) : 0.;
+                if (ok)
+                    weights[pair[0].trimmed().toLower()] = weight;
+                else
+                    qCritical() << "option \"" << entry << "\" to cache-weights not understood.";
+            }
+            ctrlScreen->setCacheWeights(weights);
+        }
+    }
     {
         quint8 value;
 
@@ -1299,6 +1390,28 @@ int main(int argc, char *argv[])
         // This restricts only the number of slides which are pre-rendered to cache, not the actual amount of memory used.
         value = intFromConfig<int>(parser, local, settings, "cache", -1);
         ctrlScreen->setCacheNumber(value);
+
+        // Set number of pages before and after the current page which are kept decoded.
+        // Each of these costs 4 bytes per pixel in every cache.
+        value = intFromConfig<int>(parser, local, settings, "hot-pages", 1);
+        ctrlScreen->setHotPages(value);
+        // Fewer pages are kept decoded if they are large.
+        value = intFromConfig<int>(parser, local, settings, "hot-memory", 64);
+        ctrlScreen->setHotMemory(value < 0 ? -1 : 1048576L * value);
+
+        // Set size of tiles. Large slides (e.g. on 8K displays) are rendered as tiles in parallel.
+        value = intFromConfig<int>(parser, local, settings, "tile-size", 0);
+        ctrlScreen->setTileSize(value);
+
+        // Set number of threads used for rendering slides to cache.
+        // A number < 1 selects the number of CPU cores.
+        value = intFromConfig<int>(parser, local, settings, "render-threads", 0);
+        ctrlScreen->setRenderThreads(value);
+
+        // Set number of persistent external renderer processes.
+        // This must be set before the renderer, because it changes the required arguments of the renderer command.
+        value = intFromConfig<int>(parser, local, settings, "renderer-workers", 0);
+        ctrlScreen->setRendererWorkers(value);
     }
     {
         quint16 value;
@@ -1496,6 +1609,9 @@ int main(int argc, char *argv[])
     emit ctrlScreen->sendNewPageNumber(0, false);
     // Render the first page on control screen.
     ctrlScreen->renderPage(0);
+    // Fingerprints of the pages are calculated in the background after the
+    // first page has been shown, such that they do not delay the first render.
+    QTimer::singleShot(0, ctrlScreen, &ControlScreen::fingerprintDocuments);
 
     // Load drawings if a BeamerPresenter drawings file is given.
     // The drawings file can be handed to BeamerPresenter as single positional argument, but is then internally written to the local configuration.
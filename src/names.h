@@ -132,6 +132,7 @@ static const QMap<KeyAction, QString> actionNames = {
     {SaveDrawingsLegacy, "save legacy"},
     {SaveDrawingsUncompressed, "save uncompressed"},
     {SaveDrawingsXournal, "save xournal"},
+    {SaveDrawingsBinary, "save binary"},
 };
 
 /// Map KeyActions to icon names.
@@ -269,6 +270,7 @@ static const QMap<QString, KeyAction> keyActionMap {
     {"load drawings", KeyAction::LoadDrawings},
     {"save drawings legacy", KeyAction::SaveDrawingsLegacy},
     {"save drawings uncompressed", KeyAction::SaveDrawingsUncompressed},
+    {"save drawings binary", KeyAction::SaveDrawingsBinary},
     {"save", KeyAction::SaveDrawings},
     {"save xournal", KeyAction::SaveDrawingsXournal},
     {"save xournal++", KeyAction::SaveDrawingsXournal},
@@ -276,6 +278,7 @@ static const QMap<QString, KeyAction> keyActionMap {
     {"load", KeyAction::LoadDrawings},
     {"save legacy", KeyAction::SaveDrawingsLegacy},
     {"save uncompressed", KeyAction::SaveDrawingsUncompressed},
+    {"save binary", KeyAction::SaveDrawingsBinary},
 };
 
 /// Map tool strings from configuration file to DrawTool (enum).
@@ -290,6 +293,14 @@ static const QMap<QString, DrawTool> toolMap {
     {"magnifier", DrawTool::Magnifier},
 };
 
+/// Map cache mode strings from configuration file to CacheCodec (enum).
+static const QMap<QString, CacheCodec> cacheCodecMap {
+    {"png", CacheCodec::PngCodec},
+    {"raw", CacheCodec::RawCodec},
+    {"lz", CacheCodec::LzCodec},
+    {"lz4", CacheCodec::LzCodec},
+};
+
 /// Default mapping of keys to KeyAction actions.
 /// This is used if the configuration file does not define any key mapping.
 static const QMap<quint32, QList<KeyAction>> defaultKeyMap = {
@@ -17,27 +17,98 @@
  */
 
 #include "basicrenderer.h"
+#include "renderpool.h"
 
 BasicRenderer::BasicRenderer(PdfDoc const* doc, PagePart const part, QObject* parent)
     : QObject(parent),
       pdf(doc),
-      pagePart(part),
-      cacheThread(new CacheThread(this, this))
+      pagePart(part)
 {
-    connect(cacheThread, &CacheThread::finished, this, &BasicRenderer::receiveBytes);
 }
 
-QPixmap const BasicRenderer::renderPixmap(int const page) const
+BasicRenderer::~BasicRenderer()
 {
-    // This should only be called from within CacheThread, BasicRenderer and CacheMap!
-    Poppler::Page const* cachePage = pdf->getPage(page);
+    RenderPool::instance()->cancel(this);
+}
+
+QImage const BasicRenderer::renderImage(PdfDoc const* pdf, int const page, qreal const resolution, PagePart const part)
+{
+    // This is called from render jobs in the RenderPool and from CacheMap.
+    QSharedPointer<Poppler::Page const> const cachePage = pdf->getPage(page);
     QImage image = cachePage->renderToImage(72*resolution, 72*resolution);
-    if (pagePart == FullPage)
-        return QPixmap::fromImage(image);
-    else if (pagePart == LeftHalf)
-        return QPixmap::fromImage(image.copy(0, 0, image.width()/2, image.height()));
+    if (part == FullPage)
+        return image;
+    else if (part == LeftHalf)
+        return image.copy(0, 0, image.width()/2, image.height());
     else
-        return QPixmap::fromImage(image.copy(image.width()/2, 0, image.width()/2, image.height()));
+        return image.copy(image.width()/2, 0, image.width()/2, image.height());
+}
+
+QImage const BasicRenderer::renderTile(PdfDoc const* pdf, int const page, qreal const resolution, PagePart const part, QRect const& tile)
+{
+    QSharedPointer<Poppler::Page const> const cachePage = pdf->getPage(page);
+    int x = tile.x();
+    if (part == RightHalf)
+        x += qRound(resolution*cachePage->pageSizeF().width())/2;
+    return cachePage->renderToImage(72*resolution, 72*resolution, x, tile.y(), tile.width(), tile.height());
+}
+
+QByteArray const* BasicRenderer::processExternalImage(QByteArray const* png, PagePart const part, CacheCodec const codec)
+{
+    if (png == nullptr || (part == FullPage && codec == PngCodec))
+        return png;
+    QImage image = ImageCodec::decode(*png);
+    delete png;
+    if (part == LeftHalf)
+        image = image.copy(0, 0, image.width()/2, image.height());
+    else if (part == RightHalf)
+        image = image.copy(image.width()/2, 0, image.width()/2, image.height());
+    return ImageCodec::encode(image, codec);
+}
+
+void BasicRenderer::changeResolution(double const res)
+{
+    if (res == resolution)
+        return;
+    cancelJobs();
+    resolution = res;
+}
+
+void BasicRenderer::cancelJobs()
+{
+    RenderPool::instance()->cancel(this);
+    pending.clear();
+}
+
+void BasicRenderer::submitJob(int const page, int const priority, bool const keepImage)
+{
+    if (pending.contains(page))
+        return;
+    pending.insert(page);
+    RenderPool::instance()->submit(this, page, priority, keepImage);
+}
+
+void BasicRenderer::receiveJob(RenderJob* job)
+{
+    if (job->isDecodeJob()) {
+        receiveImage(job->page, job->resolution == resolution ? job->getImage() : QImage());
+        return;
+    }
+    if (job->isTileJob()) {
+        // Tiles of an old resolution are dropped. Only the last tile of a page finishes the job.
+        bool const valid = job->resolution == resolution;
+        if (receiveTile(job->page, job->tile, valid ? job->takeBytes() : nullptr, valid ? job->getImage() : QImage()))
+            emit jobFinished();
+        return;
+    }
+    pending.remove(job->page);
+    // Results for an old resolution are dropped.
+    if (job->resolution == resolution) {
+        receiveBytes(job->page, job->takeBytes());
+        if (!job->getImage().isNull())
+            receiveImage(job->page, job->getImage());
+    }
+    emit jobFinished();
 }
 
 QString const BasicRenderer::getRenderCommand(int const page) const
@@ -46,11 +117,28 @@ QString const BasicRenderer::getRenderCommand(int const page) const
         return renderCommand;
     QString command = renderCommand;
     command.replace("%file", pdf->getPath());
+    // Persistent renderers receive page and size with each request.
+    if (RenderPool::instance()->getRendererWorkers() > 0)
+        return command;
+    QSize const size = getRenderSize(page);
     command.replace("%page", QString::number(page+1));
-    if (pagePart==FullPage)
-        command.replace("%width", QString::number(int(resolution*pdf->getPageSize(page).width()+0.5)));
-    else
-        command.replace("%width", QString::number(int(2*resolution*pdf->getPageSize(page).width()+0.5)));
-    command.replace("%height", QString::number(int(resolution*pdf->getPageSize(page).height()+0.5)));
+    command.replace("%width", QString::number(size.width()));
+    command.replace("%height", QString::number(size.height()));
     return command;
 }
+
+QSize const BasicRenderer::getRenderSize(int const page) const
+{
+    QSizeF const size = resolution*pdf->getPageSize(page);
+    // External renderers always render the full page.
+    if (pagePart==FullPage)
+        return QSize(int(size.width()+0.5), int(size.height()+0.5));
+    return QSize(int(2*size.width()+0.5), int(size.height()+0.5));
+}
+
+QByteArray const BasicRenderer::getDiskCacheKey(int const page) const
+{
+    if (!usesDiskCache())
+        return QByteArray();
+    return DiskCache::entryKey(pdf, page, getRenderSize(page), pagePart, codec, getRenderCommand(page));
+}
@@ -22,12 +22,16 @@
 #include <QObject>
 #include <QBuffer>
 #include <QByteArray>
+#include <QSet>
 #include "pdfdoc.h"
-#include "cachethread.h"
+#include "imagecodec.h"
+#include "diskcache.h"
 
-/// Abstract class for rendering pages using a CacheThread.
-/// Classes inheriting from BasicRenderer can be used to render slides in a different thread.
-/// These classes are SingleRenderer (rendering and storing a single page), and CacheMap (storing cached pages in a QMap).
+class RenderJob;
+
+/// Abstract class for rendering pages using the RenderPool.
+/// Classes inheriting from BasicRenderer can be used to render slides in different threads.
+/// These classes are TileRenderer (rendering tiles of a single page, used by the magnifier), and CacheMap (storing cached pages in a QMap).
 class BasicRenderer : public QObject
 {
     Q_OBJECT
@@ -35,33 +39,71 @@ class BasicRenderer : public QObject
 public:
     /// Constructor
     explicit BasicRenderer(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr);
-    /// Destructor
-    /// cacheThread must be deleted by destructors of child classes.
-    ~BasicRenderer() {};
-    /// Get cache thread.
-    CacheThread* getCacheThread() {return cacheThread;}
-    /// Render page using poppler.
-    QPixmap const renderPixmap(int const page) const;
-
-    /// Is a cache thread running?
-    bool threadRunning() const {return cacheThread->isRunning();}
+    /// Destructor: cancel all render jobs.
+    ~BasicRenderer();
+    /// Render page using poppler. This is thread safe.
+    static QImage const renderImage(PdfDoc const* pdf, int const page, qreal const resolution, PagePart const part);
+    /// Render page using poppler. This is thread safe.
+    QImage const renderImage(int const page) const {return renderImage(pdf, page, resolution, pagePart);}
+    /// Render the rectangle tile (in pixels of the image of part) of page using poppler. This is thread safe.
+    static QImage const renderTile(PdfDoc const* pdf, int const page, qreal const resolution, PagePart const part, QRect const& tile);
+    /// Render page using poppler. This should only be called from the main thread.
+    QPixmap const renderPixmap(int const page) const {return QPixmap::fromImage(renderImage(page));}
+    /// Crop an image created by the external renderer to part and encode it using codec.
+    /// Takes ownership of png and returns new data owned by the caller. This is thread safe.
+    static QByteArray const* processExternalImage(QByteArray const* png, PagePart const part, CacheCodec const codec);
+    /// Crop an image created by the external renderer to pagePart and encode it using codec.
+    QByteArray const* processExternalImage(QByteArray const* png) const {return processExternalImage(png, pagePart, codec);}
+
+    /// Are render jobs of this renderer queued or running?
+    bool jobsPending() const {return !pending.isEmpty();}
+    /// Is page queued or rendered in the RenderPool?
+    bool isPending(int const page) const {return pending.contains(page);}
+    /// Cancel all render and decode jobs of this renderer.
+    virtual void cancelJobs();
+    /// Receive the result of a render job. This is called by RenderPool.
+    void receiveJob(RenderJob* job);
     qreal getResolution() const {return resolution;}
+    PdfDoc const* getDoc() const {return pdf;}
 
     // Settings.
-    /// Change resolution.
-    virtual void changeResolution(double const res) {resolution=res;}
+    /// Change resolution. This cancels all render jobs if the resolution actually changes.
+    virtual void changeResolution(double const res);
     /// Set custom renderer. When only empty strings are given, the renderer is set to popper (internal).
     void setRenderer(QString const renderer = "") {renderCommand = renderer;}
     /// Get renderer command.
     QString const getRenderCommand(int const page) const;
+    /// Size in pixels of the full page as requested from the external renderer.
+    QSize const getRenderSize(int const page) const;
+    /// Does this renderer read and write pages in the disk cache?
+    bool usesDiskCache() const {return DiskCache::isEnabled() && resolution > 0.;}
+    /// Key of page in the disk cache. Empty if the disk cache is not used
+    /// or if the fingerprint of the page is not available.
+    QByteArray const getDiskCacheKey(int const page) const;
     /// Get page part.
     PagePart getPagePart() const {return pagePart;}
-
-public slots:
-    /// Get cached pages from cacheThread. Called when cacheThread finishes.
-    virtual void receiveBytes() = 0;
+    /// Set codec used to store rendered pages.
+    virtual void setCodec(CacheCodec const newCodec) {codec = newCodec;}
+    /// Get codec used to store rendered pages.
+    CacheCodec getCodec() const {return codec;}
+    /// Memory used by decoded pixmaps (e.g. the hot tier or the tiles of the magnifier) in bytes.
+    qint64 getDecodedBytes() const {return decodedBytes;}
+    /// Memory used by a decoded pixmap in bytes.
+    static qint64 pixmapBytes(QPixmap const& pixmap) {return qint64(pixmap.width())*pixmap.height()*pixmap.depth()/8;}
 
 protected:
+    /// Render page in the RenderPool. Nothing is done if the page is already pending.
+    /// If keepImage is true, the rendered image is handed to receiveImage.
+    void submitJob(int const page, int const priority, bool const keepImage = false);
+    /// Store the result of a render job. Takes ownership of bytes (which can be nullptr).
+    virtual void receiveBytes(int const page, QByteArray const* bytes) = 0;
+    /// Receive a decoded image from a decode job or from a render job with keepImage.
+    /// The image is null if decoding failed.
+    virtual void receiveImage(int const page, QImage const& image) {Q_UNUSED(page) Q_UNUSED(image)}
+    /// Store the result of a tile job. Takes ownership of bytes (which can be nullptr).
+    /// image is the decoded tile. Return true if all tiles of page are done.
+    virtual bool receiveTile(int const page, int const tile, QByteArray const* bytes, QImage const& image) {Q_UNUSED(page) Q_UNUSED(tile) Q_UNUSED(image) delete bytes; return true;}
+
     /// PDF document.
     PdfDoc const* const pdf;
     /// Resolution of the pixmap.
@@ -70,12 +112,22 @@ protected:
     PagePart const pagePart;
     /// Command for external renderer.
     QString renderCommand = "";
-    /// Separate thread used to render pages to compressed cache.
-    CacheThread* cacheThread;
+    /// Format in which rendered pages are stored.
+    CacheCodec codec = LzCodec;
+    /// Pages which are queued or rendered in the RenderPool.
+    QSet<int> pending;
+    /// Change the memory used by decoded pixmaps by diff bytes and emit decodedSizeChanged.
+    void addDecodedBytes(qint64 const diff) {if (diff != 0) {decodedBytes += diff; emit decodedSizeChanged(diff);}}
+
+private:
+    /// Memory used by decoded pixmaps in bytes.
+    qint64 decodedBytes = 0;
 
 signals:
-    /// Nofity that cacheThread has finished and this has received a new compressed page from cacheThread.
-    void cacheThreadFinished();
+    /// Nofity that a render job has finished and its result has been received.
+    void jobFinished();
+    /// Notify about changes in the memory used by decoded pixmaps (in bytes).
+    void decodedSizeChanged(qint64 const diff);
 
 };
 
@@ -0,0 +1,374 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "cachemanager.h"
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include "renderpool.h"
+
+CacheManager::CacheManager(PdfDoc const* doc, QObject* parent) :
+    QObject(parent),
+    doc(doc)
+{
+    // The timer calls step() whenever the main thread is idle.
+    connect(&timer, &QTimer::timeout, this, &CacheManager::step);
+}
+
+void CacheManager::addCache(CacheMap* cache, qreal const weight, bool const prefetch)
+{
+    if (cache == nullptr)
+        return;
+    for (ManagedCache const& managed : caches) {
+        if (managed.cache == cache)
+            return;
+    }
+    caches.append({cache, weight > 0. ? weight : 1., ranking.size() - 1, prefetch});
+    // Caches track their size incrementally. Only forward changes to the readout.
+    connect(cache, &CacheMap::cacheSizeChanged, this, &CacheManager::sizeChanged);
+    connect(cache, &CacheMap::decodedSizeChanged, this, &CacheManager::sizeChanged);
+    // Only jobs started by the manager are counted.
+    if (prefetch)
+        connect(cache, &CacheMap::jobFinished, this, &CacheManager::jobFinished);
+    connect(cache, &QObject::destroyed, this, &CacheManager::cacheDestroyed);
+}
+
+void CacheManager::addRenderer(BasicRenderer const* renderer)
+{
+    if (renderer == nullptr || renderers.contains(renderer))
+        return;
+    renderers.append(renderer);
+    connect(renderer, &BasicRenderer::decodedSizeChanged, this, &CacheManager::sizeChanged);
+    connect(renderer, &QObject::destroyed, this, &CacheManager::cacheDestroyed);
+}
+
+void CacheManager::removeCache(CacheMap const* cache)
+{
+    for (QList<ManagedCache>::iterator it=caches.begin(); it!=caches.end(); it++) {
+        if (it->cache == cache) {
+            disconnect(cache, nullptr, this, nullptr);
+            caches.erase(it);
+            emit budgetChanged(getSize(), maxSize);
+            return;
+        }
+    }
+}
+
+void CacheManager::cacheDestroyed(QObject* cache)
+{
+    // The cache is only compared, because it is already partially destroyed.
+    for (QList<ManagedCache>::iterator it=caches.begin(); it!=caches.end(); it++) {
+        if (it->cache == cache) {
+            caches.erase(it);
+            return;
+        }
+    }
+    for (QList<BasicRenderer const*>::iterator it=renderers.begin(); it!=renderers.end(); it++) {
+        if (*it == cache) {
+            renderers.erase(it);
+            return;
+        }
+    }
+}
+
+void CacheManager::setWeight(CacheMap const* cache, qreal const weight)
+{
+    for (ManagedCache& managed : caches) {
+        if (managed.cache == cache)
+            managed.weight = weight > 0. ? weight : 1.;
+    }
+}
+
+qint64 CacheManager::getSize() const
+{
+    qint64 size = 0;
+    for (ManagedCache const& managed : caches)
+        size += managed.cache->getSizeBytes() + managed.cache->getDecodedBytes();
+    for (BasicRenderer const* renderer : renderers)
+        size += renderer->getDecodedBytes();
+    return size;
+}
+
+QString const CacheManager::budgetReport() const
+{
+    QString report = QString("Cache: %1 MiB").arg(getSize()/1048576., 0, 'f', 1);
+    if (maxSize >= 0)
+        report += QString(" of %1 MiB").arg(maxSize/1048576., 0, 'f', 1);
+    for (ManagedCache const& managed : caches)
+        report += QString("\n%1 (weight %2): %3 pages, %4 MiB, decoded %5 MiB")
+                .arg(managed.cache->objectName().isEmpty() ? "cache" : managed.cache->objectName())
+                .arg(managed.weight)
+                .arg(managed.cache->length())
+                .arg(managed.cache->getSizeBytes()/1048576., 0, 'f', 1)
+                .arg(managed.cache->getDecodedBytes()/1048576., 0, 'f', 1);
+    for (BasicRenderer const* renderer : renderers)
+        report += QString("\n%1: decoded %2 MiB")
+                .arg(renderer->objectName().isEmpty() ? "renderer" : renderer->objectName())
+                .arg(renderer->getDecodedBytes()/1048576., 0, 'f', 1);
+    return report;
+}
+
+qreal CacheManager::cost(int const page) const
+{
+    int const distance = page - currentPage;
+    // Pages in the direction of travel are needed first.
+    qreal cost;
+    if (distance >= 0)
+        cost = (direction >= 0 ? 1. : 2.) * distance;
+    else
+        cost = (direction >= 0 ? -3. : -1.) * distance;
+    // Navigation skipping overlays reaches the neighbouring slides directly.
+    if (page == nextSlideStart)
+        cost = std::min(cost, 1.5);
+    if (page == previousSlideEnd)
+        cost = std::min(cost, 2.5);
+    // Presenters often return to where they jumped away from.
+    // Older jumps are less relevant.
+    for (int i=0; i<jumpOrigins.size(); i++) {
+        int const origin = jumpOrigins[i];
+        qreal const age = jumpOrigins.size() - i;
+        cost = std::min(cost, 2*age + (page >= origin ? 1. : 3.) * std::abs(page - origin));
+    }
+    return cost;
+}
+
+void CacheManager::setCurrentPage(int const page)
+{
+    if (page != currentPage) {
+        // Everything which does not just move to a neighbouring page or slide is a jump.
+        if (forceJump || (std::abs(page - currentPage) > 1 && page != nextSlideStart && page != previousSlideEnd)) {
+            jumpOrigins.removeAll(currentPage);
+            jumpOrigins.append(currentPage);
+            while (jumpOrigins.size() > maxJumpOrigins)
+                jumpOrigins.removeFirst();
+        }
+        else
+            direction = page > currentPage ? 1 : -1;
+        jumpOrigins.removeAll(page);
+        currentPage = page;
+    }
+    forceJump = false;
+    start();
+}
+
+void CacheManager::reset()
+{
+    timer.stop();
+    jumpOrigins.clear();
+    direction = 1;
+    forceJump = false;
+    ranking.clear();
+}
+
+void CacheManager::start()
+{
+    timer.stop();
+    if (isDisabled() || caches.isEmpty())
+        return;
+    rank();
+    timer.start();
+}
+
+void CacheManager::rank()
+{
+    int const pages = doc->getDoc()->numPages();
+    if (currentPage >= pages)
+        currentPage = pages - 1;
+    nextSlideStart = doc->getNextSlideIndex(currentPage);
+    previousSlideEnd = doc->getPreviousSlideEnd(currentPage);
+    costs.resize(pages);
+    for (int page=0; page<pages; page++)
+        costs[page] = cost(page);
+    ranking.resize(pages);
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::stable_sort(ranking.begin(), ranking.end(), [this](int const a, int const b){return costs[a] < costs[b];});
+    nextIndex = 0;
+    evictIndex = pages - 1;
+    for (ManagedCache& managed : caches)
+        managed.evictIndex = pages - 1;
+#ifdef DEBUG_CACHE
+    qDebug() << "Rank pages" << currentPage << direction << jumpOrigins << ranking.mid(0, 10);
+#endif
+}
+
+void CacheManager::invalidate(PdfDoc const* doc, QSet<int> const& pages)
+{
+    if (pages.isEmpty())
+        return;
+    for (ManagedCache const& managed : caches) {
+        if (managed.cache->getDoc() == doc)
+            managed.cache->clearPages(pages);
+    }
+}
+
+bool CacheManager::isCached(int const page) const
+{
+    for (ManagedCache const& managed : caches) {
+        // Caches which have never been shown have no resolution and cannot render pages.
+        if (managed.prefetch && managed.cache->getResolution() > 0. && !managed.cache->contains(page) && !managed.cache->isPending(page))
+            return false;
+    }
+    return true;
+}
+
+bool CacheManager::isPartlyCached(int const page) const
+{
+    for (ManagedCache const& managed : caches) {
+        if (managed.cache->contains(page))
+            return true;
+    }
+    return false;
+}
+
+bool CacheManager::hasRoom() const
+{
+    int const number = cachedNumber();
+    if (maxNumber >= 0 && number >= maxNumber)
+        return false;
+    // Assume that the next page needs as much memory as an average cached page.
+    qint64 const size = getSize();
+    return maxSize < 0 || number == 0 || size + size/number <= maxSize;
+}
+
+void CacheManager::step()
+{
+    /*
+    * Select a page for rendering to cache and tell the CacheMaps to render that page in the RenderPool.
+    * Delete cached pages if necessary due to limited memory or a limited number of cached slides.
+    *
+    * Outline of the cache management:
+    *
+    * 0. setCurrentPage sorts all pages by cost in ranking and starts timer.
+    * 1. timer calls step in a loop whenever the main thread is not busy.
+    * 2. step frees the pages with the largest cost as long as the cache is too large.
+    * 3. step selects the next page in ranking, which is not cached yet.
+    *    - If there is no such page, it stops timer.
+    *    - If the limits do not allow caching another page, it frees a page of larger cost.
+    *      If there is no such page, it stops timer.
+    *    - Otherwise it hands the page to cachePage.
+    * 4. cachePage calls CacheMap::updateCache for all caches.
+    *    This queues render jobs in the RenderPool. If enough jobs are queued to
+    *    keep all workers of the RenderPool busy, timer is stopped.
+    * 5. When a job is done, CacheMap emits jobFinished and jobFinished starts timer again.
+    */
+#ifdef DEBUG_CACHE
+    qDebug() << "Cache step" << nextIndex << evictIndex << jobsRunning << getSize() << maxSize << maxNumber;
+#endif
+    // Free space if necessary.
+    // Too many pages: free complete pages. Too much memory: free single pages from caches of low weight.
+    while (maxNumber >= 0 && cachedNumber() > maxNumber && freeWorstPage(nextIndex)) {}
+    while (maxSize >= 0 && getSize() > maxSize && freeWeightedPage(nextIndex)) {}
+
+    // Find the next page which is not cached.
+    while (nextIndex < ranking.size() && isCached(ranking[nextIndex]))
+        nextIndex++;
+    if (nextIndex >= ranking.size()) {
+        // All pages are cached or queued. jobFinished reports when everything is done.
+        timer.stop();
+        return;
+    }
+    if (!hasRoom()) {
+        // Only pages which are less important than the next page can be freed.
+        bool const freed = (maxNumber >= 0 && cachedNumber() >= maxNumber) ? freeWorstPage(nextIndex) : freeWeightedPage(nextIndex);
+        if (!freed) {
+            timer.stop();
+#ifdef DEBUG_CACHE
+            qDebug() << "Cache is full" << nextIndex << getSize() << cachedNumber();
+#endif
+        }
+        return;
+    }
+    cachePage(ranking[nextIndex++]);
+}
+
+bool CacheManager::freeWorstPage(int const minIndex)
+{
+    while (evictIndex > minIndex) {
+        int const page = ranking[evictIndex--];
+        if (isPartlyCached(page)) {
+            freePage(page);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CacheManager::freeWeightedPage(int const minIndex)
+{
+    ManagedCache* worst = nullptr;
+    qreal worstScore = 0.;
+    for (ManagedCache& managed : caches) {
+        // Skip pages which are not cached in this cache.
+        while (managed.evictIndex > minIndex && !managed.cache->contains(ranking[managed.evictIndex]))
+            managed.evictIndex--;
+        if (managed.evictIndex <= minIndex)
+            continue;
+        qreal const score = (1. + costs[ranking[managed.evictIndex]]) / managed.weight;
+        if (worst == nullptr || score > worstScore) {
+            worst = &managed;
+            worstScore = score;
+        }
+    }
+    if (worst == nullptr)
+        return false;
+    int const page = ranking[worst->evictIndex--];
+    worst->cache->clearPage(page);
+#ifdef DEBUG_CACHE
+    qDebug() << "Freed page" << page << "in" << worst->cache->objectName() << ". Cache size" << getSize() << "B";
+#endif
+    emit budgetChanged(getSize(), maxSize);
+    return true;
+}
+
+void CacheManager::freePage(int const page)
+{
+    for (ManagedCache const& managed : caches)
+        managed.cache->clearPage(page);
+#ifdef DEBUG_CACHE
+    qDebug() << "Freed page" << page << ". Cache size" << getSize() << "B";
+#endif
+    emit budgetChanged(getSize(), maxSize);
+}
+
+void CacheManager::cachePage(int const page)
+{
+#ifdef DEBUG_CACHE
+    qDebug() << "Cache page" << page << jobsRunning << getSize();
+#endif
+    // Pages are rendered in the order of the ranking.
+    int const priority = -nextIndex;
+    for (ManagedCache const& managed : caches) {
+        if (managed.prefetch && managed.cache->updateCache(page, priority))
+            jobsRunning++;
+    }
+    // Keep a few jobs per worker in the queue. Continue when enough of them are finished.
+    if (jobsRunning >= 2*RenderPool::instance()->getWorkers())
+        timer.stop();
+}
+
+void CacheManager::jobFinished()
+{
+    if (jobsRunning > 0)
+        jobsRunning--;
+    if (nextIndex < ranking.size()) {
+        if (jobsRunning < 2*RenderPool::instance()->getWorkers() && !timer.isActive() && !isDisabled())
+            timer.start();
+    }
+    else if (jobsRunning == 0 && !ranking.isEmpty() && evictIndex == ranking.size() - 1)
+        qInfo() << "All slides rendered to cache. Cache size:" << getSize() << "bytes.";
+}
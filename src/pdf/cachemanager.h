@@ -0,0 +1,181 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CACHEMANAGER_H
+#define CACHEMANAGER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include "cachemap.h"
+
+/// Decides which pages are rendered to cache and which are freed.
+/// Every page gets a cost, which estimates how soon it will be needed:
+/// the distance to the current page weighted by the direction of travel,
+/// the neighbouring slides when skipping overlays, and the pages from which
+/// the presenter jumped away (e.g. using TOC or overview), because these are
+/// likely to be visited again. Pages are rendered in order of increasing cost.
+/// When the cache size or the number of cached pages is limited, the cached
+/// pages with the largest cost are freed first, but never for a page of larger cost.
+///
+/// The manager also keeps the memory budget of all registered caches. Each
+/// cache has a weight: when memory is needed, the page with the largest cost
+/// divided by the weight of its cache is freed. Caches with large weights
+/// (the presentation) therefore keep their pages longer than caches with
+/// small weights (previews).
+class CacheManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// Constructor. doc is used for the number of pages and the overlay structure.
+    explicit CacheManager(PdfDoc const* doc, QObject* parent = nullptr);
+
+    /// Manage cache with given weight (> 0). The objectName of cache is used in the budget report.
+    /// The first registered cache determines the number of cached pages.
+    /// If prefetch is false, the manager never renders pages in cache (e.g. the
+    /// thumbnails of the overview, which are rendered on demand), but they count
+    /// in the budget and can be freed.
+    void addCache(CacheMap* cache, qreal const weight = 1., bool const prefetch = true);
+    /// Stop managing cache.
+    void removeCache(CacheMap const* cache);
+    /// Change the weight of a registered cache.
+    void setWeight(CacheMap const* cache, qreal const weight);
+    /// Count the decoded pixmaps of renderer (e.g. the tiles of the magnifier) in the budget.
+    /// Pages of renderer are not managed. The objectName of renderer is used in the budget report.
+    void addRenderer(BasicRenderer const* renderer);
+
+    /// Set maximum cache size in bytes. A negative size means unlimited.
+    void setMaxSize(qint64 const size) {maxSize = size;}
+    /// Set maximum number of cached pages. A negative number means unlimited.
+    void setMaxNumber(int const number) {maxNumber = number;}
+    /// Is caching disabled by a maximum size or number of 0?
+    bool isDisabled() const {return maxSize == 0 || maxNumber == 0;}
+    /// Memory used by all caches and registered renderers in bytes, including decoded pixmaps.
+    qint64 getSize() const;
+    /// Maximum cache size in bytes (negative if unlimited).
+    qint64 getMaxSize() const {return maxSize;}
+    /// Human readable summary of the memory used by all caches.
+    QString const budgetReport() const;
+
+    /// Set the current page, update the cost of all pages and (re)start caching.
+    void setCurrentPage(int const page);
+    /// The next page change is a jump (e.g. from TOC or overview), even if it only moves by a few pages.
+    void markJump() {forceJump = true;}
+    /// Rank all pages again and start caching.
+    void start();
+    /// Stop selecting new pages. Jobs in the RenderPool are not affected.
+    void stop() {timer.stop();}
+    /// Forget about jobs which were cancelled in all caches.
+    void jobsCancelled() {jobsRunning = 0;}
+    /// Forget the navigation history, e.g. after reloading the document.
+    void reset();
+    /// Delete pages of doc from all caches, e.g. after they have changed.
+    void invalidate(PdfDoc const* doc, QSet<int> const& pages);
+
+    /// Estimated cost of page: lower numbers will be needed sooner.
+    qreal cost(int const page) const;
+
+private:
+    /// Sort all pages by cost.
+    void rank();
+    /// Are all caches done with page?
+    bool isCached(int const page) const;
+    /// Is page contained in any cache?
+    bool isPartlyCached(int const page) const;
+    /// Number of cached pages in the first registered cache.
+    int cachedNumber() const {return caches.isEmpty() ? 0 : caches.first().cache->length();}
+    /// Is there space for one more page?
+    bool hasRoom() const;
+    /// Free the page with the largest cost divided by the weight of its cache,
+    /// if its position in ranking is after minIndex. Only a single cache is affected.
+    /// Return false if there is no such page.
+    bool freeWeightedPage(int const minIndex);
+    /// Free the cached page with the largest cost in all caches, if its
+    /// position in ranking is after minIndex. Return false if there is no such page.
+    bool freeWorstPage(int const minIndex);
+    /// Free page in all caches.
+    void freePage(int const page);
+    /// Render page in all caches.
+    void cachePage(int const page);
+
+    /// Document providing number of pages and overlays.
+    PdfDoc const* const doc;
+    /// Managed cache with its weight.
+    struct ManagedCache {
+        CacheMap* cache;
+        qreal weight;
+        /// Position in ranking of the next page which might be freed from this cache.
+        int evictIndex;
+        /// Does the manager render pages in this cache?
+        bool prefetch;
+    };
+    /// Managed caches.
+    QList<ManagedCache> caches;
+    /// Renderers of which only the decoded pixmaps are counted.
+    QList<BasicRenderer const*> renderers;
+    /// Timer for regular calls to step().
+    QTimer timer;
+
+    /// Pages sorted by increasing cost.
+    QVector<int> ranking;
+    /// Cost of each page, calculated in rank().
+    QVector<qreal> costs;
+    /// Position in ranking of the next page which might need to be rendered.
+    int nextIndex = 0;
+    /// Position in ranking of the next page which might be freed from all caches.
+    int evictIndex = -1;
+
+    /// Current page.
+    int currentPage = 0;
+    /// +1 when moving forward, -1 when moving backward.
+    int direction = 1;
+    /// First overlay of the slide after currentPage.
+    int nextSlideStart = 1;
+    /// Last overlay of the slide before currentPage.
+    int previousSlideEnd = 0;
+    /// Pages from which the presenter jumped away, the latest one last.
+    QList<int> jumpOrigins;
+    /// Set by markJump.
+    bool forceJump = false;
+    /// Number of entries in jumpOrigins.
+    static constexpr int maxJumpOrigins = 4;
+
+    /// Maximum cache size in bytes. Negative numbers mean unlimited.
+    qint64 maxSize = 104857600L;
+    /// Maximum number of cached pages. Negative numbers mean unlimited.
+    int maxNumber = -1;
+    /// Number of render jobs which are queued or running in the RenderPool.
+    int jobsRunning = 0;
+
+private slots:
+    /// Select a page which should be rendered to cache and free cache space if necessary.
+    void step();
+    /// Count finished render jobs and continue if necessary.
+    void jobFinished();
+    /// Remove a cache or renderer which is being deleted.
+    void cacheDestroyed(QObject* cache);
+    /// Forward changes of the memory used by caches or renderers to budgetChanged.
+    void sizeChanged() {emit budgetChanged(getSize(), maxSize);}
+
+signals:
+    /// Live readout of the budget: memory used by all caches and its limit (negative if unlimited).
+    void budgetChanged(qint64 const size, qint64 const maxSize);
+};
+
+#endif // CACHEMANAGER_H
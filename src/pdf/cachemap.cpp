@@ -17,31 +17,28 @@
  */
 
 #include "cachemap.h"
+#include <QPainter>
+#include "externalrenderer.h"
+#include "renderpool.h"
 
 CacheMap::~CacheMap()
 {
-    cacheThread->requestInterruption();
-    cacheThread->wait(10000);
-    if (cacheThread->isRunning()) {
-        cacheThread->terminate();
-        cacheThread->wait(10000);
-    }
-    delete cacheThread;
+    cancelJobs();
     qDeleteAll(data);
     data.clear();
+    for (auto const& pageTiles : tiles)
+        qDeleteAll(pageTiles);
+    tiles.clear();
 }
 
-qint64 CacheMap::setPixmap(int const page, QPixmap const* pix)
+qint64 CacheMap::setImage(int const page, QImage const& image)
 {
-    // Check whether the pixmap is empty.
-    if (pix->isNull())
+    // Check whether the image is empty.
+    if (image.isNull())
         return 0;
-    QByteArray* bytes = new QByteArray();
-    QBuffer buffer(bytes);
-    buffer.open(QIODevice::WriteOnly);
-    if (!pix->save(&buffer, "PNG")) {
+    QByteArray const* bytes = ImageCodec::encode(image, codec);
+    if (bytes == nullptr) {
         qWarning() << "Rendering failed." << this;
-        delete bytes;
         return 0;
     }
     qint64 currentSize = qint64(bytes->size());
@@ -51,6 +48,7 @@ qint64 CacheMap::setPixmap(int const page, QPixmap const* pix)
         delete data[page];
     }
     data[page] = bytes;
+    sizeBytes += currentSize;
     return currentSize;
 }
 
@@ -61,6 +59,16 @@ void CacheMap::clearCache()
 #endif
     qDeleteAll(data);
     data.clear();
+    for (auto const& pageTiles : tiles)
+        qDeleteAll(pageTiles);
+    tiles.clear();
+    clearHot();
+    awaited.clear();
+    awaitingSource.clear();
+    if (sizeBytes != 0) {
+        emit cacheSizeChanged(-sizeBytes);
+        sizeBytes = 0;
+    }
 }
 
 void CacheMap::changeResolution(const double res)
@@ -71,115 +79,543 @@ void CacheMap::changeResolution(const double res)
     qDebug() << "Change resolution" << res << resolution << this << parent();
 #endif
     clearCache();
-    resolution = res;
+    BasicRenderer::changeResolution(res);
 }
 
 QPixmap const CacheMap::getCachedPixmap(int const page) const
 {
 #ifdef DEBUG_CACHE
-    qDebug() << "get cached page" << page << this << data.contains(page);
+    qDebug() << "get cached page" << page << this << data.contains(page) << hot.contains(page);
 #endif
-    QPixmap pixmap;
+    if (hot.contains(page))
+        return hot[page];
     if (data.contains(page))
-        pixmap.loadFromData(*data.value(page), "PNG");
-    return pixmap;
+        return ImageCodec::decodePixmap(*data.value(page));
+    if (contains(page)) {
+        QSize const size = pageSize(page);
+        QPixmap pixmap(size);
+        QPainter painter(&pixmap);
+        for (auto it = tiles[page].cbegin(); it != tiles[page].cend(); it++)
+            painter.drawImage(tileRect(it.key(), size).topLeft(), ImageCodec::decode(**it));
+        return pixmap;
+    }
+    return QPixmap();
 }
 
 QPixmap const CacheMap::getPixmap(int const page)
 {
 #ifdef DEBUG_CACHE
-    qDebug() << "get page" << page << this << data.contains(page);
+    qDebug() << "get page" << page << this << data.contains(page) << hot.contains(page);
 #endif
-    QPixmap pixmap;
-    if (data.contains(page) && data.value(page) != nullptr) {
-        pixmap.loadFromData(*data.value(page), "PNG");
-        // Check whether pixmap has the correct size.
-        QSizeF pageSize = resolution*pdf->getPageSize(page);
-        if (pagePart != FullPage)
-            pageSize.setWidth(pageSize.width()/2);
-        if (abs(pixmap.height() - pageSize.height()) < 2 && abs(pixmap.width() - pageSize.width()) < 2)
+    QSize const size = pageSize(page);
+    hotCenter = page;
+    QPixmap pixmap, stale;
+    if (hot.contains(page)) {
+        pixmap = hot[page];
+        if (abs(pixmap.height() - size.height()) < 2 && abs(pixmap.width() - size.width()) < 2) {
+            // Mark the page as recently used.
+            hotOrder.removeOne(page);
+            hotOrder.append(page);
+            prefetchHot();
             return pixmap;
-#ifdef DEBUG_CACHE
-        qDebug() << "Size changed:" << pixmap.size() << pageSize;
-#endif
-        // The size was wrong. Delete the old cached page.
-        emit cacheSizeChanged(-data[page]->size());
-        data.remove(page);
+        }
+        removeHot(page);
+        stale = pixmap;
+        pixmap = QPixmap();
     }
-    if (resolution <= 0.)
+    if (isTiled(page)) {
+        pixmap = composeTiles(page, size, stale);
+        // Incomplete pages are not inserted in the hot tier.
+        if (contains(page))
+            insertHot(page, pixmap);
+        prefetchHot();
         return pixmap;
-    if (renderCommand.isEmpty()) {
-        pixmap = renderPixmap(page);
-        emit cacheSizeChanged(setPixmap(page, &pixmap));
     }
-    else {
-        ExternalRenderer* renderer = new ExternalRenderer(page);
-        renderer->start(getRenderCommand(page));
-        QByteArray const* bytes = nullptr;
-        if (renderer->waitForFinished(60000))
-            bytes = renderer->getBytes();
-        else
-            renderer->kill();
-        delete renderer;
-        pixmap.loadFromData(*bytes, "PNG");
-        if (pagePart == FullPage) {
-            data[page] = bytes;
-            emit cacheSizeChanged(bytes->size());
+    if (data.contains(page) && data.value(page) != nullptr) {
+        // Check whether the cached image has the correct size.
+        // This only reads the header of the encoded image.
+        QSize const cachedSize = ImageCodec::size(*data.value(page));
+        if (abs(cachedSize.height() - size.height()) < 2 && abs(cachedSize.width() - size.width()) < 2)
+            pixmap = ImageCodec::decodePixmap(*data.value(page));
+        else {
+#ifdef DEBUG_CACHE
+            qDebug() << "Size changed:" << cachedSize << size;
+#endif
+            // The size was wrong. Delete the old cached page.
+            sizeBytes -= data[page]->size();
+            emit cacheSizeChanged(-data[page]->size());
+            delete data[page];
+            data.remove(page);
+        }
+    }
+    if (pixmap.isNull()) {
+        if (resolution <= 0.)
+            return pixmap;
+        QSize sourceSize;
+        QVector<EncodedTile> const source = sourceTiles(page, size, sourceSize);
+        if (!source.isEmpty()) {
+            // Downscaling a page of higher resolution is much faster than rendering it.
+            QImage const image = ImageCodec::scaled(ImageCodec::decodeTiles(source, sourceSize), size);
+            emit cacheSizeChanged(setImage(page, image));
+            pixmap = QPixmap::fromImage(image);
+            derivedPages++;
+        }
+        else if (renderCommand.isEmpty()) {
+            // Reading the page from the disk cache is much faster than rendering it.
+            QByteArray const diskKey = getDiskCacheKey(page);
+            QByteArray const* bytes = diskKey.isEmpty() ? nullptr : DiskCache::load(diskKey);
+            if (bytes != nullptr) {
+                pixmap = ImageCodec::decodePixmap(*bytes);
+                if (pixmap.isNull()) {
+                    // The entry passed the checks of its header, but its data are corrupt.
+                    DiskCache::remove(diskKey);
+                    delete bytes;
+                }
+                else
+                    receiveBytes(page, bytes);
+            }
+            if (pixmap.isNull()) {
+                QImage const image = renderImage(page);
+                emit cacheSizeChanged(setImage(page, image));
+                pixmap = QPixmap::fromImage(image);
+                if (!diskKey.isEmpty() && data.contains(page))
+                    DiskCache::store(diskKey, *data[page]);
+            }
         }
         else {
-            delete bytes;
-            if (pagePart == LeftHalf)
-                pixmap = pixmap.copy(0, 0, pixmap.width()/2, pixmap.height());
+            // Never wait for the external renderer in the main thread.
+            // Render the page in the RenderPool before all other pages and
+            // return a placeholder. pageReady is emitted when the page arrives.
+            awaited.insert(page);
+            if (pending.contains(page))
+                RenderPool::instance()->prioritize(this, page, RenderPool::immediatePriority);
             else
-                pixmap = pixmap.copy(pixmap.width()/2, 0, pixmap.width()/2, pixmap.height());
-            emit cacheSizeChanged(setPixmap(page, &pixmap));
+                submitJob(page, RenderPool::immediatePriority);
+            prefetchHot();
+            // The placeholder is not inserted in the hot tier.
+            return placeholder(page, size, stale);
         }
     }
+    insertHot(page, pixmap);
+    prefetchHot();
     return pixmap;
 }
 
+QPixmap const CacheMap::placeholder(int const page, QSize const& size, QPixmap const& stale) const
+{
+    // Prefer an outdated pixmap of the same page.
+    QPixmap pixmap = stale;
+    // Then try the cache of placeholderSource.
+    if (pixmap.isNull() && !placeholderSource.isNull())
+        pixmap = placeholderSource->getCachedPixmap(page);
+    // Otherwise render the page at low resolution using poppler.
+    // This takes only a small fraction of the time required for a full resolution image.
+    if (pixmap.isNull())
+        pixmap = QPixmap::fromImage(renderImage(pdf, page, resolution/4, pagePart));
+    if (pixmap.isNull() || pixmap.size() == size)
+        return pixmap;
+    return pixmap.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void CacheMap::setPlaceholderSource(CacheMap const* source)
+{
+    if (source != nullptr && (source->getDoc() != pdf || source->getPagePart() != pagePart)) {
+        qWarning() << "Placeholder source renders a different document.";
+        return;
+    }
+    placeholderSource = source;
+}
+
+void CacheMap::setTileSize(int const size)
+{
+    if (size == tileSize)
+        return;
+    cancelJobs();
+    clearCache();
+    tileSize = size < 0 ? 0 : size;
+}
+
+bool CacheMap::isTiled(int const page) const
+{
+    if (tileSize <= 0 || !renderCommand.isEmpty() || resolution <= 0.)
+        return false;
+    QSize const size = pageSize(page);
+    return size.width() > tileSize || size.height() > tileSize;
+}
+
+int CacheMap::tileCount(QSize const& size) const
+{
+    if (tileSize <= 0)
+        return 1;
+    return ((size.width() + tileSize - 1) / tileSize) * ((size.height() + tileSize - 1) / tileSize);
+}
+
+QRect const CacheMap::tileRect(int const tile, QSize const& size) const
+{
+    int const columns = (size.width() + tileSize - 1) / tileSize;
+    return QRect((tile % columns) * tileSize, (tile / columns) * tileSize, tileSize, tileSize) & QRect(QPoint(), size);
+}
+
+bool CacheMap::submitTiles(int const page, int const priority)
+{
+    QSize const size = pageSize(page);
+    int const count = tileCount(size);
+    QMap<int, QByteArray const*> const& pageTiles = tiles[page];
+    QSet<int>& pagePending = pendingTiles[page];
+    bool started = false;
+    // Tiles with equal priority are rendered in the order of submission: from top to bottom.
+    for (int tile=0; tile<count; tile++) {
+        if (pageTiles.contains(tile) || pagePending.contains(tile))
+            continue;
+        pagePending.insert(tile);
+        RenderPool::instance()->submitTile(this, page, tile, tileRect(tile, size), priority);
+        started = true;
+    }
+    if (pagePending.isEmpty()) {
+        pendingTiles.remove(page);
+        if (pageTiles.isEmpty())
+            tiles.remove(page);
+        return false;
+    }
+    // A tiled page is pending as long as any of its tiles is pending.
+    pending.insert(page);
+    return started;
+}
+
+QPixmap const CacheMap::composeTiles(int const page, QSize const& size, QPixmap const& stale)
+{
+    QMap<int, QByteArray const*> const pageTiles = tiles.value(page);
+    bool const complete = pageTiles.size() == tileCount(size);
+    QPixmap pixmap = complete ? QPixmap() : placeholder(page, size, stale);
+    if (pixmap.size() != size) {
+        pixmap = QPixmap(size);
+        pixmap.fill(Qt::white);
+    }
+    QPainter painter(&pixmap);
+    for (auto it = pageTiles.cbegin(); it != pageTiles.cend(); it++)
+        painter.drawImage(tileRect(it.key(), size).topLeft(), ImageCodec::decode(**it));
+    painter.end();
+    if (!complete) {
+        // Missing tiles are reported by tileReady.
+        awaited.insert(page);
+        if (pendingTiles.contains(page))
+            RenderPool::instance()->prioritize(this, page, RenderPool::immediatePriority);
+        submitTiles(page, RenderPool::immediatePriority);
+    }
+    return pixmap;
+}
+
+bool CacheMap::receiveTile(int const page, int const tile, QByteArray const* bytes, QImage const& image)
+{
+    if (pendingTiles.contains(page)) {
+        pendingTiles[page].remove(tile);
+        if (pendingTiles[page].isEmpty()) {
+            pendingTiles.remove(page);
+            pending.remove(page);
+        }
+    }
+    if (bytes == nullptr || bytes->isEmpty()) {
+        delete bytes;
+        if (awaited.contains(page))
+            qWarning() << "Rendering tile" << tile << "of page" << page+1 << "failed.";
+        if (pending.contains(page))
+            return false;
+        emit pageDropped(page);
+        return true;
+    }
+    qint64 sizeDiff = bytes->size();
+    QMap<int, QByteArray const*>& pageTiles = tiles[page];
+    if (pageTiles.contains(tile)) {
+        sizeDiff -= pageTiles[tile]->size();
+        delete pageTiles[tile];
+    }
+    pageTiles[tile] = bytes;
+    sizeBytes += sizeDiff;
+    emit cacheSizeChanged(sizeDiff);
+    QSize const size = pageSize(page);
+    if (awaited.contains(page) && !image.isNull())
+        emit tileReady(page, tileRect(tile, size), image);
+    if (pageTiles.size() == tileCount(size)) {
+        awaited.remove(page);
+        emit pageCached(page);
+    }
+    else if (!pending.contains(page))
+        // Another tile of the page failed.
+        emit pageDropped(page);
+    return !pending.contains(page);
+}
+
+void CacheMap::setDownscaleSource(CacheMap const* source)
+{
+    if (source != nullptr && (source->getDoc() != pdf || source->getPagePart() != pagePart)) {
+        qWarning() << "Downscale source renders a different document.";
+        return;
+    }
+    if (!downscaleSource.isNull()) {
+        disconnect(downscaleSource, &CacheMap::pageCached, this, &CacheMap::receiveSourcePage);
+        disconnect(downscaleSource, &CacheMap::pageDropped, this, &CacheMap::receiveSourcePage);
+    }
+    awaitingSource.clear();
+    downscaleSource = source;
+    if (source != nullptr) {
+        connect(source, &CacheMap::pageCached, this, &CacheMap::receiveSourcePage);
+        connect(source, &CacheMap::pageDropped, this, &CacheMap::receiveSourcePage);
+    }
+}
+
+QSize const CacheMap::pageSize(int const page) const
+{
+    QSizeF size = resolution*pdf->getPageSize(page);
+    if (pagePart != FullPage)
+        size.setWidth(size.width()/2);
+    return size.toSize();
+}
+
+QVector<EncodedTile> const CacheMap::sourceTiles(int const page, QSize const& size, QSize& sourceSize) const
+{
+    QVector<EncodedTile> source;
+    if (downscaleSource.isNull() || !downscaleSource->contains(page))
+        return source;
+    QByteArray const* bytes = downscaleSource->data.value(page, nullptr);
+    // Tiles are only used if the page is not available as a whole.
+    sourceSize = bytes == nullptr ? downscaleSource->pageSize(page) : ImageCodec::size(*bytes);
+    // Only downscale: upscaled pages would be blurry.
+    if (sourceSize.width() < size.width() || sourceSize.height() < size.height())
+        return source;
+    if (bytes != nullptr)
+        source.append({QRect(QPoint(), sourceSize), *bytes});
+    else {
+        QMap<int, QByteArray const*> const& pageTiles = downscaleSource->tiles[page];
+        source.reserve(pageTiles.size());
+        for (auto it = pageTiles.cbegin(); it != pageTiles.cend(); it++)
+            source.append({downscaleSource->tileRect(it.key(), sourceSize), **it});
+    }
+    return source;
+}
+
+void CacheMap::submitDownscale(int const page, QVector<EncodedTile> const& source, QSize const& sourceSize, int const priority)
+{
+    if (pending.contains(page))
+        return;
+    pending.insert(page);
+    derivedPages++;
+#ifdef DEBUG_CACHE
+    qDebug() << "Derive page" << page << "from" << downscaleSource << this;
+#endif
+    RenderPool::instance()->submitDownscale(this, page, source, sourceSize, pageSize(page), priority, isHot(page));
+}
+
+void CacheMap::receiveSourcePage(int const page)
+{
+    if (!awaitingSource.contains(page))
+        return;
+    int const priority = awaitingSource.take(page);
+    if (data.contains(page) || pending.contains(page) || resolution <= 0.)
+        return;
+    QSize sourceSize;
+    QVector<EncodedTile> const source = sourceTiles(page, pageSize(page), sourceSize);
+    if (source.isEmpty())
+        submitJob(page, priority, isHot(page));
+    else
+        submitDownscale(page, source, sourceSize, priority);
+}
+
 qint64 CacheMap::clearPage(const int page)
 {
+    removeHot(page);
+    if (tiles.contains(page)) {
+        qint64 freed = 0;
+        for (QByteArray const* tile : tiles[page])
+            freed += tile->size();
+        qDeleteAll(tiles[page]);
+        tiles.remove(page);
+        sizeBytes -= freed;
+        return freed;
+    }
     if (!data.contains(page))
         return 0;
     qint64 pageSize(data[page]->size());
     delete data[page];
     data.remove(page);
+    sizeBytes -= pageSize;
     return pageSize;
 }
 
-void CacheMap::receiveBytes()
+void CacheMap::clearPages(QSet<int> const& pages)
+{
+    qint64 freed = 0;
+    for (int const page : pages) {
+        freed += clearPage(page);
+        awaited.remove(page);
+        awaitingSource.remove(page);
+    }
+    if (freed != 0)
+        emit cacheSizeChanged(-freed);
+}
+
+void CacheMap::receiveBytes(int const page, QByteArray const* bytes)
 {
-    QByteArray const* bytes = cacheThread->getBytes();
     if (bytes != nullptr && !bytes->isEmpty()) {
         qint64 size_diff = bytes->size();
-        int const page = cacheThread->getPage();
-        if (data.contains(page))
+        if (data.contains(page)) {
             size_diff -= data[page]->size();
+            delete data[page];
+        }
         data[page] = bytes;
+        sizeBytes += size_diff;
         emit cacheSizeChanged(size_diff);
+        emit pageCached(page);
+        // Replace the placeholder by the sharp image.
+        if (awaited.remove(page))
+            emit pageReady(page);
+    }
+    else {
+        delete bytes;
+        if (awaited.remove(page))
+            qWarning() << "Rendering page" << page+1 << "failed.";
+        emit pageDropped(page);
     }
 #ifdef DEBUG_CACHE
-    qDebug() << "Cache thread finished:" << this << parent();
+    qDebug() << "Render job finished:" << page << this << parent();
 #endif
-    emit cacheThreadFinished();
 }
 
-bool CacheMap::updateCache(int const page)
+void CacheMap::receiveImage(int const page, QImage const& image)
+{
+    pendingHot.remove(page);
+    // The page could have been removed from cache or navigation could have moved on.
+    if (!image.isNull() && data.contains(page) && isHot(page) && !hot.contains(page))
+        insertHot(page, QPixmap::fromImage(image));
+}
+
+void CacheMap::insertHot(int const page, QPixmap const& pixmap)
+{
+    if (hotPages < 0 || pixmap.isNull())
+        return;
+    qint64 diff = pixmapBytes(pixmap);
+    if (hot.contains(page))
+        diff -= pixmapBytes(hot[page]);
+    hot[page] = pixmap;
+    hotOrder.removeOne(page);
+    hotOrder.append(page);
+    // The new pixmap is used last and is therefore never evicted here.
+    while (hotOrder.size() > 2*hotPages + 2 || (maxHotBytes >= 0 && hotOrder.size() > 1 && getDecodedBytes() + diff > maxHotBytes))
+        diff -= evictHot();
+    addDecodedBytes(diff);
+}
+
+qint64 CacheMap::evictHot()
+{
+    // Evict the least recently used page outside the neighbourhood of hotCenter.
+    // If all pages are in the neighbourhood, evict the least recently used page.
+    QList<int>::iterator it = hotOrder.begin();
+    while (it != hotOrder.end() && isHot(*it))
+        it++;
+    if (it == hotOrder.end())
+        it = hotOrder.begin();
+    qint64 const freed = pixmapBytes(hot.take(*it));
+    hotOrder.erase(it);
+    return freed;
+}
+
+void CacheMap::removeHot(int const page)
+{
+    if (!hot.contains(page))
+        return;
+    addDecodedBytes(-pixmapBytes(hot.take(page)));
+    hotOrder.removeOne(page);
+}
+
+void CacheMap::clearHot()
+{
+    hot.clear();
+    hotOrder.clear();
+    addDecodedBytes(-getDecodedBytes());
+}
+
+void CacheMap::prefetchHot()
+{
+    if (hotPages < 0 || resolution <= 0.)
+        return;
+    // Only decode as many pages as fit in maxHotBytes. Otherwise decoded
+    // pages would evict each other. Decoded pages use 4 bytes per pixel.
+    qint64 available = maxHotBytes;
+    // Start with the following pages: these are most likely needed next.
+    for (int i=0; i<=2*hotPages; i++) {
+        int const page = i <= hotPages ? hotCenter + i : hotCenter + hotPages - i;
+        if (!hot.contains(page) && !data.contains(page))
+            continue;
+        if (maxHotBytes >= 0) {
+            QSize const size = pageSize(page);
+            available -= hot.contains(page) ? pixmapBytes(hot[page]) : 4*qint64(size.width())*size.height();
+            if (available < 0 && i > 0)
+                break;
+        }
+        if (!hot.contains(page) && !pendingHot.contains(page)) {
+            pendingHot.insert(page);
+            RenderPool::instance()->submitDecode(this, page, *data[page]);
+        }
+    }
+}
+
+void CacheMap::setHotPages(int const pages)
+{
+    hotPages = pages;
+    if (hotPages < 0)
+        clearHot();
+}
+
+void CacheMap::setMaxHotBytes(qint64 const bytes)
+{
+    maxHotBytes = bytes;
+    qint64 freed = 0;
+    while (maxHotBytes >= 0 && hotOrder.size() > 1 && getDecodedBytes() - freed > maxHotBytes)
+        freed += evictHot();
+    addDecodedBytes(-freed);
+}
+
+void CacheMap::cancelJobs()
+{
+    QSet<int> const dropped = pending;
+    BasicRenderer::cancelJobs();
+    pendingHot.clear();
+    awaitingSource.clear();
+    pendingTiles.clear();
+    // Pages in awaited are kept: pageReady is still emitted when they are
+    // rendered again (either by getPixmap or by updateCache).
+    // Caches waiting to derive the dropped pages render them themselves.
+    for (int const page : dropped)
+        emit pageDropped(page);
+}
+
+bool CacheMap::updateCache(int const page, int const priority)
 {
     if (resolution <= 0.)
         return false;
-    if (data.contains(page))
+    if (data.contains(page) || pending.contains(page))
         return false;
-    cacheThread->setPage(page);
-    cacheThread->start();
+    if (awaitingSource.contains(page)) {
+        if (!downscaleSource.isNull() && downscaleSource->isPending(page))
+            return false;
+        // The source has dropped the page without notice (e.g. it was deleted).
+        awaitingSource.remove(page);
+    }
+    if (isTiled(page))
+        return submitTiles(page, priority);
+    if (!downscaleSource.isNull()) {
+        QSize sourceSize;
+        QVector<EncodedTile> const source = sourceTiles(page, pageSize(page), sourceSize);
+        if (!source.isEmpty()) {
+            submitDownscale(page, source, sourceSize, priority);
+            return true;
+        }
+        if (downscaleSource->isPending(page)) {
+            // Derive the page when the source has rendered it.
+            awaitingSource[page] = priority;
+            return false;
+        }
+    }
+    // Keep the rendered image if it will be needed soon.
+    submitJob(page, priority, isHot(page));
     return true;
 }
-
-qint64 CacheMap::getSizeBytes() const
-{
-    qint64 size = 0;
-    for (QMap<int, QByteArray const*>::const_iterator it=data.cbegin(); it!=data.cend(); it++)
-        size += (*it)->size();
-    return size;
-}
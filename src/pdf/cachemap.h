@@ -20,11 +20,24 @@
 #define CACHEMAP_H
 
 #include <QMap>
+#include <QPointer>
 #include "basicrenderer.h"
 
 /// QObject rendering pdf pages to images and storing these in a compressed cache.
-/// This class handles the complete rendering, owns the cached pages, and owns the
-/// cache thread which is used to render pages without affecting the main thread.
+/// This class handles the complete rendering and owns the cached pages.
+/// Pages are rendered to cache in the RenderPool without affecting the main thread.
+/// The cache has two tiers: The compressed pages and a small "hot" LRU cache of
+/// decoded pixmaps for the neighbourhood of the last requested page.
+/// The hot tier is filled in the RenderPool ahead of navigation.
+/// The main thread never waits for an external renderer: missing pages are
+/// shown as a scaled placeholder until the RenderPool delivers them (see pageReady).
+/// A cache can derive its pages from a cache of higher resolution (its
+/// downscale source) instead of rendering them again.
+/// In tiled mode, large pages are rendered as tiles in parallel and cached per
+/// tile. Tiles are reported by tileReady as soon as they are available.
+/// Caches deriving their pages from a tiled page compose them from the tiles.
+/// Tiles are not stored in the disk cache: tiled pages are rendered again after
+/// a restart.
 class CacheMap : public BasicRenderer
 {
     Q_OBJECT
@@ -39,37 +52,153 @@ public:
     /// Get an image from cache if available or an empty pixmap otherwise.
     QPixmap const getCachedPixmap(int const page) const;
     /// Get an image from cache or render a new image and save it to cache.
+    /// This also updates the neighbourhood of the hot tier to page.
+    /// With an external renderer, a missing page is rendered in the RenderPool
+    /// and a scaled placeholder is returned. pageReady is emitted when the page is available.
     QPixmap const getPixmap(int const page);
-    /// Calculate and return cache ssize in bytes.
-    qint64 getSizeBytes() const;
-    /// Set data from pixmap.
-    /// Write the pixmap in png format to a QBytesArray at *value(page).
-    qint64 setPixmap(int const page, QPixmap const* pix);
+    /// Cache size in bytes.
+    qint64 getSizeBytes() const {return sizeBytes;}
+    /// Set data from image.
+    /// Encode the image using codec and write it to a QBytesArray at *value(page).
+    /// Return the change in cache size (in bytes).
+    qint64 setImage(int const page, QImage const& image);
     /// Clear cache.
     void clearCache();
     /// Is a page contained in cache?
-    bool contains(int const page) {return data.contains(page);}
-    /// Number of cached slides.
-    int length() const {return data.size();}
+    bool contains(int const page) const {return data.contains(page) || (tiles.contains(page) && tiles[page].size() == tileCount(pageSize(page)));}
+    /// Number of cached slides (including partially cached tiled slides).
+    int length() const {return data.size() + tiles.size();}
     /// Delete a page from cache and return its size.
+    /// cacheSizeChanged is not emitted: the caller is responsible for the size.
     qint64 clearPage(int const page);
+    /// Delete pages from cache, e.g. after they have changed in the PDF file.
+    /// This emits cacheSizeChanged.
+    void clearPages(QSet<int> const& pages);
     /// Change resolution. This clears cache if the resolution actually changes.
     void changeResolution(double const res) override;
 
-    /// Update cache. This will start cacheThread.
-    bool updateCache(int const page);
+    /// Update cache: render page in the RenderPool with given priority.
+    /// Return true if a new render job was started.
+    bool updateCache(int const page, int const priority = 0);
+    /// Set the number of pages before and after the current page which are kept decoded.
+    /// The hot tier holds at most 2*pages+2 pixmaps. A negative number disables the hot tier.
+    void setHotPages(int const pages);
+    /// Set the maximum memory used by the hot tier in bytes. The page which was
+    /// requested last is always kept. A negative size means unlimited.
+    void setMaxHotBytes(qint64 const bytes);
+    /// Cancel all render and decode jobs of this cache.
+    void cancelJobs() override;
+    /// Use the cached pages of source (usually a cache with lower resolution) as placeholders.
+    /// source must render the same document and page part.
+    void setPlaceholderSource(CacheMap const* source);
+    /// Derive pages by downscaling the cached pages of source (a cache with higher resolution).
+    /// Pages which are not available in source are rendered as usual.
+    /// source must render the same document and page part.
+    void setDownscaleSource(CacheMap const* source);
+    /// Number of pages which were derived from the downscale source instead of being rendered.
+    int getDerivedPages() const {return derivedPages;}
+    /// Render pages which are larger than size x size pixels as tiles of this size. 0 disables tiles.
+    /// This clears the cache if the tile size changes.
+    void setTileSize(int const size);
+    /// Is page rendered as tiles at the current resolution?
+    bool isTiled(int const page) const;
 
-public slots:
-    /// Get cached pages from cacheThread. Called when cacheThread finishes.
-    void receiveBytes() override;
+protected:
+    /// Save a page rendered in the RenderPool to cache.
+    void receiveBytes(int const page, QByteArray const* bytes) override;
+    /// Save a decoded page in the hot tier.
+    void receiveImage(int const page, QImage const& image) override;
 
 private:
-    /// Cached slides as png images.
+    /// Is page in the neighbourhood of hotCenter?
+    bool isHot(int const page) const {return hotPages >= 0 && page >= hotCenter - hotPages && page <= hotCenter + hotPages;}
+    /// Insert pixmap in the hot tier and evict old pixmaps if the number of
+    /// pixmaps or their size exceeds the limits.
+    void insertHot(int const page, QPixmap const& pixmap);
+    /// Evict the least recently used pixmap of the hot tier, preferably outside the neighbourhood of hotCenter.
+    /// Return the number of freed bytes.
+    qint64 evictHot();
+    /// Remove page from the hot tier.
+    void removeHot(int const page);
+    /// Remove all pages from the hot tier.
+    void clearHot();
+    /// Decode pages in the neighbourhood of hotCenter in the RenderPool.
+    void prefetchHot();
+    /// Create a placeholder of the given size for a page which is not available yet.
+    /// stale is an outdated pixmap of the page or a null pixmap.
+    QPixmap const placeholder(int const page, QSize const& size, QPixmap const& stale) const;
+    /// Size of page in pixels at the current resolution.
+    QSize const pageSize(int const page) const;
+    /// Encoded page in downscaleSource if it is at least as large as size, an empty vector otherwise.
+    /// Pages which downscaleSource renders in tiled mode are returned as tiles if all tiles are available.
+    /// sourceSize is set to the size of the page in downscaleSource.
+    QVector<EncodedTile> const sourceTiles(int const page, QSize const& size, QSize& sourceSize) const;
+    /// Derive a page from the tiles of a page of size sourceSize in downscaleSource in the RenderPool.
+    void submitDownscale(int const page, QVector<EncodedTile> const& source, QSize const& sourceSize, int const priority);
+    /// Number of tiles of a page of the given size.
+    int tileCount(QSize const& size) const;
+    /// Rectangle covered by tile in a page of the given size.
+    QRect const tileRect(int const tile, QSize const& size) const;
+    /// Render all missing tiles of page in the RenderPool.
+    /// Return true if a new tile job was started.
+    bool submitTiles(int const page, int const priority);
+    /// Compose a tiled page from the cached tiles. Missing tiles are taken
+    /// from a placeholder and rendered in the RenderPool.
+    QPixmap const composeTiles(int const page, QSize const& size, QPixmap const& stale);
+    /// Save a tile rendered in the RenderPool.
+    bool receiveTile(int const page, int const tile, QByteArray const* bytes, QImage const& image) override;
+
+    /// Cached slides, encoded using ImageCodec.
     QMap<int, QByteArray const*> data;
+    /// Total size of data in bytes.
+    qint64 sizeBytes = 0;
+    /// Hot tier: decoded pixmaps. Their size is counted in getDecodedBytes().
+    QMap<int, QPixmap> hot;
+    /// Pages in hot, least recently used first.
+    QList<int> hotOrder;
+    /// Pages which are decoded in the RenderPool.
+    QSet<int> pendingHot;
+    /// Page which was requested last.
+    int hotCenter = 0;
+    /// Number of pages before and after hotCenter which should be in the hot tier.
+    int hotPages = 1;
+    /// Maximum memory used by the hot tier in bytes. Negative numbers mean unlimited.
+    qint64 maxHotBytes = 67108864L;
+    /// Pages which were shown as placeholder and are rendered in the RenderPool.
+    QSet<int> awaited;
+    /// Cache providing placeholders.
+    QPointer<CacheMap const> placeholderSource;
+    /// Cache from which pages are derived by downscaling.
+    QPointer<CacheMap const> downscaleSource;
+    /// Pages which are rendered in downscaleSource and will be derived from it, with their priority.
+    QMap<int, int> awaitingSource;
+    /// Number of pages derived from downscaleSource.
+    int derivedPages = 0;
+    /// Size of tiles in pixels, 0 if tiles are disabled.
+    int tileSize = 0;
+    /// Tiles of pages rendered in tiled mode, encoded using ImageCodec.
+    QMap<int, QMap<int, QByteArray const*>> tiles;
+    /// Tiles which are rendered in the RenderPool.
+    QMap<int, QSet<int>> pendingTiles;
+
+private slots:
+    /// Derive page if it is waiting for downscaleSource. If downscaleSource
+    /// dropped the page, it is rendered instead.
+    void receiveSourcePage(int const page);
 
 signals:
     /// Notify about changes in cache size (in bytes).
     void cacheSizeChanged(qint64 const size);
+    /// A page which was returned as placeholder by getPixmap is now available.
+    void pageReady(int const page);
+    /// A page rendered in the RenderPool was saved to cache.
+    void pageCached(int const page);
+    /// A page which was pending was not saved to cache: its job was
+    /// cancelled or rendering failed. pageCached will not be emitted.
+    void pageDropped(int const page);
+    /// A tile of a page which was returned incomplete by getPixmap is now available.
+    /// rect is the position of the tile in the pixmap of the page.
+    void tileReady(int const page, QRect const& rect, QImage const& image);
 };
 
 #endif // CACHEMAP_H
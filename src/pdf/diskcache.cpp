@@ -0,0 +1,181 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "diskcache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include "imagecodec.h"
+#include <algorithm>
+#include <cstring>
+
+/// Magic number of disk cache entries ("BPDC").
+static constexpr quint32 diskMagic = 0x42504443;
+/// Increase this when the format of entries or of ImageCodec changes.
+static constexpr quint32 diskVersion = 2;
+
+std::atomic<bool> DiskCache::enabled {false};
+std::atomic<qint64> DiskCache::maxSize {qint64(1) << 30};
+std::atomic<qint64> DiskCache::usedSize {-1};
+
+/// Only one thread scans the cache directory at a time.
+static QMutex pruneMutex;
+
+QString const DiskCache::directory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pages";
+}
+
+QString const DiskCache::entryPath(QByteArray const& key)
+{
+    return directory() + "/" + key.toHex() + ".bpc";
+}
+
+QByteArray const DiskCache::entryKey(PdfDoc const* pdf, int const page, QSize const& size, PagePart const part, CacheCodec const codec, QString const& renderCommand)
+{
+    // Pages are identified by their content, not by the file or the page number.
+    QByteArray const fingerprint = pdf->getFingerprint(page);
+    if (fingerprint.isEmpty())
+        return QByteArray();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(fingerprint);
+    hash.addData(QByteArray::number(size.width()) + "x" + QByteArray::number(size.height())
+                 + " " + QByteArray::number(int(part)) + " " + QByteArray::number(int(codec)) + " ");
+    hash.addData(renderCommand.toUtf8());
+    return hash.result();
+}
+
+QByteArray const* DiskCache::load(QByteArray const& key)
+{
+    if (key.size() != int(sizeof(Header::key)))
+        return nullptr;
+    QString const path = entryPath(key);
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+    if (file.size() <= qint64(sizeof(Header)) || file.size() > (1 << 30)) {
+        file.close();
+        discard(path);
+        return nullptr;
+    }
+    int const size = int(file.size());
+    // Map the file if possible. The page is copied only once, directly from the page cache of the OS.
+    uchar const* mapped = file.map(0, size);
+    QByteArray contents;
+    if (mapped == nullptr) {
+        contents = file.readAll();
+        if (contents.size() != size)
+            return nullptr;
+        mapped = reinterpret_cast<uchar const*>(contents.constData());
+    }
+    Header header;
+    std::memcpy(&header, mapped, sizeof(Header));
+    QByteArray const* bytes = nullptr;
+    if (header.magic == diskMagic && header.version == diskVersion && std::memcmp(header.key, key.constData(), sizeof(header.key)) == 0)
+        bytes = new QByteArray(reinterpret_cast<char const*>(mapped) + sizeof(Header), size - int(sizeof(Header)));
+    // A corrupt cache file must never crash the presenter: reject the entry and delete the file.
+    if (bytes == nullptr || !ImageCodec::isValid(*bytes)) {
+        delete bytes;
+        // Closing the file also unmaps it.
+        file.close();
+        discard(path);
+        return nullptr;
+    }
+    // The modification time marks recently used entries for prune().
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return bytes;
+}
+
+void DiskCache::remove(QByteArray const& key)
+{
+    if (key.size() == int(sizeof(Header::key)))
+        discard(entryPath(key));
+}
+
+void DiskCache::discard(QString const& path)
+{
+    qWarning() << "Removing invalid disk cache entry" << path;
+    QFile::remove(path);
+}
+
+void DiskCache::store(QByteArray const& key, QByteArray const& bytes)
+{
+    if (bytes.isEmpty() || key.size() != int(sizeof(Header::key)))
+        return;
+    QString const path = entryPath(key);
+    QDir().mkpath(directory());
+    Header header {diskMagic, diskVersion, {}};
+    std::memcpy(header.key, key.constData(), sizeof(header.key));
+    // Replace the entry atomically: other threads or processes never read incomplete entries.
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)
+            || file.write(reinterpret_cast<char const*>(&header), sizeof(Header)) != qint64(sizeof(Header))
+            || file.write(bytes) != bytes.size()
+            || !file.commit()) {
+        qWarning() << "Failed to write disk cache entry" << path;
+        return;
+    }
+    // The size is only estimated between scans: other processes may write to the same directory.
+    qint64 const size = qint64(sizeof(Header)) + bytes.size();
+    qint64 const used = usedSize.fetch_add(size);
+    if (maxSize > 0 && (used < 0 || used + size > maxSize))
+        prune();
+}
+
+void DiskCache::prune()
+{
+    // Other threads continue rendering while one thread scans the directory.
+    if (!pruneMutex.tryLock())
+        return;
+    struct Entry {
+        QDateTime lastUsed;
+        QString path;
+        qint64 size;
+    };
+    QVector<Entry> entries;
+    qint64 total = 0;
+    // Entries of older versions are in subdirectories. They are removed as least recently used.
+    QDirIterator it(directory(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo const info = it.fileInfo();
+        entries.append({info.lastModified(), info.filePath(), info.size()});
+        total += info.size();
+    }
+    qint64 const max = maxSize;
+    if (max > 0 && total > max) {
+        // Leave some space, such that the directory is not scanned again for every new entry.
+        std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b){return a.lastUsed < b.lastUsed;});
+        for (Entry const& entry : entries) {
+            if (total <= max - max/4)
+                break;
+            if (QFile::remove(entry.path))
+                total -= entry.size;
+        }
+#ifdef DEBUG_CACHE
+        qDebug() << "Pruned disk cache to" << total << "bytes";
+#endif
+    }
+    usedSize = total;
+    pruneMutex.unlock();
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <atomic>
+#include <QtDebug>
+#include <QByteArray>
+#include <QString>
+#include "pdfdoc.h"
+
+/// Persistent cache of rendered pages on disk.
+/// Entries are files in QStandardPaths::CacheLocation, named after their key.
+/// The key identifies the content of the page by its fingerprint (see
+/// PdfDoc::getFingerprint), the image size, the page part, the codec and the
+/// renderer. Each file starts with the key, followed by the page encoded by
+/// ImageCodec. Changed pages get new keys, and thus new entries.
+/// The size of the directory is limited: when it exceeds its budget, the least
+/// recently used entries are removed. Reading an entry marks it as used.
+/// All functions are thread safe and are usually called in the RenderPool.
+class DiskCache
+{
+public:
+    /// Enable or disable the disk cache. This should be set before documents are loaded.
+    static void setEnabled(bool const enable) {enabled = enable;}
+    static bool isEnabled() {return enabled;}
+    /// Set the maximum size of the cache directory in bytes. Non-positive values disable the limit.
+    static void setMaxSize(qint64 const bytes) {maxSize = bytes;}
+    /// Key of the entry for page of pdf. Empty if the fingerprint of the page is not available.
+    static QByteArray const entryKey(PdfDoc const* pdf, int const page, QSize const& size, PagePart const part, CacheCodec const codec, QString const& renderCommand);
+    /// Read the entry with given key. Return nullptr if it does not exist.
+    /// Invalid entries are deleted. The caller owns the result.
+    static QByteArray const* load(QByteArray const& key);
+    /// Delete the entry with given key, e.g. because its data could not be decoded.
+    static void remove(QByteArray const& key);
+    /// Write bytes (encoded by ImageCodec) to the entry with given key.
+    /// This removes the least recently used entries if the budget is exceeded.
+    static void store(QByteArray const& key, QByteArray const& bytes);
+
+private:
+    /// Header of every entry.
+    struct Header {
+        /// "BPDC" as defined in diskcache.cpp.
+        quint32 magic;
+        /// Format version of the entry.
+        quint32 version;
+        /// entryKey: SHA-1 hash.
+        char key[20];
+    };
+    /// Directory containing all entries.
+    static QString const directory();
+    /// Path of the entry with given key.
+    static QString const entryPath(QByteArray const& key);
+    /// Delete the invalid entry at path.
+    static void discard(QString const& path);
+    /// Scan the directory and remove the least recently used entries until
+    /// the cache uses at most 3/4 of maxSize.
+    static void prune();
+    static std::atomic<bool> enabled;
+    static std::atomic<qint64> maxSize;
+    /// Size of all entries in bytes as estimated since the last scan, negative if unknown.
+    static std::atomic<qint64> usedSize;
+};
+
+#endif // DISKCACHE_H
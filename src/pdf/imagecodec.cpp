@@ -0,0 +1,325 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "imagecodec.h"
+#include <QBuffer>
+#include <QImageReader>
+#include <QPainter>
+#include <cstring>
+#include <limits>
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+/// Magic number of raw images ("BPRW").
+static constexpr quint32 rawMagic = 0x42505257;
+/// Magic number of images compressed with the built-in LZ codec ("BPLZ").
+static constexpr quint32 lzMagic = 0x42504c5a;
+/// Magic number of images compressed with LZ4 ("BPL4").
+static constexpr quint32 lz4Magic = 0x42504c34;
+
+// Tokens of the built-in LZ codec are 32 bit words: The upper 2 bits select
+// the operation, the lower 30 bits contain the number of pixels.
+// This is an LZ77 scheme restricted to the two offsets which matter for
+// slides: the previous pixel (uniform areas) and the pixel one row above
+// (vertical structures like text columns, frames and gradients).
+/// Literal: count pixels follow the token.
+static constexpr quint32 lzLiteral = 0u << 30;
+/// Fill: repeat the previous pixel count times.
+static constexpr quint32 lzFill = 1u << 30;
+/// Up: copy count pixels from the row above.
+static constexpr quint32 lzUp = 2u << 30;
+static constexpr quint32 lzCountMask = (1u << 30) - 1;
+/// Minimum length of a run. Shorter runs are stored as literals.
+static constexpr int lzMinRun = 2;
+/// Maximum width and height of raw and LZ encoded images.
+static constexpr quint32 maxDimension = 1 << 15;
+
+QByteArray const* ImageCodec::encode(QImage const& image, CacheCodec const codec)
+{
+    if (image.isNull())
+        return nullptr;
+    if (codec == PngCodec) {
+        QByteArray* bytes = new QByteArray();
+        QBuffer buffer(bytes);
+        buffer.open(QIODevice::WriteOnly);
+        if (!image.save(&buffer, "PNG")) {
+            delete bytes;
+            return nullptr;
+        }
+        return bytes;
+    }
+
+    // Raw and LZ codecs store 32 bit pixels without padding.
+    QImage const pixels = (
+                image.format() == QImage::Format_RGB32
+                || image.format() == QImage::Format_ARGB32
+                || image.format() == QImage::Format_ARGB32_Premultiplied
+            ) ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    Header const header {
+        codec == RawCodec ? rawMagic :
+#ifdef USE_LZ4
+            lz4Magic,
+#else
+            lzMagic,
+#endif
+        quint32(pixels.width()),
+        quint32(pixels.height()),
+        quint32(pixels.format())
+    };
+    int const dataSize = 4*pixels.width()*pixels.height();
+    QByteArray* bytes = new QByteArray();
+    bytes->reserve(int(sizeof(Header)) + (codec == RawCodec ? dataSize : dataSize/4));
+    bytes->append(reinterpret_cast<char const*>(&header), sizeof(Header));
+    if (codec == RawCodec) {
+        // Lines of 32 bit images are never padded, bytesPerLine == 4*width.
+        bytes->append(reinterpret_cast<char const*>(pixels.constBits()), dataSize);
+    }
+    else {
+#ifdef USE_LZ4
+        int const bound = LZ4_compressBound(dataSize);
+        bytes->resize(int(sizeof(Header)) + bound);
+        int const compressed = LZ4_compress_default(reinterpret_cast<char const*>(pixels.constBits()), bytes->data() + sizeof(Header), dataSize, bound);
+        if (compressed <= 0) {
+            delete bytes;
+            return nullptr;
+        }
+        bytes->resize(int(sizeof(Header)) + compressed);
+#else
+        compressPixels(reinterpret_cast<quint32 const*>(pixels.constBits()), pixels.width(), pixels.height(), *bytes);
+#endif
+    }
+    bytes->squeeze();
+    return bytes;
+}
+
+bool ImageCodec::validHeader(Header const& header, qint64 const dataSize)
+{
+    // Pixels are always copied as 32 bit words without padding. Other formats
+    // could make the image buffer smaller than the decoded data.
+    if (header.format != quint32(QImage::Format_RGB32)
+            && header.format != quint32(QImage::Format_ARGB32)
+            && header.format != quint32(QImage::Format_ARGB32_Premultiplied))
+        return false;
+    if (header.width == 0 || header.height == 0 || header.width > maxDimension || header.height > maxDimension)
+        return false;
+    // Sizes must be calculated in 64 bit: the header may contain arbitrary values.
+    qint64 const pixelBytes = 4*qint64(header.width)*qint64(header.height);
+    if (pixelBytes > std::numeric_limits<int>::max() - qint64(sizeof(Header)))
+        return false;
+    return header.magic != rawMagic || dataSize >= pixelBytes;
+}
+
+bool ImageCodec::isValid(QByteArray const& bytes)
+{
+    Header header;
+    if (bytes.size() >= int(sizeof(Header))) {
+        std::memcpy(&header, bytes.constData(), sizeof(Header));
+        if (header.magic == rawMagic || header.magic == lzMagic || header.magic == lz4Magic)
+            return validHeader(header, bytes.size() - qint64(sizeof(Header)));
+    }
+    QBuffer buffer;
+    buffer.setData(bytes);
+    buffer.open(QIODevice::ReadOnly);
+    return QImageReader(&buffer).canRead();
+}
+
+QImage const ImageCodec::decode(QByteArray const& bytes)
+{
+    Header header;
+    if (bytes.size() < int(sizeof(Header)))
+        return QImage();
+    std::memcpy(&header, bytes.constData(), sizeof(Header));
+    if (header.magic != rawMagic && header.magic != lzMagic && header.magic != lz4Magic)
+        return QImage::fromData(bytes);
+    if (!validHeader(header, bytes.size() - qint64(sizeof(Header)))) {
+        qWarning() << "Corrupt data in cache";
+        return QImage();
+    }
+    int const width = int(header.width), height = int(header.height);
+    QImage::Format const format = QImage::Format(header.format);
+    if (header.magic == rawMagic) {
+        // Share the data: the image keeps a (shallow) copy of bytes alive until it is destroyed.
+        QByteArray* keep = new QByteArray(bytes);
+        return QImage(
+                    reinterpret_cast<uchar const*>(keep->constData() + sizeof(Header)),
+                    width,
+                    height,
+                    4*width,
+                    format,
+                    [](void* info){delete static_cast<QByteArray*>(info);},
+                    keep
+                );
+    }
+    QImage image(width, height, format);
+    // The decompressors write 4*width*height bytes without padding.
+    if (image.isNull() || image.bytesPerLine() != 4*width) {
+        qWarning() << "Failed to allocate image of size" << width << "x" << height;
+        return QImage();
+    }
+    qint64 const capacity = qint64(image.bytesPerLine()) * image.height();
+    bool success;
+    if (header.magic == lzMagic)
+        success = decompressPixels(bytes.constData() + sizeof(Header), bytes.size() - int(sizeof(Header)), width, height, capacity, reinterpret_cast<quint32*>(image.bits()));
+    else {
+#ifdef USE_LZ4
+        int const dataSize = 4*width*height;
+        success = LZ4_decompress_safe(bytes.constData() + sizeof(Header), reinterpret_cast<char*>(image.bits()), bytes.size() - int(sizeof(Header)), int(capacity)) == dataSize;
+#else
+        qWarning() << "Cannot decode LZ4 data: BeamerPresenter was compiled without LZ4.";
+        return QImage();
+#endif
+    }
+    if (!success) {
+        qWarning() << "Corrupt data in cache";
+        return QImage();
+    }
+    return image;
+}
+
+QSize const ImageCodec::size(QByteArray const& bytes)
+{
+    Header header;
+    if (bytes.size() >= int(sizeof(Header))) {
+        std::memcpy(&header, bytes.constData(), sizeof(Header));
+        if (header.magic == rawMagic || header.magic == lzMagic || header.magic == lz4Magic)
+            return validHeader(header, bytes.size() - qint64(sizeof(Header))) ? QSize(int(header.width), int(header.height)) : QSize();
+    }
+    QBuffer buffer;
+    buffer.setData(bytes);
+    buffer.open(QIODevice::ReadOnly);
+    return QImageReader(&buffer).size();
+}
+
+QImage const ImageCodec::decodeTiles(QVector<EncodedTile> const& tiles, QSize const& size)
+{
+    if (tiles.size() == 1 && tiles.first().rect == QRect(QPoint(), size))
+        return decode(tiles.first().bytes);
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    for (EncodedTile const& tile : tiles)
+        painter.drawImage(tile.rect.topLeft(), decode(tile.bytes));
+    return image;
+}
+
+QImage const ImageCodec::scaled(QImage const& image, QSize const& size)
+{
+    if (image.isNull() || image.size() == size)
+        return image;
+    return image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void ImageCodec::compressPixels(quint32 const* pixels, int const width, int const height, QByteArray& out)
+{
+    int const n = width*height;
+    // Worst case: every literal pixel is followed by a run of lzMinRun pixels.
+    int const offset = out.size();
+    out.resize(offset + 4*(n + n/(lzMinRun+1) + 2));
+    char* const start = out.data() + offset;
+    char* dst = start;
+    auto const writeToken = [&dst](quint32 const token) {
+        std::memcpy(dst, &token, 4);
+        dst += 4;
+    };
+    int literalStart = 0, i = 0;
+    while (i < n) {
+        int fill = 0, up = 0;
+        if (i > 0) {
+            quint32 const previous = pixels[i-1];
+            while (i + fill < n && pixels[i+fill] == previous && quint32(fill) < lzCountMask)
+                fill++;
+        }
+        if (i >= width && fill < width) {
+            while (i + up < n && pixels[i+up] == pixels[i+up-width] && quint32(up) < lzCountMask)
+                up++;
+        }
+        int const run = std::max(fill, up);
+        if (run < lzMinRun) {
+            i++;
+            continue;
+        }
+        // Flush pending literals.
+        for (int begin = literalStart; begin < i;) {
+            int const count = std::min(i - begin, int(lzCountMask));
+            writeToken(lzLiteral | quint32(count));
+            std::memcpy(dst, pixels + begin, 4*size_t(count));
+            dst += 4*count;
+            begin += count;
+        }
+        writeToken((fill >= up ? lzFill : lzUp) | quint32(run));
+        i += run;
+        literalStart = i;
+    }
+    for (int begin = literalStart; begin < n;) {
+        int const count = std::min(n - begin, int(lzCountMask));
+        writeToken(lzLiteral | quint32(count));
+        std::memcpy(dst, pixels + begin, 4*size_t(count));
+        dst += 4*count;
+        begin += count;
+    }
+    out.resize(offset + int(dst - start));
+}
+
+bool ImageCodec::decompressPixels(char const* data, int const size, int const width, int const height, qint64 const capacity, quint32* pixels)
+{
+    if (4*qint64(width)*qint64(height) > capacity)
+        return false;
+    int const n = width*height;
+    char const* const end = data + size;
+    int i = 0;
+    while (i < n) {
+        if (end - data < 4)
+            return false;
+        quint32 token;
+        std::memcpy(&token, data, 4);
+        data += 4;
+        int const count = int(token & lzCountMask);
+        if (count > n - i)
+            return false;
+        switch (token & ~lzCountMask) {
+        case lzLiteral:
+            if (end - data < 4*count)
+                return false;
+            std::memcpy(pixels + i, data, 4*size_t(count));
+            data += 4*count;
+            break;
+        case lzFill:
+            if (i == 0)
+                return false;
+            std::fill(pixels + i, pixels + i + count, pixels[i-1]);
+            break;
+        case lzUp:
+        {
+            if (i < width)
+                return false;
+            // Source and destination overlap if count > width: copy row by row.
+            for (int done = 0; done < count;) {
+                int const chunk = std::min(count - done, width);
+                std::memcpy(pixels + i + done, pixels + i + done - width, 4*size_t(chunk));
+                done += chunk;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        i += count;
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGECODEC_H
+#define IMAGECODEC_H
+
+#include <QtDebug>
+#include <QImage>
+#include <QPixmap>
+#include <QByteArray>
+#include <QVector>
+#include "../enumerates.h"
+
+/// Encoded part of an image, e.g. a tile of a page rendered in tiled mode.
+struct EncodedTile {
+    /// Position of the tile in the image (pixels).
+    QRect rect;
+    /// Tile encoded using ImageCodec.
+    QByteArray bytes;
+};
+
+/// Encoding and decoding of rendered pages in the compressed cache.
+/// PNG is kept for compatibility (and as format of external renderers).
+/// The raw and LZ codecs store 32 bit pixels behind a small header, which
+/// makes decoding cheap enough to be done on every slide change.
+/// Decoding detects the format from the data, independent of the codec
+/// which is currently selected.
+class ImageCodec
+{
+public:
+    /// Encode image using the given codec. The caller owns the returned data.
+    /// Returns nullptr if encoding failed.
+    /// This is thread safe and should usually be called from a cache thread.
+    static QByteArray const* encode(QImage const& image, CacheCodec const codec);
+    /// Check whether data can be decoded safely. Only the header is read for
+    /// raw and LZ data. This should be used for data from untrusted sources,
+    /// e.g. the disk cache. Corrupt compressed data are detected by decode().
+    static bool isValid(QByteArray const& bytes);
+    /// Decode data created by encode() or an image in any format supported by QImage.
+    /// Returns a null image if the data are corrupt.
+    /// Raw data is not copied: the returned image shares the data of bytes.
+    static QImage const decode(QByteArray const& bytes);
+    /// Decode data to a pixmap. This should only be called from the main thread.
+    static QPixmap const decodePixmap(QByteArray const& bytes) {return QPixmap::fromImage(decode(bytes));}
+    /// Size (width and height) of an encoded image. Only the header is read for raw and LZ data.
+    static QSize const size(QByteArray const& bytes);
+    /// Decode tiles and compose them to an image of the given size. This is thread safe.
+    /// A single tile covering the whole image is decoded without copying.
+    static QImage const decodeTiles(QVector<EncodedTile> const& tiles, QSize const& size);
+    /// Downscale image to size by area averaging. This is thread safe.
+    /// Qt's smooth scaling is vectorized (SSE4.1, NEON), which makes deriving
+    /// a small page from a large one much cheaper than rendering it again.
+    static QImage const scaled(QImage const& image, QSize const& size);
+
+private:
+    /// Header of raw and LZ encoded images.
+    struct Header {
+        /// One of the magic numbers defined in imagecodec.cpp.
+        quint32 magic;
+        quint32 width;
+        quint32 height;
+        /// QImage::Format of the pixel data.
+        quint32 format;
+    };
+    /// Check format, size and data size (in bytes, without header) given in the header.
+    static bool validHeader(Header const& header, qint64 const dataSize);
+    /// Compress 32 bit pixels (appended to out).
+    static void compressPixels(quint32 const* pixels, int const width, int const height, QByteArray& out);
+    /// Decompress 32 bit pixels to a buffer of capacity bytes. Return false if the data are corrupt.
+    static bool decompressPixels(char const* data, int const size, int const width, int const height, qint64 const capacity, quint32* pixels);
+};
+
+#endif // IMAGECODEC_H
@@ -17,12 +17,32 @@
  */
 
 #include "pdfdoc.h"
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+
+/// Calculate the fingerprint of a single page of a loaded document in the background.
+class PageFingerprintJob : public QRunnable
+{
+    PdfDoc* const pdf;
+    int const page;
+public:
+    PageFingerprintJob(PdfDoc* pdf, int const page) : pdf(pdf), page(page) {}
+    void run() override
+    {
+        pdf->getFingerprint(page);
+        pdf->fingerprintJobFinished();
+    }
+};
 
 PdfDoc::~PdfDoc()
 {
-    qDeleteAll(pdfPages);
-    pdfPages.clear();
-    delete popplerDoc;
+    fingerprintPool.clear();
+    fingerprintPool.waitForDone();
+    // Pages which are still in use keep the document alive.
+    livePages.clear();
+    liveOrder.clear();
 }
 
 bool PdfDoc::loadDocument()
@@ -45,7 +65,7 @@ bool PdfDoc::loadDocument()
         qWarning() << "Interpreting the following file as PDF:" << pdfPath;
 
     // Check whether the file has been updated
-    if (popplerDoc != nullptr && QFileInfo(pdfPath).lastModified() <= lastModified)
+    if (!popplerDoc.isNull() && QFileInfo(pdfPath).lastModified() <= lastModified)
         return false;
 
     // Load the file
@@ -86,18 +106,38 @@ bool PdfDoc::loadDocument()
 #endif
 #endif
 
-    // Clear old lists
-    qDeleteAll(pdfPages);
-    pdfPages.clear();
-    labels.clear();
-
-    // Create lists of pages.
-    for (int i=0; i < newDoc->numPages(); i++) {
-        Poppler::Page* p = newDoc->page(i);
-        pdfPages.append(p);
-        labels.append(p->label());
+    // Read labels, sizes and durations of all pages in a first pass.
+    // Pages are only kept when they are needed (see getPage).
+    // This creates a Poppler::Page for every page, which parses the page
+    // dictionaries but not the contents. It is not deferred, because the
+    // label index (navigation by overlay groups) needs the labels of all pages.
+    QList<QString> newLabels;
+    QVector<QSizeF> newSizes;
+    QVector<double> newDurations;
+    int const numPages = newDoc->numPages();
+    newLabels.reserve(numPages);
+    newSizes.reserve(numPages);
+    newDurations.reserve(numPages);
+    for (int i=0; i < numPages; i++) {
+        Poppler::Page const* p = newDoc->page(i);
+        if (p == nullptr) {
+            qWarning() << "Failed to read page" << i;
+            newLabels.append(QString::number(i+1));
+            newSizes.append(newSizes.isEmpty() ? QSizeF(595., 842.) : newSizes.last());
+            newDurations.append(-1.);
+            continue;
+        }
+        newLabels.append(p->label());
+        newSizes.append(p->pageSizeF());
+        newDurations.append(p->duration());
+        delete p;
     }
 
+    // Jobs for the old document are not needed anymore.
+    fingerprintPool.clear();
+    fingerprintPool.waitForDone();
+    bool const firstLoad = popplerDoc.isNull();
+
     // Check document contents and print warnings if unimplemented features are found.
     if (newDoc->hasOptionalContent())
         qWarning() << "This file has optional content. Optional content is not supported.";
@@ -106,61 +146,241 @@ bool PdfDoc::loadDocument()
     if (newDoc->scripts().size() != 0)
         qWarning() << "This file contains JavaScript scripts. JavaScript is not supported.";
 
-    // Delete the old document and replace it by the new document.
-    delete popplerDoc;
-    popplerDoc = newDoc;
+    // Replace the old document and all lists in one critical section: getPage
+    // never combines the old document with new page numbers or vice versa.
+    // The old document and pages are deleted after the lock is released, when
+    // their last user releases them.
+    QSharedPointer<Poppler::Document> oldDoc;
+    QMap<int, QSharedPointer<Poppler::Page const>> oldPages;
+    {
+        QMutexLocker locker(&liveMutex);
+        oldDoc.swap(popplerDoc);
+        oldPages.swap(livePages);
+        liveOrder.clear();
+        popplerDoc = QSharedPointer<Poppler::Document>(newDoc);
+        labels.swap(newLabels);
+        pageSizes.swap(newSizes);
+        durations.swap(newDurations);
+        buildLabelIndex();
+    }
     lastModified = file.lastModified();
+    {
+        QMutexLocker locker(&fingerprintMutex);
+        // When reloading, the new pages are compared with the pages of the
+        // document which may still be cached: the previous document, or the
+        // document before it if the previous one has not been compared yet.
+        // The file has already changed, so fingerprints of the old document
+        // which are still missing cannot be calculated anymore. These pages
+        // count as changed.
+        if (!firstLoad && !comparing) {
+            previousFingerprints = fingerprints;
+            comparing = true;
+        }
+        fingerprints = QVector<QByteArray>(numPages);
+        fingerprintDoc = popplerDoc;
+    }
+    // The fingerprints of a reloaded document are calculated in the background.
+    // The caches are updated when the comparison has finished. After the first
+    // load, this waits until the first page has been shown.
+    if (!firstLoad)
+        fingerprintInBackground();
     return true;
 }
 
+void PdfDoc::fingerprintInBackground()
+{
+    fingerprintPool.clear();
+    fingerprintPool.waitForDone();
+    int const numPages = labels.size();
+    pendingFingerprints = numPages;
+    if (numPages == 0) {
+        compareFingerprints();
+        return;
+    }
+    // Fingerprints which were already calculated on demand are not calculated again.
+    fingerprintPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()/2));
+    for (int i=0; i<numPages; i++)
+        fingerprintPool.start(new PageFingerprintJob(this, i));
+}
+
+void PdfDoc::fingerprintJobFinished()
+{
+    if (pendingFingerprints.fetch_sub(1) == 1)
+        compareFingerprints();
+}
+
+void PdfDoc::compareFingerprints()
+{
+    {
+        QMutexLocker locker(&fingerprintMutex);
+        if (!comparing)
+            return;
+        for (int i=0; i<std::max(previousFingerprints.size(), fingerprints.size()); i++) {
+            if (i >= previousFingerprints.size() || i >= fingerprints.size() || previousFingerprints[i].isEmpty() || previousFingerprints[i] != fingerprints[i])
+                changedPages.insert(i);
+        }
+        previousFingerprints.clear();
+        comparing = false;
+    }
+    emit changesDetected();
+}
+
+QSet<int> const PdfDoc::takeChangedPages()
+{
+    QMutexLocker locker(&fingerprintMutex);
+    QSet<int> pages;
+    pages.swap(changedPages);
+    return pages;
+}
+
+QByteArray const PdfDoc::fingerprint(Poppler::Page const* page)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QSizeF const size = page->pageSizeF();
+    hash.addData(QByteArray::number(size.width()) + "x" + QByteArray::number(size.height()));
+    hash.addData(page->label().toUtf8());
+    // Most changes in slides are changes of the text.
+    hash.addData(page->text(QRectF()).toUtf8());
+    // Graphics are compared at low resolution. Changes of graphics usually
+    // change at least some antialiased pixels.
+    QImage const image = page->renderToImage(18., 18.);
+    for (int y=0; y<image.height(); y++)
+        hash.addData(reinterpret_cast<char const*>(image.constScanLine(y)), image.bytesPerLine());
+    // Links are invisible, but they must be updated as well.
+    QList<Poppler::Link*> const links = page->links();
+    for (Poppler::Link const* link : links) {
+        QRectF const area = link->linkArea();
+        hash.addData(QByteArray::number(int(link->linkType())) + " "
+                     + QByteArray::number(area.x()) + " " + QByteArray::number(area.y()) + " "
+                     + QByteArray::number(area.width()) + " " + QByteArray::number(area.height()));
+    }
+    qDeleteAll(links);
+    return hash.result();
+}
+
+QByteArray const PdfDoc::getFingerprint(int const page) const
+{
+    QSharedPointer<Poppler::Document> doc;
+    {
+        QMutexLocker locker(&fingerprintMutex);
+        if (page < 0 || page >= fingerprints.size())
+            return QByteArray();
+        if (!fingerprints[page].isEmpty())
+            return fingerprints[page];
+        doc = fingerprintDoc;
+    }
+    // Calculate the fingerprint without holding the lock. If two threads
+    // calculate the same fingerprint, both get the same result.
+    Poppler::Page const* p = doc->page(page);
+    if (p == nullptr)
+        return QByteArray();
+    QByteArray const result = fingerprint(p);
+    delete p;
+    QMutexLocker locker(&fingerprintMutex);
+    // The document may have been reloaded in the meantime.
+    if (fingerprintDoc == doc)
+        fingerprints[page] = result;
+    return result;
+}
+
 QSizeF const PdfDoc::getPageSize(int const pageNumber) const
 {
     // Return page size in point = inch/72
+    QMutexLocker locker(&liveMutex);
     if (pageNumber < 0)
-        return pdfPages[0]->pageSizeF();
-    if (pageNumber >= popplerDoc->numPages())
-        return pdfPages[popplerDoc->numPages()-1]->pageSizeF();
-    return pdfPages[pageNumber]->pageSizeF();
+        return pageSizes.first();
+    if (pageNumber >= pageSizes.size())
+        return pageSizes.last();
+    return pageSizes[pageNumber];
 }
 
-Poppler::Page const* PdfDoc::getPage(int pageNumber) const
+QSharedPointer<Poppler::Page const> const PdfDoc::getPage(int pageNumber) const
 {
-    // Check if page number is valid and return page.
+    QMutexLocker locker(&liveMutex);
+    // Check if page number is valid.
     if (pageNumber < 0)
-        return pdfPages[0];
-    if (pageNumber >= popplerDoc->numPages())
-        return pdfPages[popplerDoc->numPages()-1];
-    return pdfPages[pageNumber];
+        pageNumber = 0;
+    else if (pageNumber >= labels.size())
+        pageNumber = labels.size() - 1;
+    QSharedPointer<Poppler::Page const> page = livePages.value(pageNumber);
+    if (page.isNull()) {
+        // The page keeps the document alive, even if the document is reloaded in the meantime.
+        QSharedPointer<Poppler::Document> const doc = popplerDoc;
+        page = QSharedPointer<Poppler::Page const>(doc->page(pageNumber), [doc](Poppler::Page const* p){delete p;});
+        livePages[pageNumber] = page;
+        liveOrder.append(pageNumber);
+        // Forget the least recently used pages. Pages which are still in use are deleted when they are released.
+        while (liveOrder.size() > maxLivePages)
+            livePages.remove(liveOrder.takeFirst());
+    }
+    else {
+        // Mark the page as recently used.
+        liveOrder.removeOne(pageNumber);
+        liveOrder.append(pageNumber);
+    }
+    return page;
 }
 
-int PdfDoc::getNextSlideIndex(QString const& label) const
+void PdfDoc::buildLabelIndex()
+{
+    int const numPages = labels.size();
+    groupOfPage.resize(numPages);
+    groupStart.clear();
+    labelPages.clear();
+    for (int page=0; page<numPages; page++) {
+        if (page == 0 || labels[page] != labels[page-1])
+            groupStart.append(page);
+        groupOfPage[page] = groupStart.size() - 1;
+        QHash<QString, QPair<int, int>>::iterator it = labelPages.find(labels[page]);
+        if (it == labelPages.end())
+            labelPages.insert(labels[page], {page, page});
+        else
+            it->second = page;
+    }
+    groupStart.append(numPages);
+
+    // The previous slide ends at the last page of the previous group, but
+    // pages which are shown for less than one second are skipped.
+    int const numGroups = groupStart.size() - 1;
+    groupPreviousEnd.resize(numGroups);
+    for (int group=0; group<numGroups; group++) {
+        if (group == 0) {
+            groupPreviousEnd[group] = 0;
+            continue;
+        }
+        int const i = groupStart[group] - 1;
+        double duration = durations[i];
+        int j = i;
+        while (duration > -0.01 && duration < 1. && j > 0 && labels[j] == labels[i])
+            duration = durations[--j];
+        groupPreviousEnd[group] = j;
+    }
+}
+
+int PdfDoc::getNextSlideIndex(int const index) const
 {
     // Return the index of the next slide, which is not just an overlay of the current slide.
+    if (index < 0 || index >= groupOfPage.size())
+        return index;
+    return groupStart[groupOfPage[index] + 1];
+}
+
+int PdfDoc::getNextSlideIndex(QString const& label) const
+{
     // Labels could reoccur (e.g. if appendix slides start counting from 1 again).
-    // Returning labels.lastIndexOf(label) is therefore not the best solution.
-    int i = labels.indexOf(label);
-    if (i < 0)
-        return i;
-    for (; ++i < labels.size() && labels[i] == label;) {}
-    return i;
+    // This returns the end of the first sequence of pages with label.
+    int const first = getFirstPage(label);
+    if (first < 0)
+        return first;
+    return getNextSlideIndex(first);
 }
 
 int PdfDoc::getPreviousSlideEnd(int const index) const
 {
     // Return the index of the last overlay of the previous slide.
-    QString const& label = labels[index];
-    for (int i=index; i>=0; i--) {
-        if (label != labels[i]) {
-            // Get the duration. Avoid returning a page of duration of less than one second.
-            double duration = pdfPages[i]->duration();
-            int j = i;
-            // Don't return the index of a slides which is shown for less than one second.
-            while (duration > -0.01 && duration < 1. && j > 0 && labels[j] == labels[i])
-                duration = pdfPages[--j]->duration();
-            return j;
-        }
-    }
-    return 0;
+    if (index < 0 || index >= groupOfPage.size())
+        return 0;
+    return groupPreviousEnd[groupOfPage[index]];
 }
 
 int PdfDoc::destToSlide(QString const & dest) const
@@ -181,16 +401,16 @@ QString const& PdfDoc::getLabel(int const pageNumber) const
     // Check whether pageNumber is valid. Return its label.
     if (pageNumber < 0)
         return labels.first();
-    else if (pageNumber >= popplerDoc->numPages())
+    else if (pageNumber >= labels.size())
         return labels.last();
     else
         return labels[pageNumber];
 }
 
-Poppler::Page const* PdfDoc::getPage(QString const& pageLabel) const
+QSharedPointer<Poppler::Page const> const PdfDoc::getPage(QString const& pageLabel) const
 {
-    int const idx = labels.indexOf(pageLabel);
-    if (idx > 0)
-        return pdfPages[idx];
-    return nullptr;
+    int const idx = getFirstPage(pageLabel);
+    if (idx >= 0)
+        return getPage(idx);
+    return QSharedPointer<Poppler::Page const>();
 }
@@ -20,11 +20,21 @@
 #define PDFWIDGET_H
 
 #include <QtDebug>
+#include <QObject>
+#include <atomic>
 #include <iostream>
 #include <QFileInfo>
 #include <poppler-qt5.h>
 #include <QDomDocument>
 #include <QInputDialog>
+#include <QSet>
+#include <QVector>
+#include <QMap>
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include <QThreadPool>
+#include <QSharedPointer>
 #include "../enumerates.h"
 
 #if __has_include(<poppler-version.h>)
@@ -41,57 +51,146 @@
 
 
 /// PDF document.
-/// This provides an interface for caching all Poppler::Page objects and reloading files.
-class PdfDoc
+/// This provides an interface for reloading files and for Poppler::Page objects.
+/// Labels, sizes and durations of all pages are read when loading the document.
+/// Poppler::Page objects are only created when they are needed and the most
+/// recently used ones are kept.
+/// Fingerprints of all pages are calculated in the background. After reloading,
+/// the new fingerprints are compared with those of the previous document and
+/// changesDetected() is emitted.
+class PdfDoc : public QObject
 {
+    Q_OBJECT
+    friend class PageFingerprintJob;
+
 private:
-    /// Poppler PDF document or nullptr if no document is loaded.
-    Poppler::Document* popplerDoc = nullptr;
+    /// Poppler PDF document or null if no document is loaded.
+    /// Pages which are in use hold a reference to their document.
+    QSharedPointer<Poppler::Document> popplerDoc;
     /// Path to PDF file.
     QString pdfPath;
-    /// List of all PDF pages.
-    QList<Poppler::Page*> pdfPages;
+    /// Recently used pages. Access is protected by liveMutex.
+    mutable QMap<int, QSharedPointer<Poppler::Page const>> livePages;
+    /// Keys of livePages, least recently used first.
+    mutable QList<int> liveOrder;
+    /// Pages are requested from the main thread and from the RenderPool.
+    /// This also protects popplerDoc, labels, pageSizes, durations and the
+    /// label index while they are replaced. The main thread, which replaces
+    /// them, reads them without locking.
+    mutable QMutex liveMutex;
+    /// Maximum number of pages in livePages.
+    static constexpr int maxLivePages = 32;
+    /// Size of all pages in point.
+    QVector<QSizeF> pageSizes;
+    /// Duration of all pages in seconds (negative if undefined).
+    QVector<double> durations;
+
+    // Label index. An overlay group is a maximal sequence of pages with equal labels.
+    /// Overlay group of each page.
+    QVector<int> groupOfPage;
+    /// First page of each overlay group, followed by the number of pages.
+    QVector<int> groupStart;
+    /// Result of getPreviousSlideEnd for the pages of each overlay group.
+    QVector<int> groupPreviousEnd;
+    /// First and last page with each label.
+    QHash<QString, QPair<int, int>> labelPages;
+    /// Build the label index from labels and durations.
+    void buildLabelIndex();
     /// Last time of modification of the file in the form which was last loaded.
     /// This is used to check whether it needs to be reloaded.
     QDateTime lastModified = QDateTime();
     /// List of labels
     QList<QString> labels;
+    /// Fingerprints of all pages of the loaded document. Empty entries have not been calculated yet.
+    /// Access is protected by fingerprintMutex.
+    mutable QVector<QByteArray> fingerprints;
+    /// Document to which the fingerprints belong. Access is protected by fingerprintMutex.
+    QSharedPointer<Poppler::Document> fingerprintDoc;
+    /// Fingerprints are requested from the main thread and from worker threads.
+    mutable QMutex fingerprintMutex;
+    /// Calculates the fingerprints of a newly loaded document in the background,
+    /// while the file still matches the document.
+    QThreadPool fingerprintPool;
+    /// Number of jobs in fingerprintPool which have not finished yet.
+    std::atomic<int> pendingFingerprints {0};
+    /// Fingerprints of the document of which pages may still be cached, while
+    /// the fingerprints of a reloaded document are calculated. Access is
+    /// protected by fingerprintMutex.
+    QVector<QByteArray> previousFingerprints;
+    /// True while previousFingerprints waits for the comparison.
+    bool comparing = false;
+    /// Pages which have changed in reloads and were not taken yet.
+    /// Access is protected by fingerprintMutex.
+    QSet<int> changedPages;
+    /// Start calculating the fingerprints of all pages in fingerprintPool.
+    void startFingerprintJobs();
+    /// Called by the fingerprint jobs. The last job compares the fingerprints.
+    void fingerprintJobFinished();
+    /// Compare the fingerprints with previousFingerprints and emit changesDetected().
+    void compareFingerprints();
 
 public:
     /// Constructor: takes the path to the PDF file as argument. This does not load the document.
-    PdfDoc(QString const& pathToPdf) : pdfPath(pathToPdf) {}
+    PdfDoc(QString const& pathToPdf, QObject* parent = nullptr) : QObject(parent), pdfPath(pathToPdf) {}
     ~PdfDoc();
     /// Load the document. Returns true if the document was loaded successfully and false otherwise.
     bool loadDocument();
 
     /// Return a pointer to the PDF document.
-    Poppler::Document const* getDoc() const {return popplerDoc;}
-    /// Return a pointer to a constant list of all pages.
-    QList<Poppler::Page*> const* getPages() const {return &pdfPages;}
-    /// Check if page number is valid and return page.
-    Poppler::Page const* getPage(int pageNumber) const;
-    /// Check if page label is valid and return page.
-    Poppler::Page const* getPage(QString const& pageLabel) const;
+    Poppler::Document const* getDoc() const {return popplerDoc.data();}
+    /// Number of pages.
+    int numPages() const {return labels.size();}
+    /// Return page. Invalid page numbers are replaced by the first or last page.
+    /// The page is created if necessary. This is thread safe.
+    QSharedPointer<Poppler::Page const> const getPage(int pageNumber) const;
+    /// Check if page label is valid and return page or a null pointer.
+    QSharedPointer<Poppler::Page const> const getPage(QString const& pageLabel) const;
     /// Modification date as string.
     QDateTime const& getLastModified() const {return lastModified;}
+    /// Calculate the fingerprints of all pages in the background. This should be
+    /// called after the first page has been shown. After reloading, this is done
+    /// automatically. Half of the cores are left for rendering.
+    void fingerprintInBackground();
+    /// Take the pages which have changed in reloads since the last call,
+    /// including pages which were added or removed. This is thread safe.
+    QSet<int> const takeChangedPages();
+    /// Fingerprint of a page: a hash of its size, label, text, links and a rendering at low resolution.
+    /// This is thread safe.
+    static QByteArray const fingerprint(Poppler::Page const* page);
+    /// Fingerprint of a page of the loaded document. It is calculated now if the background
+    /// calculation has not reached the page yet. Empty for invalid page numbers. This is thread safe.
+    QByteArray const getFingerprint(int const page) const;
     /// Return the QDomDocument representing the table of contents (TOC) of the PDF document.
     QDomDocument const* getToc() const {return popplerDoc->toc();}
-    /// Return page size in point = inch/72.
+    /// Return page size in point = inch/72. This is thread safe.
     QSizeF const getPageSize(int const pageNumber) const;
     /// Return label of given page.
     QString const& getLabel(int const pageNumber) const;
     /// Return page index (number) of the next page with a different page label.
-    int getNextSlideIndex(int const index) const {return getNextSlideIndex(labels[index]);}
-    /// Return page index (number) of the next page with a different page label.
+    int getNextSlideIndex(int const index) const;
+    /// Return page index (number) of the first page after the first sequence of pages with label.
+    /// Return -1 if no page has this label.
     int getNextSlideIndex(QString const& label) const;
     /// Return page index (number) of the previous page with a different page label.
     /// This function skips slides which have a duration of less than one second.
     int getPreviousSlideEnd(int const index) const;
+    /// Return index of the first page with label or -1 if no page has this label.
+    int getFirstPage(QString const& label) const {return labelPages.value(label, {-1, -1}).first;}
+    /// Return index of the last page with label or -1 if no page has this label.
+    int getLastPage(QString const& label) const {return labelPages.value(label, {-1, -1}).second;}
+    /// Return the overlay group of a page: pages in the same group have the same label
+    /// and are not separated by pages with other labels.
+    int getOverlayGroup(int const index) const {return groupOfPage[index];}
     /// Return page index (number) of a destination string (from table of contents).
     /// Return -1 if an invalid destination string is given.
     int destToSlide(QString const& dest) const;
     /// Return the path to the PDF file.
     QString const& getPath() const {return pdfPath;}
+
+signals:
+    /// Emitted (possibly from a worker thread) when the comparison of the
+    /// fingerprints after a reload has finished. See takeChangedPages().
+    void changesDetected();
 };
 
 #endif // PDFWIDGET_H
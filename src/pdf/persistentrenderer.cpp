@@ -0,0 +1,130 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "persistentrenderer.h"
+#include <QMap>
+#include <QtEndian>
+
+std::atomic<int> PersistentRenderer::generation {0};
+
+/// Renderer processes of one thread, keyed by command. They are deleted when the thread exits.
+struct ThreadRenderers
+{
+    QMap<QString, PersistentRenderer*> map;
+    ~ThreadRenderers() {qDeleteAll(map);}
+};
+static thread_local ThreadRenderers threadRenderers;
+
+QByteArray const* PersistentRenderer::render(QString const& command, int const page, int const width, int const height)
+{
+    PersistentRenderer*& renderer = threadRenderers.map[command];
+    if (renderer == nullptr)
+        renderer = new PersistentRenderer(command);
+    return renderer->request(page, width, height);
+}
+
+PersistentRenderer::~PersistentRenderer()
+{
+    if (process.state() == QProcess::NotRunning)
+        return;
+    // Closing standard input asks the renderer to quit.
+    process.closeWriteChannel();
+    if (!process.waitForFinished(1000))
+        stop();
+}
+
+bool PersistentRenderer::start()
+{
+    if (process.state() != QProcess::NotRunning) {
+        if (startedGeneration == generation)
+            return true;
+        stop();
+    }
+    startedGeneration = generation;
+    // Messages of the renderer are shown on the terminal.
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.start(command);
+    if (!process.waitForStarted(10000)) {
+        qWarning() << "Failed to start external renderer:" << command;
+        stop();
+        return false;
+    }
+    return true;
+}
+
+QByteArray const* PersistentRenderer::request(int const page, int const width, int const height)
+{
+    if (!start())
+        return nullptr;
+    QElapsedTimer timer;
+    timer.start();
+    process.write(QString("%1 %2 %3\n").arg(page+1).arg(width).arg(height).toUtf8());
+    if (!process.waitForBytesWritten(timeout)) {
+        qWarning() << "Sending request to external renderer failed.";
+        stop();
+        return nullptr;
+    }
+    uchar header[4];
+    if (!read(reinterpret_cast<char*>(header), 4, timer)) {
+        qWarning() << "External renderer did not answer.";
+        stop();
+        return nullptr;
+    }
+    quint32 const size = qFromBigEndian<quint32>(header);
+    if (size == 0) {
+        qWarning() << "External renderer failed to render page" << page+1;
+        return nullptr;
+    }
+    if (size >= (1u << 30)) {
+        // This is not a valid reply. Restart the renderer to resynchronize.
+        qWarning() << "Invalid reply of external renderer.";
+        stop();
+        return nullptr;
+    }
+    QByteArray* bytes = new QByteArray(int(size), Qt::Uninitialized);
+    if (!read(bytes->data(), size, timer)) {
+        qWarning() << "External renderer did not answer.";
+        delete bytes;
+        stop();
+        return nullptr;
+    }
+    return bytes;
+}
+
+bool PersistentRenderer::read(char* data, qint64 size, QElapsedTimer const& timer)
+{
+    while (size > 0) {
+        if (process.bytesAvailable() == 0) {
+            qint64 const remaining = timeout - timer.elapsed();
+            if (remaining <= 0 || !process.waitForReadyRead(int(remaining)))
+                return false;
+        }
+        qint64 const received = process.read(data, size);
+        if (received < 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+void PersistentRenderer::stop()
+{
+    process.kill();
+    process.waitForFinished(1000);
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERSISTENTRENDERER_H
+#define PERSISTENTRENDERER_H
+
+#include <atomic>
+#include <QtDebug>
+#include <QProcess>
+#include <QElapsedTimer>
+
+/// Long-lived external renderer process (persistent renderer mode).
+///
+/// The renderer is started once per document with the command in which only
+/// %file has been replaced. It then reads render requests from standard
+/// input, one request per line:
+///     <page> <width> <height>
+/// The page number starts at 1, width and height are the full page size in
+/// pixels (as %width and %height in the per-page mode). For every request the
+/// renderer writes the size of the image in bytes as 4 byte big endian
+/// integer to standard output, followed by the image data in PNG, binary PPM
+/// or any other format readable by Qt. A size of 0 reports a failure.
+///
+/// QProcess objects can only be used in the thread which created them.
+/// Therefore every worker thread of the RenderPool keeps its own processes.
+class PersistentRenderer
+{
+public:
+    /// Render page using a persistent renderer process started with command.
+    /// The process belongs to the calling thread and is kept alive for the
+    /// following requests. Returns nullptr if rendering failed.
+    static QByteArray const* render(QString const& command, int const page, int const width, int const height);
+    /// Restart all renderer processes before their next request.
+    /// This is required when the PDF files have changed.
+    static void restartAll() {generation++;}
+    /// Destructor: stop the renderer.
+    ~PersistentRenderer();
+
+private:
+    explicit PersistentRenderer(QString const& command) : command(command) {}
+    /// Start the process if it is not running or outdated. Return false if this fails.
+    bool start();
+    /// Send a request and read the reply.
+    QByteArray const* request(int const page, int const width, int const height);
+    /// Read exactly size bytes from the renderer. Return false on timeout or error.
+    bool read(char* data, qint64 size, QElapsedTimer const& timer);
+    /// Kill the renderer. It is restarted with the next request.
+    void stop();
+
+    QProcess process;
+    /// Command starting the renderer.
+    QString const command;
+    /// Value of generation when the process was started.
+    int startedGeneration = -1;
+    /// Incremented by restartAll.
+    static std::atomic<int> generation;
+    /// Maximum time in ms for rendering a single page.
+    static constexpr int timeout = 60000;
+};
+
+#endif // PERSISTENTRENDERER_H
@@ -0,0 +1,305 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "renderpool.h"
+#include <QCoreApplication>
+#include <QThread>
+#include "externalrenderer.h"
+#include "persistentrenderer.h"
+#include "diskcache.h"
+
+RenderJob::RenderJob(BasicRenderer* renderer, int const page, bool const keepImage) :
+    QObject(),
+    renderer(renderer),
+    owner(renderer),
+    page(page),
+    resolution(renderer->getResolution()),
+    tile(-1),
+    pdf(renderer->getDoc()),
+    pagePart(renderer->getPagePart()),
+    codec(renderer->getCodec()),
+    command(renderer->getRenderCommand(page)),
+    renderSize(renderer->getRenderSize(page)),
+    persistent(!command.isEmpty() && RenderPool::instance()->getRendererWorkers() > 0),
+    keepImage(keepImage),
+    encoded(),
+    targetSize(),
+    sourceTiles(),
+    sourceSize(),
+    tileRect(),
+    diskCache(renderer->usesDiskCache())
+{
+    setAutoDelete(false);
+}
+
+RenderJob::RenderJob(BasicRenderer* renderer, int const page, QByteArray const& encoded) :
+    QObject(),
+    renderer(renderer),
+    owner(renderer),
+    page(page),
+    resolution(renderer->getResolution()),
+    tile(-1),
+    pdf(renderer->getDoc()),
+    pagePart(renderer->getPagePart()),
+    codec(renderer->getCodec()),
+    command(),
+    renderSize(),
+    persistent(false),
+    keepImage(true),
+    encoded(encoded),
+    targetSize(),
+    sourceTiles(),
+    sourceSize(),
+    tileRect(),
+    diskCache(false)
+{
+    setAutoDelete(false);
+}
+
+RenderJob::RenderJob(BasicRenderer* renderer, int const page, QVector<EncodedTile> const& source, QSize const& sourceSize, QSize const& size, bool const keepImage) :
+    QObject(),
+    renderer(renderer),
+    owner(renderer),
+    page(page),
+    resolution(renderer->getResolution()),
+    tile(-1),
+    pdf(renderer->getDoc()),
+    pagePart(renderer->getPagePart()),
+    codec(renderer->getCodec()),
+    command(),
+    renderSize(),
+    persistent(false),
+    keepImage(keepImage),
+    encoded(),
+    targetSize(size),
+    sourceTiles(source),
+    sourceSize(sourceSize),
+    tileRect(),
+    diskCache(false)
+{
+    setAutoDelete(false);
+}
+
+RenderJob::RenderJob(BasicRenderer* renderer, int const page, int const tile, QRect const& rect) :
+    QObject(),
+    renderer(renderer),
+    owner(renderer),
+    page(page),
+    resolution(renderer->getResolution()),
+    tile(tile),
+    pdf(renderer->getDoc()),
+    pagePart(renderer->getPagePart()),
+    codec(renderer->getCodec()),
+    command(),
+    renderSize(),
+    persistent(false),
+    keepImage(true),
+    encoded(),
+    targetSize(),
+    sourceTiles(),
+    sourceSize(),
+    tileRect(rect),
+    diskCache(false)
+{
+    setAutoDelete(false);
+}
+
+void RenderJob::run()
+{
+    if (isDecodeJob()) {
+        if (!cancelled)
+            image = ImageCodec::decode(encoded);
+    }
+    else if (isDownscaleJob()) {
+        if (!cancelled) {
+            QImage const scaled = ImageCodec::scaled(ImageCodec::decodeTiles(sourceTiles, sourceSize), targetSize);
+            if (!cancelled)
+                bytes = ImageCodec::encode(scaled, codec);
+            if (keepImage)
+                image = scaled;
+        }
+    }
+    else if (isTileJob()) {
+        if (!cancelled)
+            image = BasicRenderer::renderTile(pdf, page, resolution, pagePart, tileRect);
+        if (!cancelled)
+            bytes = ImageCodec::encode(image, codec);
+    }
+    else if (!cancelled) {
+        // Pages in the disk cache are only read, which is much faster than rendering.
+        // The key is calculated here, because it needs the fingerprint of the page.
+        QByteArray const diskKey = diskCache ? DiskCache::entryKey(pdf, page, renderSize, pagePart, codec, command) : QByteArray();
+        QByteArray const* newBytes = diskKey.isEmpty() ? nullptr : DiskCache::load(diskKey);
+        if (newBytes != nullptr && keepImage) {
+            image = ImageCodec::decode(*newBytes);
+            if (image.isNull()) {
+                // The entry passed the checks of its header, but its data are corrupt.
+                DiskCache::remove(diskKey);
+                delete newBytes;
+                newBytes = nullptr;
+            }
+        }
+        bool const fromDisk = newBytes != nullptr;
+        if (fromDisk) {
+            // Nothing to render.
+        }
+        else if (command.isEmpty()) {
+            QImage const rendered = BasicRenderer::renderImage(pdf, page, resolution, pagePart);
+            if (!cancelled)
+                newBytes = ImageCodec::encode(rendered, codec);
+            if (keepImage)
+                image = rendered;
+        }
+        else {
+            QByteArray const* png = nullptr;
+            if (persistent)
+                png = PersistentRenderer::render(command, page, renderSize.width(), renderSize.height());
+            else {
+                ExternalRenderer process(page);
+                process.start(command);
+                if (process.waitForFinished(60000))
+                    png = process.getBytes();
+                else
+                    process.kill();
+            }
+            // Crop the image and convert it to the format of the cache if necessary.
+            newBytes = BasicRenderer::processExternalImage(png, pagePart, codec);
+            if (keepImage && newBytes != nullptr)
+                image = ImageCodec::decode(*newBytes);
+        }
+        // Only freshly rendered pages are written to the disk cache.
+        if (newBytes != nullptr && !fromDisk && !diskKey.isEmpty() && !cancelled)
+            DiskCache::store(diskKey, *newBytes);
+        delete bytes;
+        bytes = newBytes;
+    }
+    emit finished(this);
+}
+
+QByteArray const* RenderJob::takeBytes()
+{
+    QByteArray const* returnBytes = bytes;
+    bytes = nullptr;
+    return returnBytes;
+}
+
+RenderPool::RenderPool(QObject* parent) : QObject(parent)
+{
+    pool.setExpiryTimeout(-1);
+    // Threads of the renderer pool own renderer processes: never let them expire.
+    rendererPool.setExpiryTimeout(-1);
+}
+
+RenderPool* RenderPool::instance()
+{
+    // The pool is deleted together with the application.
+    static RenderPool* renderPool = new RenderPool(QCoreApplication::instance());
+    return renderPool;
+}
+
+void RenderPool::setWorkers(int const number)
+{
+    pool.setMaxThreadCount(number < 1 ? QThread::idealThreadCount() : number);
+}
+
+void RenderPool::setRendererWorkers(int const number)
+{
+    rendererWorkers = number < 0 ? 0 : number;
+    if (rendererWorkers > 0)
+        rendererPool.setMaxThreadCount(rendererWorkers);
+}
+
+void RenderPool::restartRenderers()
+{
+    PersistentRenderer::restartAll();
+}
+
+void RenderPool::submit(BasicRenderer* renderer, int const page, int const priority, bool const keepImage)
+{
+    RenderJob* job = new RenderJob(renderer, page, keepImage);
+    connect(job, &RenderJob::finished, this, &RenderPool::receiveJob, Qt::QueuedConnection);
+    jobs.append(job);
+#ifdef DEBUG_CACHE
+    qDebug() << "Submit render job" << page << priority << renderer << jobs.size();
+#endif
+    poolFor(job).start(job, priority);
+}
+
+void RenderPool::submitDecode(BasicRenderer* renderer, int const page, QByteArray const& encoded)
+{
+    RenderJob* job = new RenderJob(renderer, page, encoded);
+    connect(job, &RenderJob::finished, this, &RenderPool::receiveJob, Qt::QueuedConnection);
+    jobs.append(job);
+    pool.start(job, decodePriority);
+}
+
+void RenderPool::submitDownscale(BasicRenderer* renderer, int const page, QVector<EncodedTile> const& source, QSize const& sourceSize, QSize const& size, int const priority, bool const keepImage)
+{
+    RenderJob* job = new RenderJob(renderer, page, source, sourceSize, size, keepImage);
+    connect(job, &RenderJob::finished, this, &RenderPool::receiveJob, Qt::QueuedConnection);
+    jobs.append(job);
+    pool.start(job, priority);
+}
+
+void RenderPool::submitTile(BasicRenderer* renderer, int const page, int const tile, QRect const& rect, int const priority)
+{
+    RenderJob* job = new RenderJob(renderer, page, tile, rect);
+    connect(job, &RenderJob::finished, this, &RenderPool::receiveJob, Qt::QueuedConnection);
+    jobs.append(job);
+    pool.start(job, priority);
+}
+
+void RenderPool::prioritize(BasicRenderer const* renderer, int const page, int const priority)
+{
+    for (RenderJob* job : jobs) {
+        if (job->owner == renderer && job->page == page && !job->isDecodeJob() && !job->isCancelled()) {
+            // Only jobs which have not started yet can be taken from the queue.
+            if (poolFor(job).tryTake(job))
+                poolFor(job).start(job, priority);
+            // Pages rendered as tiles have several jobs.
+            if (!job->isTileJob())
+                return;
+        }
+    }
+}
+
+void RenderPool::cancel(BasicRenderer const* renderer)
+{
+    for (QList<RenderJob*>::iterator it=jobs.begin(); it!=jobs.end();) {
+        if ((*it)->owner != renderer)
+            it++;
+        else if (poolFor(*it).tryTake(*it)) {
+            // The job has not started yet.
+            delete *it;
+            it = jobs.erase(it);
+        }
+        else {
+            // The job is running or waiting to be received.
+            (*it)->cancel();
+            it++;
+        }
+    }
+}
+
+void RenderPool::receiveJob(RenderJob* job)
+{
+    jobs.removeOne(job);
+    if (!job->isCancelled() && !job->renderer.isNull())
+        job->renderer->receiveJob(job);
+    delete job;
+}
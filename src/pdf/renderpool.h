@@ -0,0 +1,182 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDERPOOL_H
+#define RENDERPOOL_H
+
+#include <atomic>
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QPointer>
+#include "basicrenderer.h"
+
+/// Job rendering a single page for a BasicRenderer in the RenderPool.
+/// Everything needed for rendering is copied when the job is created, such
+/// that the renderer can be changed or deleted while the job is running.
+/// A job can also decode an already rendered page (decode job).
+class RenderJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    /// Constructor: take page, resolution, page part, codec and render command from renderer.
+    /// If keepImage is true, the rendered image is also kept in decoded form.
+    RenderJob(BasicRenderer* renderer, int const page, bool const keepImage = false);
+    /// Constructor for a decode job: decode encoded, which was rendered by renderer.
+    RenderJob(BasicRenderer* renderer, int const page, QByteArray const& encoded);
+    /// Constructor for a downscale job: compose source (tiles of a page of size sourceSize),
+    /// scale it to size and encode it for renderer.
+    RenderJob(BasicRenderer* renderer, int const page, QVector<EncodedTile> const& source, QSize const& sourceSize, QSize const& size, bool const keepImage);
+    /// Constructor for a tile job: render the rectangle rect (tile number tile) of page using poppler.
+    RenderJob(BasicRenderer* renderer, int const page, int const tile, QRect const& rect);
+    /// Destructor: delete the result if it was not picked up.
+    ~RenderJob() override {delete bytes;}
+    /// Render the page, encode it and save the result in bytes.
+    void run() override;
+    /// Mark this job as cancelled. A cancelled job stops as soon as possible and its result is dropped.
+    void cancel() {cancelled = true;}
+    bool isCancelled() const {return cancelled;}
+    /// Return the result and set bytes to nullptr. The caller owns the result.
+    QByteArray const* takeBytes();
+    /// Decoded image: result of decode jobs or of render jobs with keepImage.
+    QImage const& getImage() const {return image;}
+    /// Is this a decode job?
+    bool isDecodeJob() const {return !encoded.isNull() && !targetSize.isValid();}
+    /// Is this a downscale job?
+    bool isDownscaleJob() const {return targetSize.isValid();}
+    /// Is this a tile job?
+    bool isTileJob() const {return tile >= 0;}
+    /// Does this job use a persistent external renderer?
+    bool usesPersistentRenderer() const {return persistent;}
+
+    /// Renderer which requested this job. This is set to nullptr if the renderer is deleted.
+    QPointer<BasicRenderer> const renderer;
+    /// Renderer which requested this job. Only used for comparison.
+    BasicRenderer const* const owner;
+    /// Page index.
+    int const page;
+    /// Resolution at which the page is rendered.
+    qreal const resolution;
+    /// Tile number of tile jobs, -1 for other jobs.
+    int const tile;
+
+private:
+    PdfDoc const* const pdf;
+    PagePart const pagePart;
+    CacheCodec const codec;
+    /// Command for external renderer or empty string.
+    QString const command;
+    /// Size of the full page requested from the external renderer.
+    QSize const renderSize;
+    /// Use a persistent renderer instead of starting command for this page.
+    bool const persistent;
+    /// Keep the rendered image in image.
+    bool const keepImage;
+    /// Input of a decode job.
+    QByteArray const encoded;
+    /// Size of the result of a downscale job, invalid for other jobs.
+    QSize const targetSize;
+    /// Input of a downscale job: a complete page or the tiles of a tiled page.
+    QVector<EncodedTile> const sourceTiles;
+    /// Size of the page composed from sourceTiles.
+    QSize const sourceSize;
+    /// Rectangle rendered by a tile job (in pixels).
+    QRect const tileRect;
+    /// Read and write the page in the disk cache.
+    bool const diskCache;
+    /// Encoded image, result of this job.
+    QByteArray const* bytes = nullptr;
+    /// Decoded image, result of decode jobs or of render jobs with keepImage.
+    QImage image;
+    std::atomic<bool> cancelled {false};
+
+signals:
+    /// Emitted in the worker thread when run() is done (also if the job was cancelled).
+    void finished(RenderJob* job);
+};
+
+/// Thread pool shared by all renderers.
+/// Pages of all caches are rendered as RenderJobs in a common queue, which is
+/// ordered by priority. The number of worker threads is configurable.
+/// Jobs using persistent external renderers run in a separate queue. Its
+/// worker threads each keep one renderer process per document alive.
+class RenderPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// Priority of pages which are required immediately (e.g. by the magnifier).
+    static constexpr int immediatePriority = 1 << 20;
+    /// Priority of decode jobs. Decoding is fast and its result is needed soon.
+    static constexpr int decodePriority = immediatePriority - 1;
+
+    /// Get the render pool. It is created when this is first called.
+    static RenderPool* instance();
+    /// Set number of worker threads. A number < 1 selects the number of CPU cores.
+    void setWorkers(int const number);
+    /// Number of worker threads.
+    int getWorkers() const {return pool.maxThreadCount();}
+    /// Set number of persistent external renderer processes per document.
+    /// 0 disables persistent renderers: a new process is started for every page.
+    void setRendererWorkers(int const number);
+    /// Number of persistent external renderer processes per document (0 if disabled).
+    int getRendererWorkers() const {return rendererWorkers;}
+    /// Restart persistent renderers, e.g. after the PDF files have changed.
+    void restartRenderers();
+    /// Render page for renderer with given priority (larger numbers first).
+    /// The result is handed to BasicRenderer::receiveJob in the main thread.
+    void submit(BasicRenderer* renderer, int const page, int const priority, bool const keepImage = false);
+    /// Decode encoded page for renderer. The result is handed to BasicRenderer::receiveJob.
+    void submitDecode(BasicRenderer* renderer, int const page, QByteArray const& encoded);
+    /// Derive page for renderer by downscaling source (the tiles of an encoded page of higher
+    /// resolution, which has size sourceSize) to size.
+    /// The result is handed to BasicRenderer::receiveJob like the result of a render job.
+    void submitDownscale(BasicRenderer* renderer, int const page, QVector<EncodedTile> const& source, QSize const& sourceSize, QSize const& size, int const priority, bool const keepImage = false);
+    /// Render the rectangle rect (tile number tile) of page for renderer.
+    /// The result is handed to BasicRenderer::receiveJob.
+    void submitTile(BasicRenderer* renderer, int const page, int const tile, QRect const& rect, int const priority);
+    /// Move queued render jobs (or tile jobs) of renderer for page to the given priority.
+    /// Nothing is done for jobs which are already running.
+    void prioritize(BasicRenderer const* renderer, int const page, int const priority);
+    /// Cancel all jobs of renderer. Cancelled jobs are never reported to the renderer.
+    void cancel(BasicRenderer const* renderer);
+    /// Wait until all jobs are done. Return false if this timed out.
+    bool waitForDone(int const msecs) {return pool.waitForDone(msecs) && rendererPool.waitForDone(msecs);}
+    /// Number of jobs which are queued or running.
+    int queuedJobs() const {return jobs.size();}
+
+private:
+    explicit RenderPool(QObject* parent = nullptr);
+    /// Worker threads.
+    QThreadPool pool;
+    /// Worker threads of persistent external renderers.
+    QThreadPool rendererPool;
+    /// Number of persistent renderer processes per document, 0 if disabled.
+    int rendererWorkers = 0;
+    /// Pool in which job is executed.
+    QThreadPool& poolFor(RenderJob const* job) {return job->usesPersistentRenderer() ? rendererPool : pool;}
+    /// All jobs which have been submitted and not yet received.
+    QList<RenderJob*> jobs;
+
+private slots:
+    /// Hand the result of a finished job to its renderer and delete the job.
+    void receiveJob(RenderJob* job);
+};
+
+#endif // RENDERPOOL_H
@@ -0,0 +1,126 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "tilerenderer.h"
+#include "renderpool.h"
+
+bool TileRenderer::setPage(int const newPage, qreal const res)
+{
+    if (newPage == page && res == resolution)
+        return false;
+    clear();
+    changeResolution(res);
+    page = newPage;
+    QSizeF size = resolution*pdf->getPageSize(page);
+    if (pagePart != FullPage)
+        size.rwidth() /= 2;
+    imageSize = size.toSize();
+    columns = (imageSize.width() + tileSize - 1) / tileSize;
+    return true;
+}
+
+QRect const TileRenderer::tileRect(int const tile) const
+{
+    return QRect((tile % columns) * tileSize, (tile / columns) * tileSize, tileSize, tileSize) & QRect(QPoint(), imageSize);
+}
+
+QList<int> const TileRenderer::tilesIn(QRectF const& rect) const
+{
+    QList<int> list;
+    QRect const region = rect.toAlignedRect() & QRect(QPoint(), imageSize);
+    if (page < 0 || region.isEmpty())
+        return list;
+    for (int row=region.top()/tileSize; row<=region.bottom()/tileSize; row++)
+        for (int column=region.left()/tileSize; column<=region.right()/tileSize; column++)
+            list.append(row*columns + column);
+    return list;
+}
+
+void TileRenderer::request(QRectF const& rect)
+{
+    if (page < 0 || imageSize.isEmpty())
+        return;
+    QRect const region = rect.toAlignedRect() & QRect(QPoint(), imageSize);
+    if (region.isEmpty())
+        return;
+    int const rows = (imageSize.height() + tileSize - 1) / tileSize;
+    int const left = region.left() / tileSize, right = region.right() / tileSize;
+    int const top = region.top() / tileSize, bottom = region.bottom() / tileSize;
+    // Visible tiles are needed immediately. Neighbouring tiles are prefetched
+    // after all decode jobs, which are required for navigation.
+    for (int const tile : tilesIn(rect))
+        submitTile(tile, RenderPool::immediatePriority);
+    for (int row=std::max(0, top-1); row<=std::min(rows-1, bottom+1); row++) {
+        for (int column=std::max(0, left-1); column<=std::min(columns-1, right+1); column++) {
+            if (row < top || row > bottom || column < left || column > right)
+                submitTile(row*columns + column, RenderPool::decodePriority - 1);
+        }
+    }
+}
+
+void TileRenderer::submitTile(int const tile, int const priority)
+{
+    if (tiles.contains(tile) || pendingTiles.contains(tile))
+        return;
+    pendingTiles.insert(tile);
+    RenderPool::instance()->submitTile(this, page, tile, tileRect(tile), priority);
+}
+
+QPixmap const TileRenderer::getTile(int const tile)
+{
+    if (!tiles.contains(tile))
+        return QPixmap();
+    tileOrder.removeOne(tile);
+    tileOrder.append(tile);
+    return tiles[tile];
+}
+
+bool TileRenderer::receiveTile(int const page, int const tile, QByteArray const* bytes, QImage const& image)
+{
+    delete bytes;
+    pendingTiles.remove(tile);
+    if (page != this->page || image.isNull())
+        return true;
+    QPixmap const pixmap = QPixmap::fromImage(image);
+    qint64 diff = pixmapBytes(pixmap);
+    if (tiles.contains(tile))
+        diff -= pixmapBytes(tiles[tile]);
+    tiles[tile] = pixmap;
+    tileOrder.removeOne(tile);
+    tileOrder.append(tile);
+    while (tileOrder.size() > maxTiles)
+        diff -= pixmapBytes(tiles.take(tileOrder.takeFirst()));
+    addDecodedBytes(diff);
+    emit tileReady();
+    return true;
+}
+
+void TileRenderer::cancelJobs()
+{
+    BasicRenderer::cancelJobs();
+    pendingTiles.clear();
+}
+
+void TileRenderer::clear()
+{
+    cancelJobs();
+    tiles.clear();
+    tileOrder.clear();
+    addDecodedBytes(-getDecodedBytes());
+    page = -1;
+}
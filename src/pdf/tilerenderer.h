@@ -0,0 +1,91 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILERENDERER_H
+#define TILERENDERER_H
+
+#include "basicrenderer.h"
+
+/// Renderer for tiles of a single page using the RenderPool.
+/// This is used by the magnifier: only tiles around the magnified region are
+/// rendered (using poppler's sub-rectangle rendering). Decoded tiles are kept
+/// in a small LRU cache, such that memory and latency do not depend on the
+/// magnification.
+class TileRenderer : public BasicRenderer
+{
+    Q_OBJECT
+
+public:
+    /// Size of tiles in pixels.
+    static constexpr int tileSize = 256;
+    /// Maximum number of decoded tiles which are kept.
+    static constexpr int maxTiles = 64;
+
+    /// Constructor
+    explicit TileRenderer(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr): BasicRenderer(doc, part, parent) {codec = RawCodec;}
+    /// Destructor
+    ~TileRenderer() override {cancelJobs();}
+
+    /// Select page and resolution. All tiles are dropped if one of them changes.
+    /// Return true if the page or resolution changed.
+    bool setPage(int const newPage, qreal const res);
+    int getPage() const {return page;}
+    /// Render all missing tiles intersecting rect (in pixels of the page image) in the RenderPool.
+    /// Tiles in a margin of one tile around rect are rendered with lower priority.
+    void request(QRectF const& rect);
+    /// Numbers of all tiles intersecting rect (in pixels of the page image).
+    QList<int> const tilesIn(QRectF const& rect) const;
+    /// Rectangle covered by tile in the page image.
+    QRect const tileRect(int const tile) const;
+    /// Is tile available?
+    bool contains(int const tile) const {return tiles.contains(tile);}
+    /// Get an available tile or a null pixmap. This marks the tile as recently used.
+    QPixmap const getTile(int const tile);
+    /// Drop all tiles and cancel rendering.
+    void clear();
+    /// Cancel all render jobs of this renderer.
+    void cancelJobs() override;
+
+protected:
+    /// Results of render jobs are not used: tiles are received by receiveTile.
+    void receiveBytes(int const page, QByteArray const* bytes) override {Q_UNUSED(page) delete bytes;}
+    /// Save a tile rendered in the RenderPool.
+    bool receiveTile(int const page, int const tile, QByteArray const* bytes, QImage const& image) override;
+
+private:
+    /// Render tile with the given priority if it is not available.
+    void submitTile(int const tile, int const priority);
+    /// Page which is rendered, -1 if no page is selected.
+    int page = -1;
+    /// Size of the page image in pixels.
+    QSize imageSize;
+    /// Number of tile columns of the page image.
+    int columns = 1;
+    /// Decoded tiles. Their size is counted in getDecodedBytes().
+    QMap<int, QPixmap> tiles;
+    /// Tiles in tiles, least recently used first.
+    QList<int> tileOrder;
+    /// Tiles which are rendered in the RenderPool.
+    QSet<int> pendingTiles;
+
+signals:
+    /// A new tile is available.
+    void tileReady();
+};
+
+#endif // TILERENDERER_H
@@ -18,6 +18,7 @@
 
 #include "controlscreen.h"
 #include "../names.h"
+#include "../pdf/renderpool.h"
 
 #ifdef DISABLE_TOOL_TIP
 #else
@@ -83,12 +84,8 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
     // Save the total number of pages.
     numberOfPages = presentation->getDoc()->numPages();
 
-    // Some numbers for cache management.
-    // Maximum number of cached pages is by default the total number of pages.
-    maxCacheNumber = numberOfPages;
-    // last_delete points to the last page which has not been deleted yet.
-    // No pages have been deleted from cache yet.
-    last_delete = numberOfPages - 1;
+    // The cache manager selects pages which are rendered to cache.
+    cacheManager = new CacheManager(presentation, this);
 
     // Set up presentation screen.
     // The presentation screen is shown immediately.
@@ -123,6 +120,10 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
     }
     else
         setWindowTitle("BeamerPresenter: " + notesPath);
+    // Changed pages are detected in the background after reloading.
+    connect(presentation, &PdfDoc::changesDetected, this, &ControlScreen::applyDocumentChanges);
+    if (notes != presentation)
+        connect(notes, &PdfDoc::changesDetected, this, &ControlScreen::applyDocumentChanges);
 
     // Set up the slide widgets.
     if (notesPath.isEmpty() && pagePart == FullPage) {
@@ -139,12 +140,15 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
 
         // Connect drawSlide to other widgets.
         // Copy paths from draw slide to presentation slide and vice versa when drawing on one of the slides.
-        // Copy paths after moving the mouse while drawing. This assumes that only the last path is changed or a new path is created.
-        connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChangedQuick, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChangedQuick, drawSlide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        // Copy all paths. This completely updates all paths after using the erasor.
+        // Every change (drawing, erasing, undo, redo) is sent as an operation, which is applied to the other slide.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::pathOperation, presentationScreen->slide->getPathOverlay(), &PathOverlay::applyOperation);
+        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathOperation, drawSlide->getPathOverlay(), &PathOverlay::applyOperation);
+        // Copy all paths. This completely updates all paths, e.g. after loading a file.
         connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChanged, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPaths);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChanged, drawSlide->getPathOverlay(), &PathOverlay::setPaths);
+        // If an operation cannot be applied, all paths of the page are copied from the sender.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::requestPaths, presentationScreen->slide->getPathOverlay(), &PathOverlay::sendPaths);
+        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::requestPaths, drawSlide->getPathOverlay(), &PathOverlay::sendPaths);
         // Send pointer position (when using a pointer, torch or magnifier tool).
         connect(drawSlide->getPathOverlay(), &PathOverlay::pointerPositionChanged, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPointerPosition);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pointerPositionChanged, drawSlide->getPathOverlay(), &PathOverlay::setPointerPosition);
@@ -189,14 +193,28 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
     previewCache = new CacheMap(presentation, pagePart, this);
     ui->current_slide->overwriteCacheMap(previewCache);
     ui->next_slide->overwriteCacheMap(previewCache);
-
-    // Connect cache maps.
-    connect(previewCache, &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
-    connect(previewCache, &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
-    connect(ui->notes_widget->getCacheMap(), &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
-    connect(ui->notes_widget->getCacheMap(), &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
-    connect(presentationScreen->slide->getCacheMap(), &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
-    connect(presentationScreen->slide->getCacheMap(), &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
+    // Pages in the preview cache serve as placeholders while the presentation
+    // slide is rendered in the background (only used with external renderers).
+    presentationScreen->slide->getCacheMap()->setPlaceholderSource(previewCache);
+    // Previews are derived from the presentation cache by downscaling instead of rendering them again.
+    previewCache->setDownscaleSource(presentationScreen->slide->getCacheMap());
+
+    // Connect cache maps. Pages are freed from caches with large weights last.
+    presentationScreen->slide->getCacheMap()->setObjectName("presentation");
+    previewCache->setObjectName("previews");
+    ui->notes_widget->getCacheMap()->setObjectName("notes");
+    cacheManager->addCache(presentationScreen->slide->getCacheMap(), cacheWeights["presentation"]);
+    cacheManager->addCache(previewCache, cacheWeights["previews"]);
+    cacheManager->addCache(ui->notes_widget->getCacheMap(), cacheWeights["notes"]);
+    // Decoded tiles of the magnifiers count in the budget.
+    connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::magnifierRendererCreated, cacheManager, &CacheManager::addRenderer);
+    if (drawSlide != nullptr)
+        connect(drawSlide->getPathOverlay(), &PathOverlay::magnifierRendererCreated, cacheManager, &CacheManager::addRenderer);
+#ifdef DISABLE_TOOL_TIP
+#else
+    // Show the memory used by all caches in the tool tip of the number of pages.
+    connect(cacheManager, &CacheManager::budgetChanged, this, [&](){ui->text_number_slides->setToolTip("Total number of pages\n" + cacheManager->budgetReport());});
+#endif
 
     // Create widget showing table of content (TocBox) on the control screen.
     // tocBox is empty by default and will be updated when it is shown for the first time.
@@ -319,22 +337,20 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
     // The escape key resets the focus to the notes slide.
     connect(ui->text_current_slide, &PageNumberEdit::sendEscape,           this, &ControlScreen::resetFocus);
 
-    // Set up cache handling.
-    // Set slide widgets for cache thread. The widgets are const for the cache thread.
-    // The cache timer just makes sure that slides are rendered to cache after the main thread finished all other tasks.
-    connect(cacheTimer, &QTimer::timeout, this, &ControlScreen::updateCacheStep);
-    // Send rendered pages from cache thread to control screen.
     // Clear presentation cache when presentation screen is resized.
     connect(presentationScreen, &PresentationScreen::presentationResizeEvent, this, &ControlScreen::presentationResized);
 
     // Signals emitted by the TOC box (table of contents).
     // Send a destination in pdf (e.g. a section).
     connect(tocBox, &TocBox::sendNewPage, presentationScreen, [&](int const pageNumber){presentationScreen->renderPage(pageNumber, false);});
+    // Tell the cache manager that this is a jump before the page changes.
+    connect(tocBox, &TocBox::sendNewPage, cacheManager, &CacheManager::markJump);
     connect(tocBox, &TocBox::sendNewPage, this, &ControlScreen::receiveNewPageNumber);
 
     // Signals emitted by the overview box
     // Send new page number to presentation screen and control screen. TODO: check this.
     connect(overviewBox, &OverviewBox::sendPageNumber, presentationScreen, [&](int const pageNumber){presentationScreen->renderPage(pageNumber, false);});
+    connect(overviewBox, &OverviewBox::sendPageNumber, cacheManager, &CacheManager::markJump);
     connect(overviewBox, &OverviewBox::sendPageNumber, this, &ControlScreen::receiveNewPageNumber);
     // Exit overview box.
     connect(overviewBox, &OverviewBox::sendReturn, this, &ControlScreen::showNotes);
@@ -354,9 +370,9 @@ ControlScreen::~ControlScreen()
     delete overviewBox;
 
     // Stop cache processes.
-    cacheTimer->disconnect();
     interruptCacheProcesses(10000);
-    delete cacheTimer;
+    delete cacheManager;
+    cacheManager = nullptr;
 
     // Disconnect draw slide.
     if (drawSlide != nullptr && drawSlide != ui->notes_widget)
@@ -607,11 +623,9 @@ void ControlScreen::renderPage(int const pageNumber, bool const full)
         // TODO: improve this part.
         // It is possible that presentationScreen->slide contains drawings which have not been copied to drawSlide yet.
         QString label = presentation->getLabel(currentPageNumber);
-        if (drawSlide->getPage() != nullptr && !drawSlide->getPathOverlay()->getPaths().contains(label)) {
-            qint16 const sx=presentationScreen->slide->getXshift(), sy=presentationScreen->slide->getYshift();
-            qreal res = presentationScreen->slide->getResolution();
-            drawSlide->getPathOverlay()->setPaths(label, presentationScreen->slide->getPathOverlay()->getPaths()[label], sx, sy, res);
-        }
+        presentationScreen->slide->getPathOverlay()->loadPage(label);
+        if (drawSlide->getPage() != nullptr && !drawSlide->getPathOverlay()->getPaths().contains(label))
+            drawSlide->getPathOverlay()->setPaths(label, presentationScreen->slide->getPathOverlay()->getPaths()[label]);
 
         // Update current slide
         drawSlide->renderPage(currentPageNumber, false);
@@ -642,11 +656,11 @@ void ControlScreen::renderPage(int const pageNumber, bool const full)
 void ControlScreen::updateCache()
 {
     // (Re)start updating cache.
-    // This (re)initializes the variables for cache management and starts the cacheTimer, which manages cache updates in a separate thread.
+    // The cache manager ranks all pages relative to the current page and renders them in this order.
 
-    if (maxCacheSize == 0 || maxCacheNumber == 0) {
+    if (cacheManager->isDisabled()) {
         // The cache managment cannot be turned of.
-        // If cache is disabled by setting maxCacheSize=0 or maxCacheNumber=0,
+        // If cache is disabled by setting the maximum size or number of cached pages to 0,
         // cache needs to be cleared manually.
         presentationScreen->slide->getCacheMap()->clearCache();
         ui->notes_widget->getCacheMap()->clearCache();
@@ -657,249 +671,100 @@ void ControlScreen::updateCache()
             drawSlideCache->clearCache();
         return;
     }
+    cacheManager->setCurrentPage(currentPageNumber);
+}
 
-    // Stop running cache updates
-    cacheTimer->stop();
-    // Number of currently cached slides
-    int const cacheNumber = presentationScreen->slide->getCacheMap()->length();
-    if (
-            cacheNumber == numberOfPages
-            && ui->notes_widget->getCacheMap()->length() == numberOfPages
-            && previewCache->length() == numberOfPages
-            && (drawSlideCache == nullptr || drawSlideCache->length() == numberOfPages)
-            && (previewCacheX == nullptr || previewCacheX->length() == numberOfPages)
-            ) {
-        // All slides are cached
-        return;
-    }
-    // Size of currently cached slides in memory (set to -infinity if it should be ignored)
-    if (maxCacheSize > 0) {
-        cacheSize = presentationScreen->slide->getCacheMap()->getSizeBytes()
-                + ui->notes_widget->getCacheMap()->getSizeBytes()
-                + previewCache->getSizeBytes();
-        if (previewCacheX != nullptr)
-            cacheSize += previewCacheX->getSizeBytes();
-        if (drawSlideCache != nullptr)
-            cacheSize += drawSlideCache->getSizeBytes();
-    }
-    else
-        // This is approximately -infinity and means that the cache size is unlimited:
-        cacheSize = -8589934591L; // -8GiB
-
-    // There should be a simply connected region of cached pages between first_cached and last_cached.
-    if (first_cached > currentPageNumber || last_cached < currentPageNumber) {
-        // We are outside the simply connected cache region.
-        // Reset cache numbers and start a new simply connected region, which is initially empty.
-        first_cached = currentPageNumber;
-        last_cached = currentPageNumber-1;
-        first_delete = 0;
-        last_delete = numberOfPages-1;
-#ifdef DEBUG_CACHE
-        qDebug() << "Reset cache region" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-    }
-    else {
-        // TODO: check whether this is necessary.
-        // We are in the simply connected cache region.
-        // Make sure that deleting cached pages starts outside this region.
-        // Cached pages will only be deleted if the memory or the number of cached pages is limited.
-        last_delete = last_delete > currentPageNumber + cacheNumber ? last_delete : currentPageNumber + cacheNumber;
-        last_delete = last_delete >= numberOfPages ? numberOfPages-1 : last_delete;
-        first_delete = first_delete > currentPageNumber - cacheNumber/2 ? currentPageNumber - cacheNumber/2 : first_delete;
-        first_delete = first_delete < 0 ? 0 : first_delete;
-    }
-    if (last_cached < numberOfPages-1 || first_cached > 0)
-        // The simply connected region does not include all pages.
-        // Start the update steps by starting the cacheTimer.
-        // cacheTimer will call updateCacheStep().
-        cacheTimer->start();
+void ControlScreen::setCacheNumber(int const number)
+{
+    if (number == 0)
+        interruptCacheProcesses(0);
+    cacheManager->setMaxNumber(number);
 }
 
-void ControlScreen::updateCacheStep()
+void ControlScreen::setCacheSize(qint64 const size)
 {
-    /*
-    * Select a page for rendering to cache and tell the CacheThreads of CacheMaps to render that page.
-    * Delete cached pages if necessary due to limited memory or a limited number of cached slides.
-    * This function will notice when no more pages need to be rendered to cache and stop the cacheTimer.
-    *
-    * Outline of the cache management:
-    *
-    * 0. updateCache initializes some variables and starts cacheTimer.
-    * 1. cacheTimer calls updateCacheStep in a loop whenever the main thread is not busy.
-    * 2. updateCacheStep deletes pages (using freeCachePage) as long as the cache uses
-    *    too much memory (or as long as too many slides are cached).
-    * 3. updateCacheStep checks whether a new pages should be rendered to cache.
-    *    TODO: This process of checking and finding pages should be more understandable.
-    *    - If no more cached pages are needed, it stops cacheTimer.
-    *    - If it finds a page, which should be rendered to cache:
-    *        a. it stops cacheTimer
-    *        b. it hands the page to ControlScreen::cachePage.
-    * 4. ControlScreen::cachePage calls CacheMap::updateCache for all slide widgets.
-    *    This starts CacheThreads which render the different pages in parallel in own threads.
-    *    For each new thread the counter ControlScreen::cacheThreadsRunning is incremented.
-    * 5. When the rendering is done, CacheMap gets the results from CacheThread and
-    *    ControlScreen::cacheThreadFinished is called.
-    * 6. cacheThreadFinished decrements cacheThreadsRunning.
-    *    If cacheThreadsRunning==0, starts cacheTimer again.
-    */
-
-#ifdef DEBUG_CACHE
-    qDebug() << "Update cache step" << cacheThreadsRunning << cacheSize << maxCacheSize << maxCacheNumber;
-#endif
-
-    // TODO: improve this, make it more deterministic, avoid caching pages which will directly be freed again
-    if (
-            presentationScreen->slide->getCacheMap()->length() == numberOfPages
-            && ui->notes_widget->getCacheMap()->length() == numberOfPages
-            && previewCache->length() == numberOfPages
-            && (drawSlideCache == nullptr || drawSlideCache->length() == numberOfPages)
-            && (previewCacheX == nullptr || previewCacheX->length() == numberOfPages)
-            ) {
-        // All slides are cached
-        qInfo() << "All slides rendered to cache. Cache size:" << cacheSize << "bytes.";
-        cacheTimer->stop();
-        return;
-    }
-    if (
-            last_cached > last_delete
-            || first_cached < first_delete
-            || first_cached > currentPageNumber
-            || last_cached < currentPageNumber-1
-            ) {
-        cacheTimer->stop();
-#ifdef DEBUG_CACHE
-        qDebug() << "Stopped cache timer" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-        return;
-    }
-    // Free space if necessary
-    while (cacheSize > maxCacheSize || (maxCacheNumber < numberOfPages && presentationScreen->slide->getCacheMap()->length() > maxCacheNumber) ) {
-        // Start deleting later slides if less than 1/4 of the caches slides are previous slides
-        if (last_delete > 4*currentPageNumber - 3*first_delete) {
-            if (freeCachePage(last_delete))
-                break;
-            last_delete--;
-            last_cached = last_delete > last_cached ? last_cached : last_delete;
-        }
-        else {
-            if (freeCachePage(first_delete))
-                break;
-            first_delete++;
-            first_cached = first_cached > first_delete ? first_cached : first_delete;
-        }
-        if (last_cached > last_delete || first_cached < first_delete) {
-            cacheTimer->stop();
-#ifdef DEBUG_CACHE
-            qDebug() << "Stopped cache timer: need to reset cache region." << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-            return;
-        }
-    }
-    if (last_cached+1 == numberOfPages) {
-        if (
-                first_cached > first_delete
-                && 2*maxCacheSize > 3*cacheSize
-                && (maxCacheNumber == numberOfPages || 2*maxCacheNumber > 3*presentationScreen->slide->getCacheMap()->length())
-                ) {
-            // cache first_cached-1
-            cachePage(--first_cached);
-            return;
-        }
-        else {
-            cacheTimer->stop();
-#ifdef DEBUG_CACHE
-            qDebug() << "Stopped cache timer" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-            return;
-        }
-    }
-    // Don't continue if it is likely that the next cached page would directly be deleted.
-    else if (
-             // More than 2/3 of available cache space is occupied.
-             2*maxCacheSize < 3*cacheSize
-             // Enough slides (compared to cache size) after current slide are contained in cache.
-             && (last_cached == numberOfPages || 3*(last_cached - currentPageNumber)*cacheSize > 2*presentationScreen->slide->getCacheMap()->length()*maxCacheSize)
-             // The remaining cache space is smaller than twice the average space needed per presentation slide.
-             && (maxCacheSize - cacheSize)*presentationScreen->slide->getCacheMap()->length() < 2*cacheSize
-             ) {
-        cacheTimer->stop();
-#ifdef DEBUG_CACHE
-        qDebug() << "Stopped cache timer" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-        return;
-    }
-    else {
-        // Cache the page last_cached+1
-        cachePage(++last_cached);
-    }
+    if (size == 0)
+        interruptCacheProcesses(0);
+    cacheManager->setMaxSize(size);
 }
 
-bool ControlScreen::freeCachePage(const int page)
+void ControlScreen::setCacheWeights(QMap<QString, qreal> const& weights)
 {
-    if (drawSlideCache != nullptr) {
-        cacheSize -= drawSlideCache->clearPage(page);
-        if (cacheSize <= maxCacheSize && (maxCacheNumber >= numberOfPages || presentationScreen->slide->getCacheMap()->length() <= maxCacheNumber))
-            return true;
+    for (QMap<QString, qreal>::const_iterator it=weights.cbegin(); it!=weights.cend(); it++) {
+        if (!cacheWeights.contains(it.key()))
+            qWarning() << "Ignoring weight of unknown cache" << it.key();
+        else if (it.value() <= 0.)
+            qWarning() << "Ignoring invalid cache weight" << it.value() << "for" << it.key();
+        else
+            cacheWeights[it.key()] = it.value();
     }
-    cacheSize -= ui->notes_widget->getCacheMap()->clearPage(page);
-    if (cacheSize <= maxCacheSize && (maxCacheNumber >= numberOfPages || presentationScreen->slide->getCacheMap()->length() <= maxCacheNumber))
-        return true;
+    cacheManager->setWeight(presentationScreen->slide->getCacheMap(), cacheWeights["presentation"]);
+    cacheManager->setWeight(ui->notes_widget->getCacheMap(), cacheWeights["notes"]);
+    cacheManager->setWeight(previewCache, cacheWeights["previews"]);
     if (previewCacheX != nullptr)
-        cacheSize -= previewCacheX->clearPage(page);
-    cacheSize -= previewCache->clearPage(page);
-    if (cacheSize <= maxCacheSize && (maxCacheNumber >= numberOfPages || presentationScreen->slide->getCacheMap()->length() <= maxCacheNumber))
-        return true;
-    cacheSize -= presentationScreen->slide->getCacheMap()->clearPage(page);
-#ifdef DEBUG_CACHE
-    qDebug() << "Freed page" << page << ". Cache size" << cacheSize << "B";
-#endif
-    return false;
+        cacheManager->setWeight(previewCacheX, cacheWeights["previews"]);
+    if (drawSlideCache != nullptr)
+        cacheManager->setWeight(drawSlideCache, cacheWeights["draw"]);
+    cacheManager->setWeight(overviewBox->getThumbnails(), cacheWeights["previews"]);
 }
 
-void ControlScreen::cachePage(const int page)
+void ControlScreen::setHotPages(int const pages)
 {
-#ifdef DEBUG_CACHE
-    qDebug() << "Cache page" << page << cacheThreadsRunning << cacheSize;
-#endif
-    cacheTimer->stop();
-    cacheThreadsRunning = 0;
-    if (presentationScreen->slide->getCacheMap()->updateCache(page))
-        cacheThreadsRunning++;
-    if(ui->notes_widget->getCacheMap()->updateCache(page))
-        cacheThreadsRunning++;
-    if (previewCache->updateCache(page))
-        cacheThreadsRunning++;
-    if (drawSlideCache != nullptr && drawSlideCache->updateCache(page))
-        cacheThreadsRunning++;
-    if (previewCacheX != nullptr && previewCacheX->updateCache(page))
-        cacheThreadsRunning++;
-    if (cacheThreadsRunning == 0)
-        cacheTimer->start();
+    hotPages = pages;
+    presentationScreen->slide->getCacheMap()->setHotPages(pages);
+    ui->notes_widget->getCacheMap()->setHotPages(pages);
+    previewCache->setHotPages(pages);
+    if (drawSlideCache != nullptr)
+        drawSlideCache->setHotPages(pages);
+    if (previewCacheX != nullptr)
+        previewCacheX->setHotPages(pages);
 }
 
-void ControlScreen::setCacheNumber(int const number)
+void ControlScreen::setHotMemory(qint64 const bytes)
 {
-    if (number < 0)
-        maxCacheNumber = numberOfPages;
-    else if (number == 0) {
-        interruptCacheProcesses(0);
-        maxCacheNumber = 0;
-    }
-    else
-        maxCacheNumber = number;
+    hotMemory = bytes;
+    presentationScreen->slide->getCacheMap()->setMaxHotBytes(bytes);
+    ui->notes_widget->getCacheMap()->setMaxHotBytes(bytes);
+    previewCache->setMaxHotBytes(bytes);
+    if (drawSlideCache != nullptr)
+        drawSlideCache->setMaxHotBytes(bytes);
+    if (previewCacheX != nullptr)
+        previewCacheX->setMaxHotBytes(bytes);
 }
 
-void ControlScreen::cacheThreadFinished()
+void ControlScreen::setTileSize(int const size)
 {
-    if (--cacheThreadsRunning == 0)
-        cacheTimer->start();
+    tileSize = size;
+    presentationScreen->slide->getCacheMap()->setTileSize(size);
+    ui->notes_widget->getCacheMap()->setTileSize(size);
+    previewCache->setTileSize(size);
+    if (drawSlideCache != nullptr)
+        drawSlideCache->setTileSize(size);
+    if (previewCacheX != nullptr)
+        previewCacheX->setTileSize(size);
 }
 
-void ControlScreen::setCacheSize(qint64 const size)
+void ControlScreen::setRenderThreads(int const number)
 {
-    if (cacheSize == 0)
-        interruptCacheProcesses(0);
-    maxCacheSize = size;
+    RenderPool::instance()->setWorkers(number);
+}
+
+void ControlScreen::setRendererWorkers(int const number)
+{
+    RenderPool::instance()->setRendererWorkers(number);
+}
+
+void ControlScreen::setCacheCodec(CacheCodec const codec)
+{
+    // Pages which are already cached stay valid: decoding does not depend on the codec.
+    cacheCodec = codec;
+    presentationScreen->slide->getCacheMap()->setCodec(codec);
+    ui->notes_widget->getCacheMap()->setCodec(codec);
+    previewCache->setCodec(codec);
+    if (drawSlideCache != nullptr)
+        drawSlideCache->setCodec(codec);
+    if (previewCacheX != nullptr)
+        previewCacheX->setCodec(codec);
 }
 
 void ControlScreen::setTocLevel(quint8 const level)
@@ -929,6 +794,7 @@ void ControlScreen::receiveDest(QString const& dest)
     if (pageNumber>=0 && pageNumber<numberOfPages) {
         ui->label_timer->continueTimer();
         emit sendNewPageNumber(pageNumber, true);
+        cacheManager->markJump();
         renderPage(pageNumber);
         updateCache();
     }
@@ -1674,6 +1540,16 @@ bool ControlScreen::handleKeyAction(KeyAction const action)
                 presentationScreen->slide->getPathOverlay()->saveXML(savePath, notes, false);
         }
         break;
+    case KeyAction::SaveDrawingsBinary:
+        {
+#ifdef DEBUG_KEY_ACTIONS
+            qDebug() << "Save drawings event" << action;
+#endif
+            QString const savePath = QFileDialog::getSaveFileName(this, "Save drawings binary");
+            if (!savePath.isEmpty())
+                presentationScreen->slide->getPathOverlay()->saveBinary(savePath, notes);
+        }
+        break;
     case KeyAction::LoadDrawings:
         {
 #ifdef DEBUG_KEY_ACTIONS
@@ -1728,10 +1604,6 @@ void ControlScreen::resizeEvent(QResizeEvent* event)
     // Update layout
     recalcLayout(currentPageNumber);
     oldSize = event->size();
-    first_cached = presentationScreen->getPageNumber();
-    last_cached = first_cached-1;
-    first_delete = 0;
-    last_delete = numberOfPages-1;
     ui->notes_widget->getCacheMap()->clearCache();
     previewCache->clearCache();
     if (previewCacheX != nullptr)
@@ -1749,12 +1621,8 @@ void ControlScreen::resizeEvent(QResizeEvent* event)
 
 void ControlScreen::presentationResized()
 {
-    // Stop rendering to cache and reset cached region.
-    cacheTimer->stop();
-    first_cached = presentationScreen->getPageNumber();
-    last_cached = first_cached-1;
-    first_delete = 0;
-    last_delete = numberOfPages-1;
+    // Stop rendering to cache. The cache manager starts again with the next page change.
+    cacheManager->stop();
 
     // Adapt tool sizes.
     if (drawSlide != nullptr) {
@@ -1909,10 +1777,11 @@ void ControlScreen::showNotes()
 void ControlScreen::showOverview()
 {
     tocBox->hide();
-    if (overviewBox->needsUpdate()) {
-        cacheTimer->stop();
-        overviewBox->create(presentation, pagePart);
-    }
+    // This only creates frames if necessary. Thumbnails are rendered in the background.
+    overviewBox->create(presentation, pagePart, presentationScreen->slide->getCacheMap());
+    // Thumbnails are rendered by the overview, but they count in the budget.
+    // create() replaces the thumbnails if the document changed.
+    cacheManager->addCache(overviewBox->getThumbnails(), cacheWeights["previews"], false);
     if (!this->isActiveWindow())
         this->activateWindow();
     ui->notes_widget->hide();
@@ -1927,10 +1796,17 @@ void ControlScreen::setRenderer(QStringList const& command)
 {
     // Set a command for an external renderer.
     // This function also checks whether the command uses the arguments %file, %page, %width and %height
+    // Persistent renderers only need %file: they receive page and size with each request.
 
     if (command.size() == 1 && command.first() == "poppler")
         return;
-    if (
+    if (RenderPool::instance()->getRendererWorkers() > 0) {
+        if (command.filter("%file").isEmpty()) {
+            qCritical() << "Ignored request to use custom renderer. Rendering command should comtain the argument %file.";
+            throw 2;
+        }
+    }
+    else if (
             command.filter("%file").isEmpty() ||
             command.filter("%page").isEmpty() ||
             command.filter("%width").isEmpty() ||
@@ -1957,36 +1833,37 @@ void ControlScreen::reloadFiles()
 
     /// True if files have changed.
     bool change = false;
+    // Only pages which have changed are removed from cache. The documents are
+    // compared in the background, see applyDocumentChanges(). All slides need
+    // to be updated anyway, because the Poppler::Page objects are replaced.
     // Reload notes file
     if (notes->loadDocument()) {
         qInfo() << "Reloading notes file";
         change = true;
-        ui->notes_widget->clearAll();
+        ui->notes_widget->clearAll(true);
         recalcLayout(currentPageNumber);
     }
     // Reload presentation file
     if ((presentation == notes && change) || (presentation != notes && presentation->loadDocument())) {
-        qInfo() << "Reloading presentation file";
+        if (presentation != notes)
+            qInfo() << "Reloading presentation file";
         change = true;
-        bool const unlimitedCache = numberOfPages==maxCacheNumber;
         numberOfPages = presentation->getDoc()->numPages();
-        if (unlimitedCache)
-            maxCacheNumber = numberOfPages;
         presentationScreen->updatedFile();
-        ui->current_slide->clearAll();
-        ui->next_slide->clearAll();
+        ui->current_slide->clearAll(true);
+        ui->next_slide->clearAll(true);
+        if (drawSlide != nullptr)
+            drawSlide->clearAll(true);
         // Hide TOC and overview and set them outdated
         showNotes();
         tocBox->setOutdated();
         tocBox->createToc();
-        overviewBox->setOutdated();
     }
     // If one of the two files has changed: Reset cache region and render pages on control screen.
     if (change) {
-        first_cached = currentPageNumber;
-        last_cached = first_cached-1;
-        first_delete = 0;
-        last_delete = numberOfPages-1;
+        // Persistent external renderers must open the new files.
+        RenderPool::instance()->restartRenderers();
+        cacheManager->reset();
         renderPage(currentPageNumber);
         ui->text_number_slides->setText(QString::number(numberOfPages));
         ui->text_current_slide->setNumberOfPages(numberOfPages);
@@ -1994,6 +1871,36 @@ void ControlScreen::reloadFiles()
     updateCache();
 }
 
+void ControlScreen::fingerprintDocuments()
+{
+    presentation->fingerprintInBackground();
+    if (notes != presentation)
+        notes->fingerprintInBackground();
+}
+
+void ControlScreen::applyDocumentChanges()
+{
+    bool change = false;
+    // If notes and presentation are the same document, the second call of
+    // takeChangedPages returns nothing.
+    for (PdfDoc* const doc : {notes, presentation}) {
+        QSet<int> const pages = doc->takeChangedPages();
+        if (pages.isEmpty())
+            continue;
+        qInfo() << "Pages changed in" << doc->getPath() << ":" << pages.size();
+        change = true;
+        cacheManager->invalidate(doc, pages);
+        if (doc == presentation)
+            overviewBox->setOutdated(pages);
+    }
+    if (!change)
+        return;
+    // The shown pages may have been taken from the cache before the comparison.
+    presentationScreen->renderPage(presentationScreen->getPageNumber(), false);
+    renderPage(currentPageNumber, false);
+    updateCache();
+}
+
 void ControlScreen::setKeyMap(QMap<quint32, QList<KeyAction>>* keymap)
 {
     delete this->keymap;
@@ -2023,12 +1930,15 @@ void ControlScreen::showDrawSlide()
 
         // Connect drawSlide to other widgets.
         // Copy paths from draw slide to presentation slide and vice versa when drawing on one of the slides.
-        // Copy paths after moving the mouse while drawing. This assumes that only the last path is changed or a new path is created.
-        connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChangedQuick, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChangedQuick, drawSlide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        // Copy all paths. This completely updates all paths after using the erasor.
+        // Every change (drawing, erasing, undo, redo) is sent as an operation, which is applied to the other slide.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::pathOperation, presentationScreen->slide->getPathOverlay(), &PathOverlay::applyOperation);
+        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathOperation, drawSlide->getPathOverlay(), &PathOverlay::applyOperation);
+        // Copy all paths. This completely updates all paths, e.g. after loading a file.
         connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChanged, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPaths);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChanged, drawSlide->getPathOverlay(), &PathOverlay::setPaths);
+        // If an operation cannot be applied, all paths of the page are copied from the sender.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::requestPaths, presentationScreen->slide->getPathOverlay(), &PathOverlay::sendPaths);
+        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::requestPaths, drawSlide->getPathOverlay(), &PathOverlay::sendPaths);
         // Send pointer position (when using a pointer, torch or magnifier tool).
         connect(drawSlide->getPathOverlay(), &PathOverlay::pointerPositionChanged, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPointerPosition);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pointerPositionChanged, drawSlide->getPathOverlay(), &PathOverlay::setPointerPosition);
@@ -2042,6 +1952,8 @@ void ControlScreen::showDrawSlide()
         // Signals used to request updates for this QPixmap:
         connect(drawSlide->getPathOverlay(), &PathOverlay::sendUpdatePathCache, presentationScreen->slide->getPathOverlay(), &PathOverlay::updatePathCache);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::sendUpdatePathCache, drawSlide->getPathOverlay(), &PathOverlay::updatePathCache);
+        // Decoded tiles of the magnifier count in the budget.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::magnifierRendererCreated, cacheManager, &CacheManager::addRenderer);
         // drawSlide can send page change events.
         connect(drawSlide, &PreviewSlide::sendNewPageNumber, presentationScreen, &PresentationScreen::receiveNewPage);
         connect(drawSlide, &PreviewSlide::sendNewPageNumber, this, [&](int const pageNumber){renderPage(pageNumber);});
@@ -2069,16 +1981,15 @@ void ControlScreen::showDrawSlide()
     // drawSlide is drawn on top of the notes widget. It should thus have the same geometry.
     if (drawSlideCache == nullptr) {
         drawSlideCache = new CacheMap(presentation, pagePart, this);
-        connect(drawSlideCache, &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
-        connect(drawSlideCache, &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
+        drawSlideCache->setCodec(cacheCodec);
+        drawSlideCache->setHotPages(hotPages);
+        drawSlideCache->setMaxHotBytes(hotMemory);
+        drawSlideCache->setTileSize(tileSize);
+        drawSlideCache->setPlaceholderSource(presentationScreen->slide->getCacheMap());
+        drawSlideCache->setDownscaleSource(presentationScreen->slide->getCacheMap());
+        drawSlideCache->setObjectName("draw slide");
+        cacheManager->addCache(drawSlideCache, cacheWeights["draw"]);
     }
-    first_cached = currentPageNumber;
-    last_cached = currentPageNumber-1;
-    first_delete = 0;
-    last_delete = numberOfPages-1;
-#ifdef DEBUG_CACHE
-    qDebug() << "Reset cache region" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
     drawSlide->overwriteCacheMap(drawSlideCache);
     // If notes slides have a different aspect ratio than presentation slides, then change preview cache to previewCacheX.
     // This cache is used because the geometry of the preview widgets will change.
@@ -2086,8 +1997,14 @@ void ControlScreen::showDrawSlide()
     if (abs(pressize.width()*notessize.height() - pressize.height()*notessize.width()) > 1e-2) {
         if (previewCacheX == nullptr) {
             previewCacheX = new CacheMap(presentation, pagePart, this);
-            connect(previewCacheX, &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
-            connect(previewCacheX, &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
+            previewCacheX->setCodec(cacheCodec);
+            previewCacheX->setHotPages(hotPages);
+            previewCacheX->setMaxHotBytes(hotMemory);
+            previewCacheX->setTileSize(tileSize);
+            previewCacheX->setPlaceholderSource(previewCache);
+            previewCacheX->setDownscaleSource(presentationScreen->slide->getCacheMap());
+            previewCacheX->setObjectName("previews (wide)");
+            cacheManager->addCache(previewCacheX, cacheWeights["previews"]);
         }
         ui->current_slide->overwriteCacheMap(previewCacheX);
         ui->next_slide->overwriteCacheMap(previewCacheX);
@@ -2101,26 +2018,23 @@ void ControlScreen::showDrawSlide()
     ui->notes_widget->hide();
     drawSlide->show();
     drawSlide->setFocus();
-    // Get offset and resolution of presentation screen.
-    // This is needed to show existing drawings from the presentation screen on drawSlide.
-    qint16 const sx=presentationScreen->slide->getXshift(), sy=presentationScreen->slide->getYshift();
+    // Get resolution of presentation screen.
     qreal const res = presentationScreen->slide->getResolution();
     /// Relative size of the draw slide compared to the presentation slide.
     qreal const scale = drawSlide->getResolution() / res;
     // Set eraser size on the draw slide.
     drawSlide->getPathOverlay()->setEraserSize(scale*presentationScreen->slide->getPathOverlay()->getEraserSize());
     // Get the current page label.
-    QString const label = presentationScreen->slide->getPage()->label();
+    QString const label = presentationScreen->slide->getLabel();
     // Load existing drawings from the presentation screen for the current page on drawSlide.
-    drawSlide->getPathOverlay()->setPaths(label, presentationScreen->slide->getPathOverlay()->getPaths()[label], sx, sy, res);
+    drawSlide->getPathOverlay()->setPaths(label, presentationScreen->slide->getPathOverlay()->getPaths()[label]);
     // Show the changed drawings.
     drawSlide->update();
     // Render the current page on drawSlide. This also adapts the current and next slide previews to previews of the next two slides.
     renderPage(currentPageNumber);
     // Set autostart delay for multimedia content on drawSlide.
     drawSlide->setAutostartDelay(presentationScreen->slide->getAutostartDelay());
-    if (cacheTimer != nullptr)
-        cacheTimer->start();
+    cacheManager->start();
 }
 
 void ControlScreen::hideDrawSlide()
@@ -2162,55 +2076,33 @@ void ControlScreen::setAutostartDelay(const qreal timeout)
 
 void ControlScreen::interruptCacheProcesses(const unsigned long time)
 {
-    cacheTimer->stop();
+    cacheManager->stop();
 
-    // Interrupt cache threads.
-    presentationScreen->slide->getCacheMap()->getCacheThread()->requestInterruption();
-    ui->notes_widget->getCacheMap()->getCacheThread()->requestInterruption();
+    // Cancel render jobs of all caches.
+    presentationScreen->slide->getCacheMap()->cancelJobs();
+    ui->notes_widget->getCacheMap()->cancelJobs();
     if (previewCache != nullptr)
-        previewCache->getCacheThread()->requestInterruption();
+        previewCache->cancelJobs();
     if (previewCacheX != nullptr)
-        previewCacheX->getCacheThread()->requestInterruption();
+        previewCacheX->cancelJobs();
     if (drawSlideCache != nullptr)
-        drawSlideCache->getCacheThread()->requestInterruption();
-    SingleRenderer* singleRendererPresentation = presentationScreen->slide->getPathOverlay()->getEnlargedPageRenderer();
-    if (singleRendererPresentation != nullptr)
-        singleRendererPresentation->getCacheThread()->requestInterruption();
-    SingleRenderer* singleRendererDrawSlide = nullptr;
+        drawSlideCache->cancelJobs();
+    if (overviewBox != nullptr)
+        overviewBox->cancelRendering();
+    TileRenderer* magnifierPresentation = presentationScreen->slide->getPathOverlay()->getMagnifierRenderer();
+    if (magnifierPresentation != nullptr)
+        magnifierPresentation->clear();
     if (drawSlide != nullptr) {
-        singleRendererDrawSlide = drawSlide->getPathOverlay()->getEnlargedPageRenderer();
-        if (singleRendererDrawSlide != nullptr)
-            singleRendererDrawSlide->getCacheThread()->requestInterruption();
+        TileRenderer* magnifierDrawSlide = drawSlide->getPathOverlay()->getMagnifierRenderer();
+        if (magnifierDrawSlide != nullptr)
+            magnifierDrawSlide->clear();
     }
+    // Cancelled jobs are never reported.
+    cacheManager->jobsCancelled();
 
-    if (time != 0) {
-        if (previewCache != nullptr && !previewCache->getCacheThread()->wait(time))
-            qWarning() << "Cache thread previewCache not stopped after" << time << "ms";
-        if (previewCacheX != nullptr && !previewCacheX->getCacheThread()->wait(time))
-            qWarning() << "Cache thread previewCacheX not stopped after" << time << "ms";
-        if (!ui->notes_widget->getCacheMap()->getCacheThread()->wait(time))
-            qWarning() << "Cache thread notes not stopped after" << time << "ms";
-        if (drawSlideCache != nullptr && !drawSlideCache->getCacheThread()->wait(time))
-            qWarning() << "Cache thread draw slide not stopped after" << time << "ms";
-        if (!presentationScreen->slide->getCacheMap()->getCacheThread()->wait(time))
-            qWarning() << "Cache thread presentation not stopped after" << time << "ms";
-        if (singleRendererDrawSlide != nullptr && !singleRendererDrawSlide->getCacheThread()->wait(time))
-            qWarning() << "Cache thread enlarged page draw slide not stopped after" << time << "ms";
-        if (singleRendererPresentation != nullptr && !singleRendererPresentation->getCacheThread()->wait(time))
-            qWarning() << "Cache thread enlarged page presentation not stopped after" << time << "ms";
-        if (previewCache != nullptr)
-            previewCache->getCacheThread()->exit();
-        if (previewCacheX != nullptr)
-            previewCacheX->getCacheThread()->exit();
-        ui->notes_widget->getCacheMap()->getCacheThread()->exit();
-        if (drawSlideCache != nullptr)
-            drawSlideCache->getCacheThread()->exit();
-        presentationScreen->slide->getCacheMap()->getCacheThread()->exit();
-        if (singleRendererDrawSlide != nullptr)
-            singleRendererDrawSlide->getCacheThread()->exit();
-        if (singleRendererPresentation != nullptr)
-            singleRendererPresentation->getCacheThread()->exit();
-    }
+    // Jobs which are already running cannot be interrupted. Wait for them.
+    if (time != 0 && !RenderPool::instance()->waitForDone(int(time)))
+        qWarning() << "Render jobs not finished after" << time << "ms";
 }
 
 void ControlScreen::setToolForKey(quint32 const key, FullDrawTool const& tool)
@@ -24,6 +24,7 @@
 #include <QLabel>
 #include <QApplication>
 #include "../pdf/pdfdoc.h"
+#include "../pdf/cachemanager.h"
 #include "../gui/timer.h"
 #include "../gui/pagenumberedit.h"
 #include "presentationscreen.h"
@@ -54,6 +55,9 @@ public:
     void renderPage(int const pageNumber, bool const full = true);
     // Update cache
     void updateCache();
+    /// Calculate the fingerprints of the documents in the background.
+    /// This is called after the first page has been shown.
+    void fingerprintDocuments();
 
     // Functions setting different properties from options (only used from main.cpp)
     /// Set background and text color for control screen.
@@ -79,6 +83,21 @@ public:
     /// Set maximum memory used for cached pages (in bytes).
     /// A negative number is interpreted as infinity.
     void setCacheSize(qint64 const size);
+    /// Set weights of the caches "presentation", "notes", "previews" and "draw".
+    /// Pages are freed from caches with small weights first.
+    void setCacheWeights(QMap<QString, qreal> const& weights);
+    /// Set format in which pages are stored in all caches.
+    void setCacheCodec(CacheCodec const codec);
+    /// Set number of pages before and after the current page which are kept decoded in all caches.
+    void setHotPages(int const pages);
+    /// Set maximum memory in bytes used by the decoded pages of each cache. A negative size means unlimited.
+    void setHotMemory(qint64 const bytes);
+    /// Set size of tiles in pixels. Pages larger than one tile are rendered as tiles in parallel. 0 disables tiles.
+    void setTileSize(int const size);
+    /// Set number of threads used for rendering pages. A number < 1 selects the number of CPU cores.
+    void setRenderThreads(int const number);
+    /// Set number of persistent external renderer processes per document. 0 starts a new process for each page.
+    void setRendererWorkers(int const number);
     /// Set maximum level of sections / subsections shown in the table of contents.
     void setTocLevel(quint8 const level);
     void setOverviewColumns(quint8 const columns) {if (overviewBox != nullptr) overviewBox->setColumns(columns);}
@@ -137,8 +156,6 @@ private:
 #endif
     /// Tell all cache processes to stop and wait up to <time> ms until each process is stopped.
     void interruptCacheProcesses(unsigned long const time = 0);
-    /// Free a page from cache. Should only be called from updateCacheStep.
-    bool freeCachePage(const int page);
 
     /// User interface (created from controlscreen.ui)
     Ui::ControlScreen* ui;
@@ -151,11 +168,8 @@ private:
     /// PDF document of notes for the speaker. If no notes are given: notes == presentation.
     PdfDoc* notes;
 
-    /// Timer for regular calls to cachePage.
-    QTimer* cacheTimer = new QTimer(this);
-
-    /// Cache given page on all slide widgets which can handle cache.
-    void cachePage(int const page);
+    /// Selects pages which are rendered to cache and frees cached pages.
+    CacheManager* cacheManager = nullptr;
 
     // Widgets shown above notes: TOC, overview, and drawSlide
     /// Widget showing the table of contents on the control screen.
@@ -173,10 +187,16 @@ private:
     bool forceIsTouchpad = false;
     /// Number of pixels on a touch pad corresponding to scrolling one slide.
     int scrollDelta = 200;
-    /// Maximum number of slides in cache.
-    int maxCacheNumber = 10;
-    /// Maximum size of cache in bytes. Note that cache can get larger than this size in some situations.
-    qint64 maxCacheSize = 104857600L;
+    /// Format in which pages are stored in all caches.
+    CacheCodec cacheCodec = LzCodec;
+    /// Number of pages before and after the current page which are kept decoded in all caches.
+    int hotPages = 1;
+    /// Maximum memory in bytes used by the decoded pages of each cache.
+    qint64 hotMemory = 67108864L;
+    /// Size of tiles in all caches in pixels, 0 if tiles are disabled.
+    int tileSize = 0;
+    /// Weights of the caches in the memory budget of cacheManager.
+    QMap<QString, qreal> cacheWeights {{"presentation", 8.}, {"notes", 4.}, {"previews", 1.}, {"draw", 2.}};
     /// Cached preview slides for standard sidebar width.
     CacheMap* previewCache = nullptr;
     /// Cached preview slides for different sidebar width.
@@ -203,26 +223,6 @@ private:
     QSize oldSize;
     /// Total number of pages
     int numberOfPages;
-    /// Number of currently running cache threads.
-    int cacheThreadsRunning = 0;
-
-    // Variables used for cache management
-    /// All pages < first_delete are not saved in cache.
-    /// Usually this page will be deleted when cache size should be reduced.
-    int first_delete = 0;
-    /// All pages > last_delete are not saved in cache.
-    /// In some case this page will be deleted when cache size should be reduced.
-    int last_delete;
-    /// Beginning of the connected set of cached pages.
-    int first_cached = 0;
-    /// End of the connected set of cached pages.
-    int last_cached = -1;
-    /// Memory used by cache in bytes.
-    qint64 cacheSize = 0;
-
-private slots:
-    /// Select a page which should be rendered to cache and free cache space if necessary.
-    void updateCacheStep();
 
 public slots:
     // TODO: Some of these functions are not used as slots. Tidy up!
@@ -253,13 +253,12 @@ public slots:
     void presentationResized();
     /// Show notes. This hides other widgets which can be shown above notes (TOC, overview, draw slide).
     void showNotes();
-    /// Change cache size.
-    void updateCacheSize(qint64 const diff) {cacheSize += diff;}
-    /// Check whether cache threads finished.
-    void cacheThreadFinished();
     /// Send draw tool from tool selector to draw slide and presentation.
     void distributeTools(FullDrawTool const& tool);
     void distributeStylusTools(FullDrawTool const& tool);
+    /// Remove pages which have changed in a reload from all caches, when the
+    /// comparison of the documents has finished.
+    void applyDocumentChanges();
 
 signals:
     /// Send a new page number with or without starting a timer for the new slide.
@@ -139,6 +139,6 @@ void PresentationScreen::updatedFile()
     qDebug() << "update file";
 #endif
     numberOfPages = presentation->getDoc()->numPages();
-    slide->clearAll();
+    slide->clearAll(true);
     slide->renderPage(slide->pageNumber(), false);
 }
@@ -36,6 +36,8 @@ public:
     ~PresentationScreen() override;
     void renderPage(int pageNumber = 0, bool const setDuration = true);
     int getPageNumber() const {return slide->pageNumber();}
+    /// Update the slide after the document was reloaded.
+    /// Cached pages are kept: changed pages must be removed from cache separately.
     void updatedFile();
     void setScrollDelta(int const scrollDelta) {this->scrollDelta=scrollDelta;}
     void setForceTouchpad() {forceIsTouchpad=true;}
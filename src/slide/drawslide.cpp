@@ -39,7 +39,6 @@ void DrawSlide::resizeEvent(QResizeEvent*)
 {
     if (resolution < 0 || page == nullptr)
         return;
-    qint16 const oldshiftx = shiftx, oldshifty = shifty;
     qreal const oldRes = resolution;
     QSizeF pageSize = page->pageSizeF();
     qreal pageWidth=pageSize.width();
@@ -56,11 +55,13 @@ void DrawSlide::resizeEvent(QResizeEvent*)
         shiftx = 0;
     }
     pathOverlay->setGeometry(geometry());
-    pathOverlay->rescale(oldshiftx, oldshifty, oldRes);
+    pathOverlay->rescale(oldRes);
 }
 
 void DrawSlide::animate(const int oldPageIndex)
 {
-    if (oldPageIndex != pageIndex)
+    if (oldPageIndex != pageIndex) {
+        pathOverlay->loadPage(pageLabel);
         pathOverlay->resetCache();
+    }
 }
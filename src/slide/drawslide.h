@@ -23,7 +23,7 @@
 #include <QDataStream>
 #include "mediaslide.h"
 #include "../draw/drawpath.h"
-#include "../pdf/singlerenderer.h"
+#include "../pdf/tilerenderer.h"
 #include "../draw/pathoverlay.h"
 
 class DrawSlide : public MediaSlide
@@ -70,14 +70,14 @@ MediaSlide::MediaSlide(QWidget* parent) : PreviewSlide(parent)
     connect(autostartTimer, &QTimer::timeout, this, &MediaSlide::startAllMultimedia);
 }
 
-void MediaSlide::clearAll()
+void MediaSlide::clearAll(bool const keepCache)
 {
     autostartTimer->stop();
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     autostartEmbeddedTimer->stop();
 #endif
     clearLists();
-    if (cache != nullptr)
+    if (cache != nullptr && !keepCache)
         cache->clearCache();
     qDeleteAll(cachedVideoWidgets);
     cachedVideoWidgets.clear();
@@ -88,7 +88,8 @@ void MediaSlide::clearAll()
     embedApps.clear();
     embedMap.clear();
 #endif
-    page = nullptr;
+    page.clear();
+    pageLabel.clear();
     pixmap = QPixmap();
 }
 
@@ -127,7 +128,7 @@ void MediaSlide::renderPage(int pageNumber, bool const hasDuration)
     // Use overlay specific options
     // A page is called an overlay of the previously rendered page, if they have the same label.
     // This is also the case, if the same page is rendered again (e.g. because the window is resized).
-    bool isOverlay = page!=nullptr && page->label() == doc->getLabel(pageNumber);
+    bool isOverlay = page!=nullptr && pageLabel == doc->getLabel(pageNumber);
     if (isOverlay) {
         qDeleteAll(links);
         linkPositions.clear();
@@ -628,7 +629,7 @@ void MediaSlide::updateCacheVideos(int const pageNumber)
         return;
     // Get a list of all video annotations on that page.
     QSet<Poppler::Annotation::SubType> videoType = QSet<Poppler::Annotation::SubType>();
-    Poppler::Page const* page = doc->getPage(pageNumber);
+    QSharedPointer<Poppler::Page const> const page = doc->getPage(pageNumber);
     if (page == nullptr || pageNumber == pageIndex)
         return;
     videoType.insert(Poppler::Annotation::AMovie);
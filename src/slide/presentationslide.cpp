@@ -153,9 +153,11 @@ void PresentationSlide::updateImages(int const oldPage)
         }
         painter.setRenderHint(QPainter::Antialiasing);
         painter.drawPixmap(shiftx, shifty, pixmap);
-        if (pathOverlay->end_cache >= 0)
+        if (pathOverlay->end_cache >= 0) {
             painter.drawPixmap(0, 0, pathOverlay->pixpaths);
-        pathOverlay->drawPaths(painter, page->label(), QRegion(rect()), false, false);
+            pathOverlay->drawUncachedPaths(painter, QRegion(rect()));
+        }
+        pathOverlay->drawPaths(painter, pageLabel, QRegion(rect()), false, false);
     }
 }
 
@@ -163,8 +165,11 @@ void PresentationSlide::animate(int const oldPageIndex) {
 #ifdef DEBUG_PAINT_EVENTS
     qDebug() << "presentation slide animate" << oldPageIndex << pageIndex;
 #endif
-    if (oldPageIndex != pageIndex)
+    if (oldPageIndex != pageIndex) {
+        // Paths of pages in an annotation file are loaded when the page is shown.
+        pathOverlay->loadPage(pageLabel);
         pathOverlay->resetCache();
+    }
     if (duration > -1e-6 && duration < .05) {
         if (transition_duration > 0)
             transition_duration = 0;
@@ -188,12 +193,14 @@ void PresentationSlide::animate(int const oldPageIndex) {
 
     /// Page transition for the current slide change.
     Poppler::PageTransition const* transition;
+    // The transition belongs to oldPage: keep the page until the transition is set up.
+    QSharedPointer<Poppler::Page const> oldPage;
     // If we move forward: transition is the transition associated with the new page.
     if (oldPageIndex < pageIndex)
         transition = page->transition();
     // If we move backward: transition is the transition associated with the old page.
     else{
-        Poppler::Page const* oldPage = doc->getPage(oldPageIndex);
+        oldPage = doc->getPage(oldPageIndex);
         if (oldPage == nullptr)
             transition = nullptr;
         else
@@ -26,6 +26,46 @@ PreviewSlide::PreviewSlide(PdfDoc const * const document, PagePart const part, Q
     pageIndex(0)
 {
     //setAttribute(Qt::WA_OpaquePaintEvent);
+    cacheConnection = connect(cache, &CacheMap::pageReady, this, &PreviewSlide::receivePage);
+    tileConnection = connect(cache, &CacheMap::tileReady, this, &PreviewSlide::receiveTile);
+}
+
+void PreviewSlide::overwriteCacheMap(CacheMap* newCache)
+{
+    // The old cache could already be deleted. Disconnecting using the connection is safe anyway.
+    disconnect(cacheConnection);
+    disconnect(tileConnection);
+    cache = newCache;
+    if (cache != nullptr) {
+        cacheConnection = connect(cache, &CacheMap::pageReady, this, &PreviewSlide::receivePage);
+        tileConnection = connect(cache, &CacheMap::tileReady, this, &PreviewSlide::receiveTile);
+    }
+}
+
+void PreviewSlide::receivePage(int const pageNumber)
+{
+    // Only the currently shown page is updated. The page might have been rendered
+    // for a different widget using the same cache.
+    if (pageNumber != pageIndex || page == nullptr)
+        return;
+    pixmap = cache->getPixmap(pageNumber);
+    update();
+}
+
+void PreviewSlide::receiveTile(int const pageNumber, QRect const& rect, QImage const& image)
+{
+    // The pixmap could belong to a different page or size if the page was
+    // rendered for a different widget using the same cache.
+    if (pageNumber != pageIndex || page == nullptr || pixmap.isNull() || !pixmap.rect().contains(rect))
+        return;
+    QPainter painter(&pixmap);
+    painter.drawImage(rect.topLeft(), image);
+    painter.end();
+    // Only repaint the new tile.
+    if (pagePart == RightHalf)
+        update(rect.translated(shiftx + width(), shifty));
+    else
+        update(rect.translated(shiftx, shifty));
 }
 
 void PreviewSlide::renderPage(int pageNumber)
@@ -73,6 +113,7 @@ void PreviewSlide::basicRenderPage(int const pageNumber)
 #endif
     // Set the new page and basic properties
     page = doc->getPage(pageNumber);
+    pageLabel = doc->getLabel(pageNumber);
     // This is given in point = inch/72 ≈ 0.353mm (Did they choose these units to bother programmers?)
     QSizeF pageSize = page->pageSizeF();
 
@@ -252,17 +293,18 @@ void PreviewSlide::paintEvent(QPaintEvent*)
         painter.drawPixmap(shiftx, shifty, pixmap);
 }
 
-void PreviewSlide::clearAll()
+void PreviewSlide::clearAll(bool const keepCache)
 {
     // Clear cache (if it exists).
-    if (cache != nullptr)
+    if (cache != nullptr && !keepCache)
         cache->clearCache();
     // Delete all links and link positions.
     qDeleteAll(links);
     links.clear();
     linkPositions.clear();
-    // Set page to nullptr.
-    page = nullptr;
+    // Release the page.
+    page.clear();
+    pageLabel.clear();
     // Clear pixmap.
     pixmap = QPixmap();
 }
@@ -52,7 +52,7 @@ public:
     /// Currently shown slide as pixmap.
     QPixmap const getPixmap(int const page);
     /// Overwrite PreviewSlide::cacheMap without deleting it.
-    void overwriteCacheMap(CacheMap* newCache) {cache = newCache;}
+    void overwriteCacheMap(CacheMap* newCache);
 
     // Set configuration.
     /// Set urlSplitCharacter.
@@ -63,7 +63,9 @@ public:
     /// Get current page number
     int pageNumber() const {return pageIndex;}
     /// Get current pdf page.
-    Poppler::Page const* getPage() {return page;}
+    Poppler::Page const* getPage() {return page.data();}
+    /// Get label of the current pdf page.
+    QString const& getLabel() const {return pageLabel;}
     /// Get position of the slide inside the widget (x direction).
     qint16 const& getXshift() const {return shiftx;}
     /// Get position of the slide inside the widget (y direction).
@@ -72,16 +74,23 @@ public:
 
     /// Clear all contents of the label.
     /// This function is called when the document is reloaded or the program is closed and everything should be cleaned up.
-    virtual void clearAll();
+    /// With keepCache the cached pages are kept (pages which changed in the document must be removed from cache separately).
+    virtual void clearAll(bool const keepCache = false);
     virtual bool isPresentation() const {return false;}
 
 protected:
     /// PDF document.
     PdfDoc const* doc = nullptr;
     /// Currently displayed slide.
-    Poppler::Page const* page = nullptr;
+    QSharedPointer<Poppler::Page const> page;
+    /// Label of page. This is used for every drawing operation and is therefore stored here.
+    QString pageLabel;
     /// Cache map for fast rendering of pages
     CacheMap* cache;
+    /// Connection of CacheMap::pageReady to receivePage.
+    QMetaObject::Connection cacheConnection;
+    /// Connection of CacheMap::tileReady to receiveTile.
+    QMetaObject::Connection tileConnection;
 
     /// Defines which part of the page is shown on this label.
     PagePart pagePart = FullPage;
@@ -121,6 +130,12 @@ protected:
 
     void toAbsoluteCoordinates(QRectF& relative) const;
 
+protected slots:
+    /// Replace a placeholder by the page which has been rendered in the background.
+    void receivePage(int const pageNumber);
+    /// Draw a tile which has been rendered in the background on the pixmap of a tiled page.
+    void receiveTile(int const pageNumber, QRect const& rect, QImage const& image);
+
 signals:
     /// Send a new page number to ControlScreen and PresentationScreen. The new page will be shown.
     void sendNewPageNumber(int const pageNumber);